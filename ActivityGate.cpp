@@ -0,0 +1,83 @@
+#include "ActivityGate.h"
+
+ActivityGate::ActivityGate() : _in(0), _out(0), _lastActive(0), _level(0xFFFFFFFF), _lookback(0), _hold(0), _divider(1), _skipped(0), _rate(1)
+{
+  memset(_base, 0, sizeof(_base));
+}
+
+void ActivityGate::configure(uint16_t level, uint8_t divider, uint16_t lookback, uint32_t hold)
+{
+  _level = level;
+  _divider = (divider > 0) ? divider : 1;
+  _lookback = (lookback < LINE) ? lookback : LINE - 1;
+  _hold = hold;
+}
+
+void ActivityGate::reset()
+{
+  _in = 0;
+  _out = 0;
+  _lastActive = 0;
+  _skipped = _divider - 1;                                                        // The first record is kept, the session starts on it
+  _rate = 1;
+}
+
+bool ActivityGate::active(const int16_t* axis)
+{
+  uint32_t dev = 0;
+  for (uint8_t a = 0; a < 3; a++)
+  {
+    if (_in == 0)
+    {
+      _base[a] = (int32_t)axis[a] << BASE_SHIFT;
+    }
+    int32_t d = axis[a] - (_base[a] >> BASE_SHIFT);
+    _base[a] += d;                                                                // base += (x - base) / 64, kept in fixed point
+    dev += (d < 0) ? -d : d;
+  }
+  return dev > _level;
+}
+
+bool ActivityGate::take(SamplePacket& out)
+{
+  uint32_t j = _out++;
+  bool full = (_lastActive > 0) && (_lastActive - 1 + _hold >= j);               // Newest activity at most lookback records later or hold earlier
+  if (!full && ++_skipped < _divider)
+  {
+    return false;
+  }
+  _skipped = 0;
+  _rate = full ? 1 : _divider;
+  out = _line[j & (LINE - 1)];
+  return true;
+}
+
+bool ActivityGate::put(const SamplePacket& in, SamplePacket& out)
+{
+  int16_t axis[3];
+  memcpy(axis, in.bytes, sizeof(axis));
+  if (active(axis))
+  {
+    _lastActive = _in + 1;
+  }
+  _line[_in & (LINE - 1)] = in;
+  _in++;
+  return (_in - _out > _lookback) && take(out);
+}
+
+bool ActivityGate::drain(SamplePacket& out)
+{
+  while (_out < _in)
+  {
+    if (take(out))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint8_t ActivityGate::rate() const
+{
+  return _rate;
+}
@@ -0,0 +1,43 @@
+#ifndef ACTIVITY_GATE_H
+#define ACTIVITY_GATE_H
+
+#include <Arduino.h>
+#include "IMUHandler.h"
+
+                                                                          // ADP start: every record waits `lookback` records in a delay line, then is
+                                                                          // kept at the full rate if sensor 1 was active within lookback records after
+                                                                          // it or hold records before it, else only 1 in divider of them is kept.
+                                                                          // Activity: |x - baseline| summed over the 3 axes above a level, the baseline
+                                                                          // following the signal slowly. Acquisition thread only.
+class ActivityGate
+{
+public:
+  static const uint16_t LINE = 256;                                       // Delay line (power of two, 7 KB): longest look-back
+  static const uint8_t BASE_SHIFT = 6;                                    // Baseline moves 1/64 of the way to each record
+
+  ActivityGate();
+
+  void configure(uint16_t level, uint8_t divider, uint16_t lookback, uint32_t hold);   // Sensor counts, records
+  void reset();                                                           // New recording, starts quiet
+  bool put(const SamplePacket& in, SamplePacket& out);                    // true - the record leaving the delay line is kept, in `out`
+  bool drain(SamplePacket& out);                                          // After the last put(): the kept records still in the line (false - none left)
+  uint8_t rate() const;                                                   // Divider of the record last returned: 1 full rate, else divider
+
+private:
+  SamplePacket _line[LINE];
+  uint32_t _in;                                                           // Records put so far
+  uint32_t _out;                                                          // Next record to leave the line
+  uint32_t _lastActive;                                                   // Index + 1 of the newest active record (0 - none yet)
+  int32_t _base[3];                                                       // Baseline << BASE_SHIFT
+  uint32_t _level;
+  uint16_t _lookback;
+  uint32_t _hold;
+  uint8_t _divider;
+  uint8_t _skipped;                                                       // Quiet records dropped since the last one kept
+  uint8_t _rate;
+
+  bool active(const int16_t* axis);
+  bool take(SamplePacket& out);                                           // Record _out leaves the line
+};
+
+#endif
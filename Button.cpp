@@ -1,9 +1,9 @@
 #include "Button.h"
 
-  ButtonHandler::ButtonHandler(int pin, Buzzer* buzzerPtr)   
+  ButtonHandler::ButtonHandler(int pin, PatternPlayer* playerPtr)   
   {
     _pin = pin;
-    _bz = buzzerPtr;                                                                            // Saving the buzzer address
+    _player = playerPtr;                                                                        // Saving the player address
     pinMode(_pin, INPUT_PULLUP);
   }
   
@@ -19,12 +19,12 @@
     
       if (_isPress)
       {
-        _bz->sound();
+        _player->play(PatternPlayer::PRESS);
         _holdFlag = false;                                                                      // Button has just been pressed, it hasn't been held down yet
       }
       else
       {
-        _bz->silence();
+        _player->stop();
         if (!_holdFlag)
         {
           event = SHORT_PRESS;                                                                  // Click! (released earlier than the hold activated)
@@ -84,7 +84,7 @@
       if (millis() - _stepTimer > STEP_TIME)                                              // Checking if the step interval (200ms) has passed since the last 'tick'
       {
         _stepTimer = millis();                                                            // Resetting the step timer
-        _bz->chirp();
+        _player->play(PatternPlayer::CHIRP);
         return true;                                                                      // The scroll "step" is triggered
       }
     }
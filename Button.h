@@ -2,7 +2,7 @@
 #define BUTTON_H
 
 #include <Arduino.h>
-#include "Buzzer.h"
+#include "PatternPlayer.h"
 
 class ButtonHandler
 {
@@ -16,7 +16,7 @@ public:
     LONG_PRESS = 2
   };
 
-  ButtonHandler(int pin, Buzzer* buzzerPtr);                                      
+  ButtonHandler(int pin, PatternPlayer* playerPtr);                                      
 
   Event getEvent();                                                               // Button polling method (0 - nothong, 1 - click, 2 - hold)
 
@@ -33,7 +33,7 @@ public:
 private:
 
   int _pin;
-  Buzzer* _bz;                                                                    // Link to the buzzer object
+  PatternPlayer* _player;                                                         // Key tone and step chirps
   uint32_t _timer;
   uint32_t _stepTimer;                                                            // Step Interval Timer
   bool _isPress;
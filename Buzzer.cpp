@@ -20,10 +20,3 @@ void Buzzer::silence()
 {
   noTone(_pin);
 }
-
-void Buzzer::chirp()
-{
-  tone(_pin, _volume);
-  delay(100);
-  silence();
-}
\ No newline at end of file
@@ -10,8 +10,7 @@ public:
   Buzzer(int pin);
   void setVolume(uint16_t volume);
   void sound();
-  void silence();
-  void chirp();
+  void silence();                                                         // Patterns (chirp, beeps) are played by PatternPlayer
 
 private:
   int _pin;
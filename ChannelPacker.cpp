@@ -0,0 +1,241 @@
+#include "ChannelPacker.h"
+
+static uint16_t slotBits(const ChannelSet& set, uint8_t k)                        // Values of slot k, without its presence bit
+{
+  uint16_t n = 0;
+  for (uint8_t a = 0; a < 3; a++)
+  {
+    n += ((set.axes[k] >> a) & 1) * set.bits[k];
+  }
+  return n;
+}
+
+static uint32_t getBits(const uint8_t* data, uint32_t& pos, uint8_t width)
+{
+  uint32_t v = 0;
+  for (uint8_t i = 0; i < width; i++, pos++)
+  {
+    v |= (uint32_t)((data[pos >> 3] >> (pos & 7)) & 1) << i;
+  }
+  return v;
+}
+
+ChannelPacker::ChannelPacker() : _page(nullptr), _bit(0), _recBits(0), _recPos(0), _time(0), _started(false), _mark(0)
+{
+  _set = ChannelSet::forMode(0);
+}
+
+bool ChannelPacker::isOpen() const
+{
+  return _page != nullptr;
+}
+
+bool ChannelPacker::pending() const
+{
+  return _recPos < _recBits;
+}
+
+void ChannelPacker::reset()
+{
+  _page = nullptr;
+  _recBits = 0;
+  _recPos = 0;
+  _started = false;
+  _mark = 0;
+}
+
+void ChannelPacker::start(const ChannelSet& set)
+{
+  reset();
+  _set = set;
+}
+
+void ChannelPacker::begin(uint8_t* page)
+{
+  _page = page;
+  memset(_page, 0xFF, PAGE_SIZE);
+  _bit = 0;
+  emit();
+}
+
+void ChannelPacker::stage(uint32_t value, uint8_t width)
+{
+  for (uint8_t i = 0; i < width; i++, _recBits++)
+  {
+    if ((value >> i) & 1)
+    {
+      _rec[_recBits >> 3] |= 1 << (_recBits & 7);
+    }
+  }
+}
+
+void ChannelPacker::emit()
+{
+  for (; _recPos < _recBits && _bit < PAGE_SIZE * 8; _recPos++, _bit++)
+  {
+    if (!((_rec[_recPos >> 3] >> (_recPos & 7)) & 1))
+    {
+      _page[_bit >> 3] &= ~(1 << (_bit & 7));                                     // Page starts as 0xFF, only zeros are written
+    }
+  }
+}
+
+void ChannelPacker::mark(uint8_t divider)
+{
+  _mark = divider;
+}
+
+void ChannelPacker::stageFields(const SamplePacket& packet, uint8_t present)
+{
+  for (uint8_t k = 0; k < ChannelSet::SLOTS && _set.sensor[k] != ChannelSet::NONE; k++)
+  {
+    if (_set.axes[k] & ChannelSet::SPARSE)
+    {
+      stage((present >> k) & 1, 1);
+      if (!((present >> k) & 1))
+      {
+        continue;
+      }
+    }
+    int16_t axis[3];
+    memcpy(axis, packet.bytes + SamplePacket::slotOffset(k), sizeof(axis));
+    int32_t hi = (1 << (_set.bits[k] - 1)) - 1;
+    for (uint8_t a = 0; a < 3; a++)
+    {
+      if (_set.axes[k] & (1 << a))
+      {
+        int32_t v = axis[a];
+        v = (v > hi) ? hi : (v < -hi - 1) ? -hi - 1 : v;
+        stage((uint32_t)v, _set.bits[k]);
+      }
+    }
+  }
+}
+
+bool ChannelPacker::add(const SamplePacket& packet)
+{
+  if (_bit >= PAGE_SIZE * 8 || pending())
+  {
+    return false;
+  }
+  memset(_rec, 0, sizeof(_rec));
+  _recBits = 0;
+  _recPos = 0;
+
+  uint32_t t;
+  memcpy(&t, packet.bytes + 12, 4);
+  uint32_t delta = _started ? t - (uint32_t)_time : 0;                            // Modulo 2^32: micros() wrapping in between is a normal step
+  _time = _started ? _time + delta : t;
+  if (!_started)
+  {
+    const uint8_t magic[3] = {'C', 'S', VERSION};
+    for (uint8_t i = 0; i < 3; i++)
+    {
+      stage(magic[i], 8);
+    }
+    const uint8_t* set = (const uint8_t*)&_set;
+    for (uint8_t i = 0; i < sizeof(ChannelSet); i++)
+    {
+      stage(set[i], 8);
+    }
+    stage((uint32_t)_time, 32);
+    stage((uint32_t)(_time >> 32), 32);
+    _started = true;
+  }
+  if (_mark != 0)                                                                 // Laid out like a record with every slot present
+  {
+    SamplePacket rate;
+    memset(rate.bytes, 0, sizeof(rate.bytes));
+    rate.bytes[SamplePacket::slotOffset(0)] = _mark;                              // First field: the divider
+    stageFields(rate, 0xFF);
+    stage((1UL << _set.timeBits) - 2, _set.timeBits);
+    _mark = 0;
+  }
+
+  stageFields(packet, packet.present);
+  uint32_t maxDelta = (1UL << _set.timeBits) - 3;
+  stage((delta > maxDelta) ? maxDelta : delta, _set.timeBits);                    // A longer stall is clipped; RunStats counts its missed ticks
+  emit();
+  return true;
+}
+
+void ChannelPacker::finish()
+{
+  _page = nullptr;
+}
+
+uint32_t ChannelPacker::decode(const uint8_t* data, uint32_t len, ChannelSet& set, SamplePacket* out, uint32_t maxPackets, uint8_t* divider)
+{
+  if (len < HEADER || data[0] != 'C' || data[1] != 'S' || data[2] == 0 || data[2] > VERSION)
+  {
+    return 0;
+  }
+  memcpy(&set, data + 3, sizeof(set));
+  uint64_t time;
+  memcpy(&time, data + 3 + sizeof(set), 8);
+  uint32_t end = len * 8;
+  uint32_t pos = HEADER * 8;
+  uint32_t n = 0;
+  uint8_t rate = 1;
+  while (n < maxPackets)
+  {
+    SamplePacket& p = out[n];
+    memset(p.bytes, 0, sizeof(p.bytes));
+    p.present = 0;
+    bool cut = false;
+    for (uint8_t k = 0; k < ChannelSet::SLOTS && set.sensor[k] != ChannelSet::NONE; k++)
+    {
+      if (set.axes[k] & ChannelSet::SPARSE)
+      {
+        cut = (pos >= end);
+        if (cut)
+        {
+          break;
+        }
+        if (!getBits(data, pos, 1))
+        {
+          continue;                                                                 // Not read on this tick
+        }
+      }
+      cut = (pos + slotBits(set, k) > end);
+      if (cut)
+      {
+        break;
+      }
+      int16_t axis[3] = {0, 0, 0};
+      for (uint8_t a = 0; a < 3; a++)
+      {
+        if (set.axes[k] & (1 << a))
+        {
+          uint32_t v = getBits(data, pos, set.bits[k]);
+          axis[a] = (int16_t)((int32_t)(v << (32 - set.bits[k])) >> (32 - set.bits[k]));   // Sign extension
+        }
+      }
+      memcpy(p.bytes + SamplePacket::slotOffset(k), axis, sizeof(axis));
+      p.present |= 1 << k;
+    }
+    if (cut || pos + set.timeBits > end)
+    {
+      break;
+    }
+    uint32_t delta = getBits(data, pos, set.timeBits);
+    if (delta == (1UL << set.timeBits) - 1)                                        // Erased: end of data
+    {
+      break;
+    }
+    if (data[2] > 1 && delta == (1UL << set.timeBits) - 2)                        // Rate record, not a sample (version 1: a clipped stall)
+    {
+      rate = p.bytes[SamplePacket::slotOffset(0)];
+      continue;
+    }
+    time += delta;
+    uint32_t t = (uint32_t)time;
+    memcpy(p.bytes + 12, &t, 4);
+    if (divider != nullptr)
+    {
+      divider[n] = rate;
+    }
+    n++;
+  }
+  return n;
+}
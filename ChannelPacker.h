@@ -0,0 +1,57 @@
+#ifndef CHANNEL_PACKER_H
+#define CHANNEL_PACKER_H
+
+#include <Arduino.h>
+#include "IMUHandler.h"
+#include "ChannelSet.h"
+
+                                                                          // SCHEMA_CHANNELS: one bitstream over all pages of the session, LSB first.
+                                                                          // Header ['C' 'S'][version][ChannelSet][base time u64], then records: per
+                                                                          // slot and axis a two's complement value of the slot width, then the time
+                                                                          // delta to the previous record. A SPARSE slot (read slower than the ticks)
+                                                                          // has a presence bit first and its values only when that is 1; without
+                                                                          // SPARSE slots every record has the same size. Records run on across page
+                                                                          // ends, so every page is full except the last, whose rest stays 0xFF
+                                                                          // (an all-ones time delta is never written and marks the end). A time
+                                                                          // delta of all ones but bit 0 marks a rate record instead: laid out with
+                                                                          // every slot present, its first field holds the divider of the records
+                                                                          // that follow (ADP recordings).
+class ChannelPacker
+{
+public:
+  static const uint16_t PAGE_SIZE = 256;
+  static const uint8_t VERSION = 3;                                       // 2: no SPARSE slots, 1: no rate records either
+  static const uint8_t HEADER = 3 + sizeof(ChannelSet) + 8;
+  static const uint8_t MAX_RECORD = ChannelSet::SLOTS * 6 + 5;            // Bytes: every slot at 3 x 16 bits and a presence bit, 32-bit time
+
+  ChannelPacker();
+
+  void start(const ChannelSet& set);                                      // New recording: the header goes ahead of the first record
+  void begin(uint8_t* page);                                              // Starts a page with the rest of a record cut at the end of the last one
+  void mark(uint8_t divider);                                             // The next record add()s is the first at 1 / divider of the rate
+  bool add(const SamplePacket& packet);                                   // false - the page is full, finish() it and begin() the next
+  void finish();                                                          // The page is done (the last one keeps 0xFF after the data)
+  void reset();                                                           // Drops an unfinished page and any cut record
+  bool isOpen() const;
+  bool pending() const;                                                   // Part of a record is waiting for the next page
+
+  static uint32_t decode(const uint8_t* data, uint32_t len, ChannelSet& set, SamplePacket* out, uint32_t maxPackets,
+                         uint8_t* divider = nullptr);                     // Pages of a session in order, optionally the divider of each record
+
+private:
+  ChannelSet _set;
+  uint8_t* _page;
+  uint16_t _bit;                                                          // Next bit of the page
+  uint8_t _rec[HEADER + 2 * MAX_RECORD];                                  // Record being written, with the header and a rate record in front
+  uint16_t _recBits;
+  uint16_t _recPos;                                                       // Bits of _rec already in pages
+  uint64_t _time;                                                         // Time of the last record, extended to 64 bits
+  bool _started;
+  uint8_t _mark;                                                          // Divider for the rate record ahead of the next record (0 - none)
+
+  void stage(uint32_t value, uint8_t width);
+  void stageFields(const SamplePacket& packet, uint8_t present);
+  void emit();
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "ChannelSet.h"
+
+#define BITS_ACC 16
+#define BITS_GYR 16
+#define BITS_MAG 13                                                               // BMM150 x/y are 13-bit, z is cut to 11 bits by readMag()
+#define BITS_COI 16                                                               // CoilSampler: oversampled and scaled by GAIN to int16
+#define BITS_TIME 20                                                              // Up to ~1 s between records
+
+ChannelSet ChannelSet::forMode(uint8_t mode)
+{
+  static const uint8_t sets[MODES][SLOTS] =                                       // Same order as the SENSORS menu
+  {
+    {ACC, COI, NONE, NONE}, {ACC, GYR, NONE, NONE}, {ACC, MAG, NONE, NONE},
+    {GYR, MAG, NONE, NONE}, {GYR, COI, NONE, NONE}, {MAG, COI, NONE, NONE},
+    {ACC, GYR, MAG, NONE}, {ACC, GYR, MAG, COI},
+    {ACC, NONE, NONE, NONE}, {GYR, NONE, NONE, NONE}, {MAG, NONE, NONE, NONE}, {COI, NONE, NONE, NONE}
+  };
+  static const uint8_t widths[4] = {BITS_ACC, BITS_GYR, BITS_MAG, BITS_COI};
+  ChannelSet set;
+  for (uint8_t k = 0; k < SLOTS; k++)
+  {
+    uint8_t s = (mode < MODES) ? sets[mode][k] : NONE;
+    set.sensor[k] = s;
+    set.axes[k] = (s == NONE) ? 0 : 0x07;                                         // Coil: CoilSampler::SUBSAMPLES values per record in the axis slots
+    set.bits[k] = (s == NONE) ? 0 : widths[s];
+  }
+  set.timeBits = BITS_TIME;
+  return set;
+}
+
+uint8_t ChannelSet::channels() const
+{
+  uint8_t n = 0;
+  for (uint8_t k = 0; k < SLOTS; k++)
+  {
+    for (uint8_t a = 0; a < 3; a++)
+    {
+      n += (axes[k] >> a) & 1;
+    }
+  }
+  return n;
+}
+
+uint16_t ChannelSet::recordBits() const
+{
+  uint16_t n = timeBits;
+  for (uint8_t k = 0; k < SLOTS; k++)
+  {
+    for (uint8_t a = 0; a < 3; a++)
+    {
+      n += ((axes[k] >> a) & 1) * bits[k];
+    }
+    n += (axes[k] & SPARSE) ? 1 : 0;
+  }
+  return n;
+}
+
+bool ChannelSet::sparse() const
+{
+  for (uint8_t k = 0; k < SLOTS; k++)
+  {
+    if (axes[k] & SPARSE)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ChannelSet::has(uint8_t s) const
+{
+  for (uint8_t k = 0; k < SLOTS; k++)
+  {
+    if (sensor[k] == s)
+    {
+      return true;
+    }
+  }
+  return false;
+}
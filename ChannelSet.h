@@ -0,0 +1,34 @@
+#ifndef CHANNEL_SET_H
+#define CHANNEL_SET_H
+
+#include <Arduino.h>
+
+                                                                          // Which sensors, axes and widths a SCHEMA_CHANNELS recording stores.
+                                                                          // Slot k of the set is slot k of the SamplePacket. The set is written at the
+                                                                          // start of the recording, so a decoder needs nothing else.
+struct ChannelSet
+{
+  static const uint8_t SLOTS = 4;
+  static const uint8_t NONE = 0xFF;
+  static const uint8_t MODES = 12;                                        // SENSORS menu entries: the 6 pairs, A/G/M, all four, then each sensor alone
+  static const uint8_t PAIR_MODES = 6;                                    // Modes the 16-byte pair layouts can hold
+  static const uint8_t SPARSE = 0x08;                                     // axes flag: the slot runs slower than the records, a presence bit
+                                                                          // goes ahead of its values and they are stored only when it is 1
+  enum Sensor                                                             // Same numbers as IMUHandler::Sensor
+  {
+    ACC, GYR, MAG, COI
+  };
+
+  uint8_t sensor[SLOTS];                                                  // NONE - slot unused, the used slots come first
+  uint8_t axes[SLOTS];                                                    // Bit mask: 1 x, 2 y, 4 z, SPARSE
+  uint8_t bits[SLOTS];                                                    // Stored width per axis (2-16), readings saturate to it
+  uint8_t timeBits;                                                       // Time delta to the previous record in us (all ones: end of data)
+
+  static ChannelSet forMode(uint8_t mode);
+  uint8_t channels() const;                                               // Axes stored per record
+  uint16_t recordBits() const;                                            // Longest record: every SPARSE slot present
+  bool has(uint8_t s) const;
+  bool sparse() const;                                                    // Some slot is SPARSE: records differ in size
+};
+
+#endif
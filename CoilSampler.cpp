@@ -0,0 +1,148 @@
+#include "CoilSampler.h"
+
+#define ADC_MID 2048                                                              // 12-bit single-ended, coil biased at VDD/2
+#define ADC_SHIFT 4                                                               // 12-bit mean -> 16-bit: oversampling fills the low bits
+
+CoilSampler* CoilSampler::_active = nullptr;
+
+CoilSampler::CoilSampler(uint8_t ain) : _ain(ain), _gain(UNITY_GAIN), _decimation(1), _block(BLOCK), _tail(0), _lagMax(RING), _sum(0), _count(0), _filling(0), _head(0)
+{
+  memset(_ring, 0, sizeof(_ring));
+}
+
+int16_t CoilSampler::scale(int32_t sum) const
+{
+  int32_t v = (sum - (int32_t)_decimation * ADC_MID) * (1 << ADC_SHIFT) / (int32_t)_decimation;  // +/- 32768 at most, so x gain still fits
+  v = v * _gain / UNITY_GAIN;
+  return (int16_t)((v > 32767) ? 32767 : (v < -32768) ? -32768 : v);
+}
+
+void CoilSampler::configure(uint32_t recordHz, uint16_t gain)
+{
+  uint32_t valuesHz = recordHz * SUBSAMPLES;
+  _decimation = (valuesHz >= ADC_RATE) ? 1 : ADC_RATE / valuesHz;
+  uint32_t period = _decimation * SUBSAMPLES;                                     // Conversions per record
+  _block = (period < BLOCK) ? period : BLOCK;                                     // Fast records: an END per record, so every read finds fresh values
+  _lagMax = 2 * ((_block + _decimation - 1) / _decimation) + SUBSAMPLES;          // Two buffers and a record absorb a late tick, more is rate rounding
+  _gain = gain;
+  _sum = 0;
+  _count = 0;
+  _filling = 0;
+  _tail = 0;
+  _head.store(0);
+}
+
+void CoilSampler::put(int16_t value)
+{
+  uint32_t head = _head.load(std::memory_order_relaxed);
+  _ring[head & (RING - 1)] = value;
+  _head.store(head + 1, std::memory_order_release);
+}
+
+void CoilSampler::consume(const int16_t* conv, uint16_t n)
+{
+  for (uint16_t i = 0; i < n; i++)
+  {
+    _sum += conv[i];
+    if (++_count == _decimation)
+    {
+      put(scale(_sum));
+      _sum = 0;
+      _count = 0;
+    }
+  }
+}
+
+void CoilSampler::read(int16_t* dest)
+{
+  uint32_t head = _head.load(std::memory_order_acquire);                          // A block adds at most BLOCK / _decimation values, far fewer than RING
+  if (head - _tail > _lagMax)
+  {
+    _tail = head - _lagMax;                                                       // The ADC ran ahead of the records (decimation rounds down)
+  }
+  if (head - _tail < SUBSAMPLES)
+  {
+    _tail = head - SUBSAMPLES;                                                    // Record ahead of the ADC: the newest values again
+  }
+  for (uint8_t i = 0; i < SUBSAMPLES; i++, _tail++)
+  {
+    dest[i] = (head - _tail <= head) ? _ring[_tail & (RING - 1)] : 0;             // Before value 0: nothing converted yet right after start()
+  }
+}
+
+#if defined(NRF52840_XXAA)                                                        // The host simulation has its own start()/stop() (host/sim)
+
+#define SAADC_CC (16000000UL / CoilSampler::ADC_RATE)                             // Internal sample timer, 80..2047
+#define COIL_PPI_CH 7                                                             // Fixed PPI channel: SAADC END -> START
+
+void CoilSampler::irq()
+{
+  CoilSampler* self = _active;
+  if (NRF_SAADC->EVENTS_END)                                                      // Before STARTED: both may be pending, the finished buffer is the older one
+  {
+    NRF_SAADC->EVENTS_END = 0;
+    self->consume(self->_buffers[self->_filling], self->_block);
+    self->_filling ^= 1;
+  }
+  if (NRF_SAADC->EVENTS_STARTED)                                                  // PTR is latched, queue the other buffer for the next START
+  {
+    NRF_SAADC->EVENTS_STARTED = 0;
+    NRF_SAADC->RESULT.PTR = (uint32_t)self->_buffers[self->_filling ^ 1];
+  }
+}
+
+void CoilSampler::start(uint32_t recordHz, uint16_t gain)
+{
+  configure(recordHz, gain);
+  _active = this;
+
+  NRF_SAADC->ENABLE = 0;
+  NRF_SAADC->RESOLUTION = SAADC_RESOLUTION_VAL_12bit;
+  NRF_SAADC->OVERSAMPLE = SAADC_OVERSAMPLE_OVERSAMPLE_Bypass;                    // Averaged in consume(): the hardware oversampler can't run on the timer
+  for (uint8_t ch = 0; ch < 8; ch++)
+  {
+    NRF_SAADC->CH[ch].PSELP = SAADC_CH_PSELP_PSELP_NC;
+  }
+  NRF_SAADC->CH[0].CONFIG = (SAADC_CH_CONFIG_GAIN_Gain1_4 << SAADC_CH_CONFIG_GAIN_Pos) |   // 0..VDD full scale
+                            (SAADC_CH_CONFIG_REFSEL_VDD1_4 << SAADC_CH_CONFIG_REFSEL_Pos) |
+                            (SAADC_CH_CONFIG_TACQ_3us << SAADC_CH_CONFIG_TACQ_Pos) |   // 3 + 2 us, well inside the 15.6 us period
+                            (SAADC_CH_CONFIG_MODE_SE << SAADC_CH_CONFIG_MODE_Pos);
+  NRF_SAADC->CH[0].PSELN = SAADC_CH_PSELN_PSELN_NC;
+  NRF_SAADC->CH[0].PSELP = SAADC_CH_PSELP_PSELP_AnalogInput0 + _ain;
+  NRF_SAADC->SAMPLERATE = (SAADC_CC << SAADC_SAMPLERATE_CC_Pos) | (SAADC_SAMPLERATE_MODE_Timers << SAADC_SAMPLERATE_MODE_Pos);
+  NRF_SAADC->RESULT.PTR = (uint32_t)_buffers[0];
+  NRF_SAADC->RESULT.MAXCNT = _block;
+
+  NRF_PPI->CH[COIL_PPI_CH].EEP = (uint32_t)&NRF_SAADC->EVENTS_END;                // Next buffer starts without waiting for the interrupt
+  NRF_PPI->CH[COIL_PPI_CH].TEP = (uint32_t)&NRF_SAADC->TASKS_START;
+  NRF_PPI->CHENSET = 1UL << COIL_PPI_CH;
+
+  NRF_SAADC->EVENTS_END = 0;
+  NRF_SAADC->EVENTS_STARTED = 0;
+  NRF_SAADC->INTENSET = SAADC_INTENSET_END_Msk | SAADC_INTENSET_STARTED_Msk;
+  NVIC_SetVector(SAADC_IRQn, (uint32_t)&CoilSampler::irq);
+  NVIC_SetPriority(SAADC_IRQn, 3);
+  NVIC_ClearPendingIRQ(SAADC_IRQn);
+  NVIC_EnableIRQ(SAADC_IRQn);
+
+  NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Enabled;
+  NRF_SAADC->TASKS_START = 1;
+  NRF_SAADC->TASKS_SAMPLE = 1;                                                    // Starts the internal timer, it keeps sampling from here on
+}
+
+void CoilSampler::stop()
+{
+  NRF_PPI->CHENCLR = 1UL << COIL_PPI_CH;
+  NVIC_DisableIRQ(SAADC_IRQn);
+  NRF_SAADC->INTENCLR = SAADC_INTENCLR_END_Msk | SAADC_INTENCLR_STARTED_Msk;
+  NRF_SAADC->EVENTS_STOPPED = 0;
+  NRF_SAADC->TASKS_STOP = 1;
+  while (NRF_SAADC->EVENTS_STOPPED == 0)
+  {
+  }
+  NRF_SAADC->EVENTS_STOPPED = 0;
+  NRF_SAADC->ENABLE = 0;                                                          // analogRead() can use the SAADC again
+  _active = nullptr;
+}
+
+#endif
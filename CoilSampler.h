@@ -0,0 +1,50 @@
+#ifndef COIL_SAMPLER_H
+#define COIL_SAMPLER_H
+
+#include <Arduino.h>
+#include <atomic>
+
+                                                                          // Coil input sampled by the SAADC on its own timer, independent of the sensor
+                                                                          // ticks: EasyDMA fills two buffers in turn (END restarts the next one through
+                                                                          // PPI), the SAADC interrupt averages each buffer down to SUBSAMPLES values per
+                                                                          // record period and applies the GAIN setting. A buffer holds at most one record
+                                                                          // period of conversions, and every record takes the values produced since the
+                                                                          // one before it instead of one analogRead() copied to three axes.
+class CoilSampler
+{
+public:
+  static const uint8_t SUBSAMPLES = 3;                                    // Coil values per record, in the x/y/z slots: oldest first
+  static const uint32_t ADC_RATE = 64000;                                 // SAADC conversions per second (16 MHz / 250)
+  static const uint16_t BLOCK = 256;                                      // Most conversions per DMA buffer: 250 interrupts per second up to 250 Hz records
+  static const uint16_t RING = 64;                                        // Decimated values kept for read() (power of two)
+  static const uint16_t UNITY_GAIN = 100;                                 // GAIN 100: the ADC range maps to the full int16 range
+
+  explicit CoilSampler(uint8_t ain);                                      // SAADC input AINn
+
+  void start(uint32_t recordHz, uint16_t gain);                           // One value per 1/(SUBSAMPLES * recordHz), averaged over the conversions in it
+  void stop();
+  void read(int16_t* dest);                                               // Acquisition thread: the next SUBSAMPLES values since the last read, oldest first
+
+private:
+  uint8_t _ain;
+  uint16_t _gain;
+  uint32_t _decimation;                                                   // Conversions per value
+  uint16_t _block;                                                        // Conversions per DMA buffer: one record period, BLOCK at most
+  uint32_t _tail;                                                         // Next value read() takes (acquisition thread only)
+  uint32_t _lagMax;                                                       // Values read() may fall behind before the oldest are skipped
+  int32_t _sum;                                                           // Conversions of the value in progress
+  uint32_t _count;
+  int16_t _buffers[2][BLOCK];                                             // EasyDMA targets, one converts while the other is averaged
+  uint8_t _filling;                                                       // Buffer the SAADC writes now
+  int16_t _ring[RING];
+  std::atomic<uint32_t> _head;                                            // Values produced so far
+
+  static CoilSampler* _active;                                            // Instance served by the SAADC interrupt
+  static void irq();
+  void configure(uint32_t recordHz, uint16_t gain);                       // Decimation and buffer size of a recording, empty ring
+  void consume(const int16_t* conv, uint16_t n);                          // Interrupt: averages a full buffer into _ring
+  int16_t scale(int32_t sum) const;                                       // Mean around mid-scale, x16 (oversampled bits), x gain / 100, saturated
+  void put(int16_t value);
+};
+
+#endif
@@ -1,13 +1,13 @@
 #include "Display.h"
+#include "ChannelSet.h"
 
 extern ACROBOTIC_SSD1306 oled; 
 
-Display::Display(Buzzer* buzzerPtr, Leds* ledsPtr, Storage* m1Ptr, Storage* m2Ptr) : _currentLine(0), _isEditing(false)
+Display::Display(PatternPlayer* playerPtr, SessionLog* logPtr) : _currentLine(0), _isEditing(false), _timerSeconds(0), _timerTick(0),
+  _screen(&oled)
 {
-  _bz = buzzerPtr; 
-  _ld = ledsPtr; 
-  _m1 = m1Ptr;
-  _m2 = m2Ptr;
+  _player = playerPtr;
+  _log = logPtr;
   for (int i = 0; i < REDACTOR_ITEMS; i++)
   {
     _stats[i] = 0;
@@ -57,7 +57,7 @@ void Display::update(ButtonHandler::Event event)
 
 void Display::incrementValue(uint8_t line)
 {
-  uint8_t limits[] = {6, 20, 11, 2, 16}; 
+  uint8_t limits[] = {ChannelSet::MODES, 21, 11, 4, 16}; 
   if (line < REDACTOR_ITEMS)
   {
     _stats[line] = (_stats[line] + 1) % limits[line];
@@ -66,10 +66,10 @@ void Display::incrementValue(uint8_t line)
 
 const char* Display::getValueText(uint8_t line)
 {
-    static const char* s_sensors[] = {"A/C", "A/G", "A/M", "G/M", "G/C", "M/C"};
-    static const char* s_freq[]    = {"050", "100", "150", "200", "250", "300", "350", "400", "450", "500", "550", "600", "650", "700", "750", "800", "850", "900", "950", "01K"};
+    static const char* s_sensors[] = {"A/C", "A/G", "A/M", "G/M", "G/C", "M/C", "AGM", "ALL", "A  ", "G  ", "M  ", "C  "};
+    static const char* s_freq[]    = {"050", "100", "150", "200", "250", "300", "350", "400", "450", "500", "550", "600", "650", "700", "750", "800", "850", "900", "950", "01K", "1K6"};
     static const char* s_gain[]    = {"001", "100", "200", "300", "400", "500", "600", "700", "800", "900", "01K"};
-    static const char* s_init[]    = {"TIM", "HIT"};
+    static const char* s_init[]    = {"TIM", "HIT", "STR", "ADP"};
     static const char* s_time[]    = {"05s", "10s", "15s", "20s", "25s", "30s", "35s", "40s", "45s", "50s", "55s", "60s", "02m", "03m", "04m", "05m"};
 
     switch (line)
@@ -89,79 +89,97 @@ void Display::render()
     
   for (uint8_t i = 0; i < MENU_ITEMS_COUNT; i++)
   {
-    oled.setTextXY(i, 0);
-    oled.putString((_currentLine == i && !_isEditing) ? ">" : " ");
-    oled.putString(labels[i]);
+    _screen.print(i, 0, (_currentLine == i && !_isEditing) ? ">" : " ");
+    _screen.print(i, 1, labels[i]);
 
     if (i < REDACTOR_ITEMS)
     {
-      oled.setTextXY(i, 11);
-      oled.putString((_currentLine == i && _isEditing) ? ">" : " ");
-      oled.putString(getValueText(i));
+      _screen.print(i, 11, (_currentLine == i && _isEditing) ? ">" : " ");
+      _screen.print(i, 12, getValueText(i));
     }
   }
 }
 
-bool Display::runTimer(int seconds, ButtonHandler* button)
+void Display::clear()
 {
-  _bz->silence();
-  oled.sendCommand(0xA7);                                                                                 // Screen inversion (white background)
-  
-  while (seconds >= 0)
-  {
-    if (button->getEvent() == ButtonHandler::LONG_PRESS)                                                 // Check interruption by button (LONG_PRESS)
-    {
-      oled.sendCommand(0xA6);                                                                            // Screen return
-      return false; 
-    }
+  _screen.clear();
+}
 
-    oled.clearDisplay();
-    oled.setTextXY(CURSOR_X_CENTER, 5); 
-    char buf[10];
-    sprintf(buf, "%02d:%02d", seconds / 60, seconds % 60);
-    oled.putString(buf);
+void Display::showMessage(uint8_t row, uint8_t col, const char* text)
+{
+  _screen.clear();
+  _screen.print(row, col, text);
+  _screen.flush(TextScreen::NO_BUDGET);
+}
 
-    unsigned long startM = millis();
-    while (millis() - startM < 1000)                                                                    // 1-second pause with button polling inside
-    {
-      if (button->getEvent() == ButtonHandler::LONG_PRESS)
-      {
-        oled.sendCommand(0xA6);
-        return false;
-      }
-    }
-    seconds--;
-    _bz->chirp();
+bool Display::refresh(uint32_t budgetUs)
+{
+  return _screen.flush(budgetUs);
+}
+
+static void formatTimer(char* buf, size_t size, int seconds)                                           // mm:ss, clamped to 00:00 .. 99:59
+{
+  unsigned s = (seconds < 0) ? 0 : (seconds > 99 * 60 + 59) ? 99 * 60 + 59 : (unsigned)seconds;
+  snprintf(buf, size, "%02u:%02u", s / 60, s % 60);
+}
+
+void Display::startTimer(int seconds)
+{
+  _player->stop();
+  oled.sendCommand(0xA7);                                                                                 // Screen inversion (white background)
+  _timerSeconds = (seconds > 0) ? seconds : 0;
+  _timerTick = millis();
+  char buf[10];
+  formatTimer(buf, sizeof buf, _timerSeconds);
+  showMessage(CURSOR_X_CENTER, 5, buf);
+}
+
+Display::TimerState Display::runTimer(ButtonHandler::Event event)
+{
+  if (event == ButtonHandler::LONG_PRESS)                                                                // Check interruption by button (LONG_PRESS)
+  {
+    oled.sendCommand(0xA6);                                                                              // Screen return
+    return TIMER_CANCELLED;
+  }
+  if (millis() - _timerTick < 1000)
+  {
+    return TIMER_RUNNING;
   }
-  oled.sendCommand(0xA6);                                                                              // Normal mode
-  return true;
+  _timerTick += 1000;
+  _timerSeconds--;
+  _player->play(PatternPlayer::CHIRP);
+  if (_timerSeconds < 0)
+  {
+    oled.sendCommand(0xA6);                                                                              // Normal mode
+    return TIMER_DONE;
+  }
+  char buf[10];
+  formatTimer(buf, sizeof buf, _timerSeconds);
+  _screen.print(CURSOR_X_CENTER, 5, buf);                                                                // Only the digits that changed are sent by refresh()
+  return TIMER_RUNNING;
 }
 
 void Display::executeAction(uint8_t line)
 {
   if (line == 5)
   {                                                                                                   // GETDATA
-    oled.clearDisplay();
-    oled.setTextXY(0, 0);
-    oled.putString("TRANSFER MODE");
-    oled.setTextXY(1, 0);
-    oled.putString("Sending to PC...");
+    _screen.clear();
+    _screen.print(0, 0, "TRANSFER MODE");
+    _screen.print(1, 0, "Sending to PC...");
   }
   else if (line == 7)
   {                                                                                                  // CLEAR
-    showCleaningProgress();
-    oled.clearDisplay();
-    oled.setTextXY(CURSOR_X_CENTER, 5);
-    oled.putString("DONE!");
-    _bz->chirp(); 
-    delay(1500);
+    bool done = showCleaningProgress();
+    showMessage(CURSOR_X_CENTER, 5, done ? "DONE!" : "CLEAR FAILED");
+    _player->play(done ? PatternPlayer::CHIRP : PatternPlayer::FAILURE);
+    delay(1500);                                                                                    // Keeps the message up, the chirp plays meanwhile
   }
 }
 
                                                                                                     // Getters for external use
 int Display::getSelectedFreq()
 {
-  static int freqs[] = {50, 100, 150, 200, 250, 300, 350, 400, 450, 500, 550, 600, 650, 700, 750, 800, 850, 900, 950, 1000};
+  static int freqs[] = {50, 100, 150, 200, 250, 300, 350, 400, 450, 500, 550, 600, 650, 700, 750, 800, 850, 900, 950, 1000, 1600};                   // 1600: A/G is batched through the BMI270 FIFO
   return freqs[_stats[1]];
 }
 int Display::getSelectedGain()
@@ -176,7 +194,7 @@ int Display::getSelectedTime()
 }
 int Display::getSelectedInit()
 { 
-  return _stats[3];                                                                                 // 0: TIM, 1: HIT
+  return _stats[3];                                                                                 // 0: TIM, 1: HIT, 2: STR, 3: ADP
 }
 int Display::getSelectedSensors() { return _stats[0]; }
 
@@ -195,50 +213,53 @@ bool Display::renderStorageProgress(uint32_t page1, uint32_t page2, uint32_t tot
     }
 
                                                                                                     // Drawing M1
-    oled.setTextXY(2, 0); oled.putString("M1:");
-    oled.setTextXY(2, 7);
-    char pBuf[8];
+    _screen.print(2, 0, "M1:");                                                                     // Unchanged characters are not resent by refresh()
+    char pBuf[TextScreen::COLS + 1];
     sprintf(pBuf, "%3d%%", perc1);
-    oled.putString(pBuf);
+    _screen.print(2, 7, pBuf);
 
-    oled.setTextXY(3, 0);
     uint8_t bar1 = (16 * perc1) / 100;
     for (uint8_t j = 0; j < 16; j++)
     {
-      oled.putString(j < bar1 ? "|" : ".");
+      pBuf[j] = (j < bar1) ? '|' : '.';
     }
+    pBuf[16] = 0;
+    _screen.print(3, 0, pBuf);
                                                                                                     // Drawing M2
-    oled.setTextXY(5, 0); oled.putString("M2:");
-    oled.setTextXY(5, 7);
+    _screen.print(5, 0, "M2:");
     sprintf(pBuf, "%3d%%", perc2);
-    oled.putString(pBuf);
+    _screen.print(5, 7, pBuf);
 
-    oled.setTextXY(6, 0);
     uint8_t bar2 = (16 * perc2) / 100;
     for (uint8_t j = 0; j < 16; j++)
     {
-      oled.putString(j < bar2 ? "|" : ".");
+      pBuf[j] = (j < bar2) ? '|' : '.';
     }
+    pBuf[16] = 0;
+    _screen.print(6, 0, pBuf);
     return (perc1 >= 100 && perc2 >= 100);
 }
 
 
-void Display::showCleaningProgress()
+bool Display::showCleaningProgress()
 {
-    oled.clearDisplay();
-    oled.setTextXY(CURSOR_X_CENTER, 2);
-    oled.putString("CLEANING");
-    _m1->startBulkErase();
-    _m2->startBulkErase();
+    showMessage(CURSOR_X_CENTER, 2, "CLEANING");
+    if (!_log->clear()) return false;                                                               // Sessions are forgotten, data sectors get erased ahead of the next recording
     uint8_t d = 0;
-    while (_m1->isBusy() || _m2->isBusy())
+    uint32_t step = millis() - 500;
+    while (_log->isBusy())                                                                          // Directory sector erase only, well under a second
     {
-      oled.setTextXY(CURSOR_X_CENTER, 10);
-      if (d == 0) oled.putString(".  ");
-      else if (d == 1) oled.putString(".. ");
-      else oled.putString("...");
+      if (millis() - step < 500)
+      {
+        continue;
+      }
+      step = millis();
+      if (d == 0) _screen.print(CURSOR_X_CENTER, 10, ".  ");
+      else if (d == 1) _screen.print(CURSOR_X_CENTER, 10, ".. ");
+      else _screen.print(CURSOR_X_CENTER, 10, "...");
+      _screen.flush(TextScreen::NO_BUDGET);
       d = (d + 1) % 3;
-      _bz->chirp();
-      delay(500); 
+      _player->play(PatternPlayer::CHIRP);
     }
+    return true;
 }
\ No newline at end of file
@@ -4,9 +4,9 @@
 #include <Arduino.h>
 #include <ACROBOTIC_SSD1306.h>
 #include "Button.h"
-#include "Leds.h"
-#include "Buzzer.h" 
-#include "Storage.h"
+#include "PatternPlayer.h"
+#include "SessionLog.h"
+#include "TextScreen.h"
 
 #define BLINK_INTERVAL 500
 #define CURSOR_X_CENTER 4
@@ -16,8 +16,12 @@ class Display
 public:
     static const uint8_t MENU_ITEMS_COUNT = 8;
     static const uint8_t REDACTOR_ITEMS = 5;
+    enum TimerState
+    {
+        TIMER_RUNNING, TIMER_DONE, TIMER_CANCELLED
+    };
 
-    Display(Buzzer* buzzerPtr, Leds* ledsPtr, Storage* m1Ptr, Storage* m2Ptr);
+    Display(PatternPlayer* playerPtr, SessionLog* logPtr);
     
     void init();
     void update(ButtonHandler::Event event);
@@ -35,22 +39,27 @@ public:
 
     bool renderStorageProgress(uint32_t page1, uint32_t page2, uint32_t totalPages);        // Drawing recording progress (returns true if memory is full)
     void render();                                                                          // Rendering the main menu
-    bool runTimer(int seconds, ButtonHandler* button);                                      // Move runTimer to public so it can be called from loop before starting recording
+    void startTimer(int seconds);                                                           // Countdown before recording, shown inverted
+    TimerState runTimer(ButtonHandler::Event event);                                        // One step per loop() pass, never waits (LONG_PRESS cancels)
+    void clear();                                                                           // Blank screen, sent by refresh()
+    void showMessage(uint8_t row, uint8_t col, const char* text);                           // Blocking: clears the screen and shows one line at once
+    bool refresh(uint32_t budgetUs);                                                        // Sends changed characters for about budgetUs (true - screen up to date)
 
 private:
     uint8_t _currentLine;
     bool _isEditing;
     int _stats[REDACTOR_ITEMS]; 
     
-    Buzzer* _bz; 
-    Leds* _ld;  
-    Storage* _m1; 
-    Storage* _m2;
+    PatternPlayer* _player;
+    int _timerSeconds;                                                                      // Shown countdown value
+    uint32_t _timerTick;                                                                    // millis() of the last countdown step
+    SessionLog* _log;
+    TextScreen _screen;                                                                     // Everything is drawn here first, only changes go over I2C
 
     void incrementValue(uint8_t line);
     void executeAction(uint8_t line);
     const char* getValueText(uint8_t line);
-    void showCleaningProgress();
+    bool showCleaningProgress();
 };
 
 #endif
@@ -0,0 +1,89 @@
+#include "EraseAhead.h"
+
+EraseAhead::EraseAhead(SessionLog* logPtr)
+{
+  _log = logPtr;
+}
+
+void EraseAhead::prepareStart(uint32_t logicalPage)
+{
+  uint32_t sector = _log->sectorOf(logicalPage);
+  uint32_t dataEnd = _log->sectorOf(_log->capacity() - 1);                        // The summary region after it is SummaryLog's
+  for (uint32_t s = sector; s <= sector + 1 && s <= dataEnd; s++)
+  {
+    for (uint8_t c = 0; c < _log->chips(); c++)
+    {
+      prepare(_log->chip(c), s, sector, true);
+    }
+  }
+}
+
+bool EraseAhead::canWrite(uint32_t logicalPage)
+{
+  uint8_t c;
+  uint32_t phys;
+  _log->locate(logicalPage, c, phys);
+  uint32_t sector = phys / Storage::SECTOR_PAGES;
+  if (phys % Storage::SECTOR_PAGES == 0 && !_log->chip(c)->isSectorErased(sector))   // First page of a sector: it must be fresh
+  {
+    return false;
+  }
+  if (sector + 1 <= _log->sectorOf(_log->capacity() - 1))                         // Keep one sector group of erased pages behind the end (last data sector: none)
+  {
+    for (uint8_t k = 0; k < _log->chips(); k++)
+    {
+      if (!_log->chip(k)->isSectorErased(sector + 1))
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool EraseAhead::step(uint32_t writePage)
+{
+  uint32_t inUse = _log->sectorOf(writePage);
+  uint32_t last = writePage + DISTANCE * _log->sectorGroup();
+  if (last >= _log->capacity())
+  {
+    last = _log->capacity() - 1;
+  }
+  last = _log->sectorOf(last);
+
+  for (uint32_t s = inUse + 1; s <= last; s++)                                    // Nearest sector first
+  {
+    for (uint8_t c = 0; c < _log->chips(); c++)
+    {
+      Storage* chip = _log->chip(c);
+      if (chip->isSectorErased(s))
+      {
+        continue;
+      }
+      if (chip->isBusy())                                                         // Programming or erasing: come back later
+      {
+        return true;
+      }
+      prepare(chip, s, inUse, false);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool EraseAhead::prepare(Storage* chip, uint32_t sector, uint32_t inUse, bool blocking)
+{
+  if (chip->isSectorErased(sector) || chip->checkSectorBlank(sector))             // A read-back is much cheaper than an erase
+  {
+    return true;
+  }
+  uint32_t block = sector / Storage::BLOCK_SECTORS;
+  bool wholeBlock = (sector % Storage::BLOCK_SECTORS == 0) && block > 0           // Block 0 holds the directory
+                    && sector > inUse && chip->isBlockUnknown(block);
+  if (blocking)
+  {
+    chip->eraseSector(sector * Storage::SECTOR_PAGES * 256);
+    return true;
+  }
+  return wholeBlock ? chip->startEraseBlock(block) : chip->startEraseSector(sector);
+}
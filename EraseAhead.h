@@ -0,0 +1,27 @@
+#ifndef ERASE_AHEAD_H
+#define ERASE_AHEAD_H
+
+#include <Arduino.h>
+#include "Storage.h"
+#include "SessionLog.h"
+
+                                                                          // Keeps the sectors in front of the write pointer erased during recording,
+                                                                          // so a session can start on used flash without a bulk erase
+class EraseAhead
+{
+public:
+  static const uint32_t DISTANCE = 16;                                    // Sector groups prepared ahead (64KB on every chip)
+
+  EraseAhead(SessionLog* logPtr);
+
+  void prepareStart(uint32_t logicalPage);                                // Blocking: first two sector pairs of a session
+  bool canWrite(uint32_t logicalPage);                                    // Sector of the page and the next sector pair are ready
+  bool step(uint32_t writePage);                                          // At most one check/erase on an idle chip (true - more work ahead)
+
+private:
+  SessionLog* _log;
+
+  bool prepare(Storage* chip, uint32_t sector, uint32_t inUse, bool blocking);
+};
+
+#endif
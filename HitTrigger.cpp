@@ -0,0 +1,41 @@
+#include "HitTrigger.h"
+
+HitTrigger::HitTrigger() : _level2(0xFFFFFFFF), _release2(0), _ready(false), _fired(false)
+{
+}
+
+void HitTrigger::configure(uint16_t level, uint16_t release)
+{
+  _level2 = (uint32_t)level * level;
+  _release2 = (uint32_t)release * release;
+}
+
+void HitTrigger::arm()
+{
+  _ready = false;
+  _fired = false;
+}
+
+bool HitTrigger::update(const int16_t* axis)
+{
+  if (_fired)
+  {
+    return false;
+  }
+  uint32_t mag2 = 0;                                                              // 3 x 32768^2 still fits in 32 bits
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    mag2 += (uint32_t)((int32_t)axis[i] * axis[i]);
+  }
+  if (!_ready)
+  {
+    _ready = (mag2 < _release2);                                                  // Still moving from the last hit or from being handled
+    return false;
+  }
+  if (mag2 > _level2)
+  {
+    _fired = true;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,24 @@
+#ifndef HIT_TRIGGER_H
+#define HIT_TRIGGER_H
+
+#include <Arduino.h>
+
+                                                                          // HIT start: 3-axis magnitude against a level, with hysteresis.
+                                                                          // Evaluated on every acquired record, no extra sensor reads.
+class HitTrigger
+{
+public:
+  HitTrigger();
+
+  void configure(uint16_t level, uint16_t release);                       // Sensor counts; release < level
+  void arm();                                                             // The magnitude must drop below release before it can fire
+  bool update(const int16_t* axis);                                       // Acquisition thread: true once, on the record that crosses the level
+
+private:
+  uint32_t _level2;                                                       // Squared thresholds, no square root per sample
+  uint32_t _release2;
+  bool _ready;
+  bool _fired;
+};
+
+#endif
@@ -6,55 +6,130 @@
 #define BMM150_ADDR 0x10 
 #define REG_ACC_DATA 0x0C 
 #define REG_GYR_DATA 0x12 
+#define REG_FIFO_LENGTH 0x24
+#define REG_FIFO_DATA 0x26
+#define REG_ACC_CONF 0x40
+#define REG_ACC_RANGE 0x41
+#define REG_GYR_CONF 0x42
+#define REG_GYR_RANGE 0x43
+#define REG_FIFO_CONFIG_0 0x48
+#define REG_FIFO_CONFIG_1 0x49
+#define REG_CMD 0x7E
+#define MAG_REG_DATA 0x42
+#define MAG_REG_OPMODE 0x4C                                     // Data rate [5:3], operation mode [2:1]
+#define MAG_REG_REP_XY 0x51                                     // nXY = 2 * REP_XY + 1
+#define MAG_REG_REP_Z 0x52                                      // nZ = REP_Z + 1
+#define MAG_OP_FORCED 0x02                                      // One measurement, then back to sleep
+#define MAG_MARGIN_US 300                                       // Read, trigger and tick jitter between two forced measurements
 
-IMUHandler::IMUHandler() {}
+#define FIFO_CMD_FLUSH 0xB0
+#define FIFO_HDR_ACC_GYR 0x8C                                   // Regular frame: GYR (6) + ACC (6)
+#define FIFO_HDR_ACC 0x84
+#define FIFO_HDR_GYR 0x88
+#define FIFO_HDR_TIME 0x44                                      // Sensortime frame (3 bytes), appended when the FIFO is read past its fill level
+#define FIFO_HDR_SKIP 0x40                                      // Skipped frames counter (1 byte)
+#define FIFO_HDR_CONFIG 0x48                                    // Input config change (4 bytes)
+#define FIFO_HDR_EMPTY 0x80
+#define FIFO_FRAME_LEN 13
+#define FIFO_CHUNK (FIFO_FRAME_LEN * 9)                         // Wire1 burst; a whole number of frames so none is split between reads
+#define FIFO_PERIOD_TICKS (25600 / IMUHandler::FIFO_ODR)        // Sensortime runs at 25.6 kHz
+
+static const uint8_t MAG_PRESETS[][2] =                         // REP_XY, REP_Z: low power, regular, enhanced regular, high accuracy
+{
+    {0x01, 0x02}, {0x04, 0x0E}, {0x07, 0x1A}, {0x17, 0x52}
+};
+
+IMUHandler::IMUHandler(RunStats* statsPtr, CoilSampler* coilPtr, TwimSampler* dmaPtr) : _coil(coilPtr), _dma(dmaPtr), _stats(statsPtr), _pack(&IMUHandler::packPair<ACC, COI>), _set(ChannelSet::forMode(0)), _magPreset(MAG_LOW_POWER), _magStartUs(0),
+    _sensorTicks(0), _lastRawTime(0), _timeValid(false), _dmaNext(0), _dmaPresent(0)
+{
+    for (uint8_t k = 0; k < ChannelSet::SLOTS; k++)
+    {
+        _divider[k] = 1;
+        _phase[k] = 1;
+    }
+}
 
 int IMUHandler::getFrequency() { return 1000; }
 
-void IMUHandler::set_AllMaxSpeed()
+void IMUHandler::writeReg(uint8_t reg, uint8_t value)
 {
-    Wire1.beginTransmission(BMI270_ADDR);                       // Setting the maximum speed/range for the Accelerometer // 0x41 = ACC_RANGE, 0x8C = ODR 1600Hz, Range +/- 16G, Normal mode
-    Wire1.write(0x41); 
-    Wire1.write(0x8C); 
+    Wire1.beginTransmission(BMI270_ADDR);
+    Wire1.write(reg);
+    Wire1.write(value);
     Wire1.endTransmission();
-    Wire1.beginTransmission(BMI270_ADDR);                       // Setting the maximum speed/range for the Gyroscope // 0x43 = GYR_RANGE, 0xE9 = ODR 3200Hz, Range +/- 2000dps, Normal mode
-    Wire1.write(0x43); 
-    Wire1.write(0xE9); 
+}
+
+void IMUHandler::writeMag(uint8_t reg, uint8_t value)
+{
+    Wire1.beginTransmission(BMM150_ADDR);
+    Wire1.write(reg);
+    Wire1.write(value);
     Wire1.endTransmission();
 }
 
-void IMUHandler::readAcc(int16_t* dest)
+void IMUHandler::setMagPreset(MagPreset preset)
 {
-    Wire1.beginTransmission(BMI270_ADDR);
-    Wire1.write(REG_ACC_DATA);
+    _magPreset = preset;
+}
+
+uint32_t IMUHandler::magTimeUs() const
+{
+    uint32_t nXY = 2 * MAG_PRESETS[_magPreset][0] + 1;
+    uint32_t nZ = MAG_PRESETS[_magPreset][1] + 1;
+    return 145 * nXY + 500 * nZ + 980;                                                                          // BMM150 datasheet
+}
+
+uint16_t IMUHandler::magRate() const
+{
+    return 1000000UL / (magTimeUs() + MAG_MARGIN_US);
+}
+
+void IMUHandler::triggerMag()
+{
+    writeMag(MAG_REG_OPMODE, MAG_OP_FORCED);
+    _magStartUs = micros();
+}
+
+void IMUHandler::set_AllMaxSpeed()
+{
+    writeReg(REG_ACC_CONF, 0xAC);                               // Accelerometer: ODR 1600Hz, normal bandwidth, performance mode
+    writeReg(REG_ACC_RANGE, 0x03);                              // Range +/- 16G
+    writeReg(REG_GYR_CONF, 0xED);                               // Gyroscope: ODR 3200Hz, normal bandwidth, performance mode
+    writeReg(REG_GYR_RANGE, 0x00);                              // Range +/- 2000dps
+    writeMag(MAG_REG_REP_XY, MAG_PRESETS[_magPreset][0]);        // Magnetometer: repetitions of the preset, forced mode, one
+    writeMag(MAG_REG_REP_Z, MAG_PRESETS[_magPreset][1]);         // measurement started after every read (readMag)
+    triggerMag();
+}
+
+void IMUHandler::readBurst(uint8_t addr, uint8_t reg, int16_t* dest, uint8_t words)
+{
+    Wire1.beginTransmission(addr);
+    Wire1.write(reg);
     Wire1.endTransmission(false);                               // Using Restart (false)
-    Wire1.requestFrom(BMI270_ADDR, 6);
-    if (Wire1.available() == 6)
+    Wire1.requestFrom(addr, words * 2);
+    if (Wire1.available() == words * 2)
     {
-        dest[0] = (int16_t)(Wire1.read() | (Wire1.read() << 8));
-        dest[1] = (int16_t)(Wire1.read() | (Wire1.read() << 8));
-        dest[2] = (int16_t)(Wire1.read() | (Wire1.read() << 8));
+        for (uint8_t i = 0; i < words; i++)
+        {
+            dest[i] = (int16_t)(Wire1.read() | (Wire1.read() << 8));
+        }
     }
 }
 
+void IMUHandler::readAcc(int16_t* dest)
+{
+    readBurst(BMI270_ADDR, REG_ACC_DATA, dest, 3);
+}
+
 void IMUHandler::readGyr(int16_t* dest)
 {
-    Wire1.beginTransmission(BMI270_ADDR);
-    Wire1.write(REG_GYR_DATA);
-    Wire1.endTransmission(false);
-    Wire1.requestFrom(BMI270_ADDR, 6);
-    if (Wire1.available() == 6)
-    {
-        dest[0] = (int16_t)(Wire1.read() | (Wire1.read() << 8));
-        dest[1] = (int16_t)(Wire1.read() | (Wire1.read() << 8));
-        dest[2] = (int16_t)(Wire1.read() | (Wire1.read() << 8));
-    }
+    readBurst(BMI270_ADDR, REG_GYR_DATA, dest, 3);
 }
 
 void IMUHandler::readMag(int16_t* dest)
 {
     Wire1.beginTransmission(BMM150_ADDR);
-    Wire1.write(0x42);
+    Wire1.write(MAG_REG_DATA);
     Wire1.endTransmission(false);
     Wire1.requestFrom(BMM150_ADDR, 6);
     if (Wire1.available() == 6)
@@ -63,74 +138,339 @@ void IMUHandler::readMag(int16_t* dest)
         dest[1] = (int16_t)(Wire1.read() | (Wire1.read() << 8)) >> 3;
         dest[2] = (int16_t)(Wire1.read() | (Wire1.read() << 8)) >> 5;
     }
+    triggerMag();                                                                                               // Next measurement, ready before the next read is due
 }
 
 void IMUHandler::readCoi(int16_t* dest)
 {
-    int16_t val = (int16_t)analogRead(A0);
-    dest[0] = val; dest[1] = val; dest[2] = val;
+    _coil->read(dest);
+}
+
+template <IMUHandler::Sensor S>
+void IMUHandler::readSensor(int16_t* dest)                                                                      // Resolved at compile time, no per-sample switch
+{
+    uint32_t t0 = micros();
+    if (S == ACC) readAcc(dest);
+    else if (S == GYR) readGyr(dest);
+    else if (S == MAG) readMag(dest);
+    else readCoi(dest);
+    _stats->read((RunStats::Channel)S, micros() - t0);
 }
 
-bool IMUHandler::checkHit() {
-    const float threshold_multiplier = 2.5; 
-    const int16_t noise_floor = 500;
-    int16_t acc[3];
-    int16_t last_val = 0;
-    readAcc(acc);
-    last_val = abs(acc[0]);
-    while(true)
+template <IMUHandler::Sensor S1, IMUHandler::Sensor S2>
+void IMUHandler::packPair(SamplePacket& packet)                                                                 // PACK BOTH SENSORS INTO ONE PACKAGE (16 bytes) // [0-5] Sensor 1 | [6-11] Sensor 2 | [12-15] Time
+{
+    uint32_t currentMicros = micros();
+    int16_t s[6];
+
+    if (S1 == ACC && S2 == GYR)
+    {
+        readBurst(BMI270_ADDR, REG_ACC_DATA, s, 6);                                                             // ACC (0x0C) and GYR (0x12) are adjacent: one 12-byte transaction
+        _stats->read(RunStats::ACC_GYR, micros() - currentMicros);
+    }
+    else
+    {
+        readSensor<S1>(s);
+        readSensor<S2>(s + 3);
+    }
+
+    memcpy(packet.bytes, s, 12);
+    memcpy(packet.bytes + 12, &currentMicros, 4); 
+    packet.present = 0x03;
+}
+
+void IMUHandler::packSet(SamplePacket& packet)
+{
+    uint32_t currentMicros = micros();
+    int16_t s[6];
+
+    uint8_t due = 0;
+    for (uint8_t k = 0; k < ChannelSet::SLOTS && _set.sensor[k] != ChannelSet::NONE; k++)
     {
-        delay(10);
-        readAcc(acc);
-        int16_t current_val = abs(acc[0]);
-        if(current_val > (last_val * threshold_multiplier) && current_val > noise_floor)
+        if (--_phase[k] > 0)
         {
-            break;
+            continue;
         }
-        last_val = current_val;
+        if (_set.sensor[k] == MAG && micros() - _magStartUs < magTimeUs())                                        // Ticks caught up after a late one: not measured yet
+        {
+            _phase[k] = 1;
+            continue;
+        }
+        _phase[k] = _divider[k];
+        due |= 1 << k;
     }
-    return true;
+    packet.present = due;                                                                                       // A slot not due keeps its last reading in the packet
+    for (uint8_t k = 0; k < ChannelSet::SLOTS && _set.sensor[k] != ChannelSet::NONE; k++)
+    {
+        if (!(due & (1 << k)))
+        {
+            continue;
+        }
+        uint8_t* dest = packet.bytes + SamplePacket::slotOffset(k);
+        if (_set.sensor[k] == ACC && k + 1 < ChannelSet::SLOTS && _set.sensor[k + 1] == GYR && (due & (2 << k)))
+        {
+            uint32_t t0 = micros();
+            readBurst(BMI270_ADDR, REG_ACC_DATA, s, 6);                                                         // Adjacent registers, one transaction as in packPair
+            _stats->read(RunStats::ACC_GYR, micros() - t0);
+            memcpy(dest, s, 6);
+            memcpy(packet.bytes + SamplePacket::slotOffset(++k), s + 3, 6);
+            continue;
+        }
+        switch (_set.sensor[k])
+        {
+            case ACC: readSensor<ACC>(s); break;
+            case GYR: readSensor<GYR>(s); break;
+            case MAG: readSensor<MAG>(s); break;
+            default: readSensor<COI>(s); break;
+        }
+        memcpy(dest, s, 6);
+    }
+    memcpy(packet.bytes + 12, &currentMicros, 4);
 }
 
-uint8_t IMUHandler::collectAndPack(uint8_t mode, uint8_t* buf1, uint16_t& off1, uint8_t* buf2, uint16_t& off2)  // FUNCTION FOR PING-PONG RECORDING
+uint16_t IMUHandler::maxRate(uint8_t sensor) const
 {
-    uint32_t currentMicros = micros();
-    int16_t s1[3], s2[3];
-    
-    switch(mode)                                                                                                // Read both sensors at the same time
+    return (sensor == MAG) ? magRate() : 0xFFFF;                                                               // The BMI270 and the SAADC keep up with any tick
+}
+
+uint16_t IMUHandler::tickRate(uint8_t mode, uint16_t rate) const
+{
+    ChannelSet set = ChannelSet::forMode(mode);
+    uint16_t fastest = 0;
+    for (uint8_t k = 0; k < ChannelSet::SLOTS && set.sensor[k] != ChannelSet::NONE; k++)
     {
-        case 0: readAcc(s1); readCoi(s2); break;
-        case 1: readAcc(s1); readGyr(s2); break;
-        case 2: readAcc(s1); readMag(s2); break;
-        case 3: readGyr(s1); readMag(s2); break;
-        case 4: readGyr(s1); readCoi(s2); break;
-        case 5: readMag(s1); readCoi(s2); break;
+        uint16_t r = maxRate(set.sensor[k]);
+        fastest = (r > fastest) ? r : fastest;
     }
+    return (fastest < rate) ? fastest : rate;
+}
 
-    uint8_t readyStatus = 0;
+ChannelSet IMUHandler::plan(uint8_t mode, uint16_t rate) const
+{
+    ChannelSet set = ChannelSet::forMode(mode);
+    uint16_t tick = tickRate(mode, rate);
+    for (uint8_t k = 0; k < ChannelSet::SLOTS && set.sensor[k] != ChannelSet::NONE; k++)
+    {
+        if (maxRate(set.sensor[k]) < tick)
+        {
+            set.axes[k] |= ChannelSet::SPARSE;
+        }
+    }
+    return set;
+}
+
+void IMUHandler::selectMode(uint8_t mode, uint16_t rate)
+{
+    static const PackFn plans[] =                                                                               // Same order as the SENSORS menu
+    {
+        &IMUHandler::packPair<ACC, COI>,
+        &IMUHandler::packPair<ACC, GYR>,
+        &IMUHandler::packPair<ACC, MAG>,
+        &IMUHandler::packPair<GYR, MAG>,
+        &IMUHandler::packPair<GYR, COI>,
+        &IMUHandler::packPair<MAG, COI>
+    };
+    _set = plan(mode, rate);
+    uint16_t tick = tickRate(mode, rate);
+    for (uint8_t k = 0; k < ChannelSet::SLOTS; k++)
+    {
+        uint16_t r = (_set.sensor[k] == ChannelSet::NONE) ? tick : maxRate(_set.sensor[k]);
+        _divider[k] = (r < tick) ? (tick + r - 1) / r : 1;                                                      // Never sooner than the sensor is ready again
+        _phase[k] = _divider[k];
+    }
+    if (mode < sizeof(plans) / sizeof(plans[0]) && !_set.sparse())
+    {
+        _pack = plans[mode];
+    }
+    else if (mode < ChannelSet::MODES)
+    {
+        _pack = &IMUHandler::packSet;
+    }
+    if (_set.has(MAG))
+    {
+        triggerMag();                                                                                           // First measurement, read when the slot is first due
+    }
+}
+
+void IMUHandler::collectAndPack(SamplePacket& packet)
+{
+    (this->*_pack)(packet);
+}
+
+bool IMUHandler::startFifo(uint8_t mode)
+{
+    if (mode != 1)                                                                                              // Only A/G lives entirely inside the BMI270 FIFO
+    {
+        return false;
+    }
+    writeReg(REG_GYR_CONF, 0xEC);                                                                               // Gyroscope down to the ACC ODR, so every frame carries both
+    writeReg(REG_FIFO_CONFIG_0, 0x02);                                                                          // fifo_time_en, overwrite oldest on full
+    writeReg(REG_FIFO_CONFIG_1, 0xD0);                                                                          // fifo_gyr_en | fifo_acc_en | fifo_header_en
+    writeReg(REG_CMD, FIFO_CMD_FLUSH);
+    _sensorTicks = 0;
+    _timeValid = false;
+    return true;
+}
+
+void IMUHandler::stopFifo()
+{
+    writeReg(REG_FIFO_CONFIG_1, 0x10);                                                                          // Headers only, no sensors
+    writeReg(REG_CMD, FIFO_CMD_FLUSH);
+    set_AllMaxSpeed();
+}
 
-    uint8_t* activeBuf = (off2 == 0xFFFF) ? buf1 : buf2;                                                        // DETERMINE THE ACTIVE BUFFER (M1 or M2) // If off2 == 0xFFFF, it means the queue is currently M1
-    uint16_t& activeOff = (off2 == 0xFFFF) ? off1 : off2;
+uint16_t IMUHandler::drainFifo(SamplePacket* out, uint16_t maxPackets)
+{
+    uint32_t t0 = micros();
+    Wire1.beginTransmission(BMI270_ADDR);
+    Wire1.write(REG_FIFO_LENGTH);
+    Wire1.endTransmission(false);
+    Wire1.requestFrom(BMI270_ADDR, 2);
+    if (Wire1.available() != 2)
+    {
+        return 0;
+    }
+    uint16_t fill = (Wire1.read() | (Wire1.read() << 8)) & 0x3FFF;
+    int32_t remaining = fill + 4;                                                                               // Read past the fill level to get the sensortime frame
+
+    uint8_t chunk[FIFO_CHUNK];
+    uint16_t count = 0;
+    bool timeSeen = false;
+    while (count < maxPackets && !timeSeen)
+    {
+        if (remaining <= 0)
+        {
+            remaining = FIFO_FRAME_LEN + 4;                                                                     // Frames arrived while draining: read on until the sensortime frame
+        }
+        uint8_t len = (remaining > FIFO_CHUNK) ? FIFO_CHUNK : remaining;
+        Wire1.beginTransmission(BMI270_ADDR);
+        Wire1.write(REG_FIFO_DATA);
+        Wire1.endTransmission(false);
+        Wire1.requestFrom(BMI270_ADDR, len);
+        uint8_t got = 0;
+        while (Wire1.available() && got < len)
+        {
+            chunk[got++] = Wire1.read();
+        }
+        if (got == 0)
+        {
+            break;
+        }
+        count = parseFifo(chunk, got, out, count, maxPackets, timeSeen);
+        remaining -= got;
+        if ((chunk[0] & 0xFC) == FIFO_HDR_EMPTY)                                                                // Empty and no sensortime frame: nothing more to wait for
+        {
+            break;
+        }
+    }
 
-    memcpy(activeBuf + activeOff, s1, 6);                                                                       // PACK BOTH SENSORS INTO ONE PACKAGE (16 bytes) // [0-5] Sensor 1 | [6-11] Sensor 2 | [12-15] Time
-    memcpy(activeBuf + activeOff + 6, s2, 6);         
-    memcpy(activeBuf + activeOff + 12, &currentMicros, 4); 
-    
-    activeOff += 16;
+    _stats->read(RunStats::FIFO, micros() - t0);
+    if (!timeSeen)                                                                                              // No sensortime this time: continue from the last known one
+    {
+        _sensorTicks += (uint64_t)count * FIFO_PERIOD_TICKS;
+    }
+    for (uint16_t i = 0; i < count; i++)                                                                        // The last frame is the newest; earlier ones are one ODR period apart
+    {
+        uint64_t ticks = _sensorTicks - (uint64_t)(count - 1 - i) * FIFO_PERIOD_TICKS;
+        uint32_t us = (uint32_t)((ticks * 625) / 16);                                                           // 39.0625 us per tick, wraps like micros()
+        memcpy(out[i].bytes + 12, &us, 4);
+    }
+    return count;
+}
 
-    if (activeOff >= 256)                                                                                       // SWITCHING MEMORY WHEN LOADING THE PAGE
+uint16_t IMUHandler::parseFifo(const uint8_t* data, uint16_t len, SamplePacket* out, uint16_t count, uint16_t maxPackets, bool& timeSeen)
+{
+    uint16_t i = 0;
+    while (i < len)
     {
-        if (off2 == 0xFFFF)
+        uint8_t header = data[i] & 0xFC;                                                                        // Low bits are interrupt tags
+        uint8_t size;
+        switch (header)
+        {
+            case FIFO_HDR_ACC_GYR: size = 12; break;
+            case FIFO_HDR_ACC:
+            case FIFO_HDR_GYR:     size = 6; break;
+            case FIFO_HDR_TIME:    size = 3; break;
+            case FIFO_HDR_SKIP:    size = 1; break;
+            case FIFO_HDR_CONFIG:  size = 4; break;
+            default:               return count;                                                                // FIFO_HDR_EMPTY or garbage: nothing more in this read
+        }
+        if (i + 1 + size > len)                                                                                 // Partial frame at the end of the burst, re-sent on the next read
+        {
+            return count;
+        }
+        const uint8_t* p = data + i + 1;
+        if (header == FIFO_HDR_ACC_GYR && count < maxPackets)
         {
-            readyStatus |= 1;
-            activeOff = 0;
-            off2 = 0;
-        } else
+            memcpy(out[count].bytes, p + 6, 6);                                                                 // [0-5] ACC
+            memcpy(out[count].bytes + 6, p, 6);                                                                 // [6-11] GYR
+            out[count].present = 0x03;
+            count++;
+        }
+        else if (header == FIFO_HDR_TIME)
         {
-            readyStatus |= 2;
-            activeOff = 0;
-            off2 = 0xFFFF;
+            uint32_t raw = p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16);
+            if (_timeValid)
+            {
+                _sensorTicks += (raw - _lastRawTime) & 0xFFFFFF;
+            }
+            else
+            {
+                _sensorTicks = raw;
+                _timeValid = true;
+            }
+            _lastRawTime = raw;
+            timeSeen = true;
         }
+        i += 1 + size;
+    }
+    return count;
+}
+
+bool IMUHandler::startDma(uint8_t mode, uint16_t rate)
+{
+    ChannelSet set = ChannelSet::forMode(mode);
+    bool pair = (set.sensor[0] == ACC && set.sensor[1] == GYR && set.sensor[2] == ChannelSet::NONE);
+    bool single = (set.sensor[0] <= GYR && set.sensor[1] == ChannelSet::NONE);
+    if (!pair && !single)                                                                                       // MAG needs a trigger write after every read, the coil isn't on the bus
+    {
+        return false;
     }
-    return readyStatus;
-}
\ No newline at end of file
+    _dmaNext = 0;
+    _dmaPresent = pair ? 0x03 : 0x01;
+    uint8_t reg = (set.sensor[0] == GYR) ? REG_GYR_DATA : REG_ACC_DATA;                                         // A/G: adjacent registers, one 12-byte read as in packPair
+    return _dma->start(BMI270_ADDR, reg, pair ? 12 : 6, rate);
+}
+
+void IMUHandler::stopDma()
+{
+    _dma->stop();
+}
+
+uint16_t IMUHandler::drainDma(SamplePacket* out, uint16_t maxPackets)
+{
+    uint32_t t0 = micros();
+    uint32_t done = _dma->completed();
+    if ((int32_t)(done - _dmaNext) > TwimSampler::RING - 1)                                                     // Overwritten before this call (the slot of read `done` is being filled)
+    {
+        _dmaNext = done - (TwimSampler::RING - 1);
+    }
+    uint16_t count = 0;
+    uint32_t skipped = 0;
+    for (; (int32_t)(done - _dmaNext) > 0 && count < maxPackets; _dmaNext++)
+    {
+        if (_dma->failed(_dmaNext))                                                                             // NACKed: nothing read on this tick, frame() shifts the later ones
+        {
+            skipped++;
+            continue;
+        }
+        SamplePacket& p = out[count++];
+        memcpy(p.bytes, _dma->frame(_dmaNext), (_dmaPresent == 0x03) ? 12 : 6);                                 // ACC, GYR as the registers are laid out: slots 0 and 1
+        uint32_t us = _dma->frameTime(_dmaNext);
+        memcpy(p.bytes + 12, &us, 4);
+        p.present = _dmaPresent;
+    }
+    _stats->read(RunStats::FIFO, micros() - t0);                                                                // Timed with the FIFO drains, also a batch per tick
+    if (skipped > 0) _stats->skipped(skipped);
+    return count;
+}
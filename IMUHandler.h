@@ -4,21 +4,87 @@
 #include <Arduino_BMI270_BMM150.h>
 #include <Wire.h>
 #include <Arduino.h>
+#include "RunStats.h"
+#include "ChannelSet.h"
+#include "CoilSampler.h"
+#include "TwimSampler.h"
+
+struct SamplePacket                                                                                     // One record: [0-5] Sensor 1 | [6-11] Sensor 2 | [12-15] Time | [16-27] Sensors 3, 4
+{
+    static const uint8_t PAIR_SIZE = 16;                                                                // Sensors 1-2 and time: all the pair layouts store
+    uint8_t bytes[28];
+    uint8_t present;                                                                                    // Slots read on this tick (bit k: slot k); only SPARSE slots are ever left out
+
+    static uint8_t slotOffset(uint8_t slot)                                                             // Sensor slot of a ChannelSet
+    {
+        return (slot < 2) ? slot * 6 : 16 + (slot - 2) * 6;
+    }
+};
 
 class IMUHandler {
 public:
-    IMUHandler();
+    enum Sensor
+    {
+        ACC, GYR, MAG, COI
+    };
+    static const uint16_t FIFO_ODR = 1600;                                                              // Native ODR used in FIFO mode (ACC maximum)
+    static const uint16_t FIFO_MAX_FRAMES = 160;                                                        // Whole 2 KB hardware FIFO in A+G frames
+    enum MagPreset                                                                                      // BMM150 repetitions of the Bosch presets, measured in forced mode
+    {
+        MAG_LOW_POWER, MAG_REGULAR, MAG_ENHANCED, MAG_HIGH_ACCURACY
+    };
+
+    IMUHandler(RunStats* statsPtr, CoilSampler* coilPtr, TwimSampler* dmaPtr);
     int getFrequency();                                                                                 // Returns the current frequency (informative)
     void set_AllMaxSpeed();                                                                             // Setting up BMI270/BMM150 for high speeds via Wire1
+    void setMagPreset(MagPreset preset);                                                                // Applied by set_AllMaxSpeed()
+    uint16_t magRate() const;                                                                           // Most forced measurements per second the preset allows
     void readAcc(int16_t* dest);                                                                        // Reading methods (take a pointer to an array of 3 elements)
     void readGyr(int16_t* dest);
     void readMag(int16_t* dest);
-    void readCoi(int16_t* dest);                                                                        // Reading analog signal (emulation of 3 axes for packaging)
-    uint8_t collectAndPack(uint8_t mode, uint8_t* buf1, uint16_t& off1, uint8_t* buf2, uint16_t& off2); // Main method for packing data into the buffer (16 bytes)
-                                                                                                        // Returns a bitmask of buffer readiness (1 - buf1 ready, 2 - buf2 ready)
-    bool checkHit();                                                                                    // Waiting for a sudden change in acceleration
+    void readCoi(int16_t* dest);                                                                        // Newest CoilSampler::SUBSAMPLES coil values, oldest first
+    uint16_t tickRate(uint8_t mode, uint16_t rate) const;                                               // rate, or lower if no sensor of the mode keeps up with it (M alone)
+    ChannelSet plan(uint8_t mode, uint16_t rate) const;                                                 // Set recorded at tickRate(): slots slower than the ticks are SPARSE
+    void selectMode(uint8_t mode, uint16_t rate);                                                       // Picks the read/pack routine of the SENSORS entry once, before recording
+    void collectAndPack(SamplePacket& packet);                                                          // Main method: reads the sensors due on this tick and packs one record
+
+    bool startFifo(uint8_t mode);                                                                       // BMI270 FIFO with headers and sensortime (false - mode can't be batched)
+    void stopFifo();
+    uint16_t drainFifo(SamplePacket* out, uint16_t maxPackets);                                         // Burst-reads the FIFO into packets stamped with sensortime, returns count
+
+    bool startDma(uint8_t mode, uint16_t rate);                                                         // BMI270 data read by TwimSampler on its timer (false - mode has MAG or the coil)
+    void stopDma();
+    uint16_t drainDma(SamplePacket* out, uint16_t maxPackets);                                          // Repacks the reads finished since the last call, stamped with their timer times
 
 private:
+    typedef void (IMUHandler::*PackFn)(SamplePacket&);
+    CoilSampler* _coil;                                                                                 // Converts on its own, readCoi() only copies
+    TwimSampler* _dma;                                                                                  // Reads on its own, drainDma() only repacks
+    RunStats* _stats;                                                                                   // Read durations per sensor
+    PackFn _pack;                                                                                       // Specialized routine of the selected mode
+    ChannelSet _set;                                                                                    // Sensors of the selected mode, for packSet()
+    uint16_t _divider[ChannelSet::SLOTS];                                                               // packSet(): slot k is read every _divider[k] ticks
+    uint16_t _phase[ChannelSet::SLOTS];                                                                 // Ticks until slot k is due
+    MagPreset _magPreset;
+    uint32_t _magStartUs;                                                                               // Last forced measurement started then
+
+    uint64_t _sensorTicks;                                                                              // 24-bit sensortime extended across wraparound (39.0625 us ticks)
+    uint32_t _lastRawTime;
+    bool _timeValid;
+
+    uint32_t _dmaNext;                                                                                  // Next TwimSampler read to repack
+    uint8_t _dmaPresent;                                                                                // Slots in every read: A/G, or A or G alone
+
+    void writeReg(uint8_t reg, uint8_t value);
+    void writeMag(uint8_t reg, uint8_t value);
+    uint16_t maxRate(uint8_t sensor) const;
+    uint32_t magTimeUs() const;                                                                         // One forced measurement with the preset
+    void triggerMag();
+    void readBurst(uint8_t addr, uint8_t reg, int16_t* dest, uint8_t words);                            // One write-address + restart + read transaction
+    template <Sensor S> void readSensor(int16_t* dest);
+    template <Sensor S1, Sensor S2> void packPair(SamplePacket& packet);
+    void packSet(SamplePacket& packet);                                                                 // Modes past the pairs and SPARSE sets: the slots of _set due on this tick
+    uint16_t parseFifo(const uint8_t* data, uint16_t len, SamplePacket* out, uint16_t count, uint16_t maxPackets, bool& timeSeen);
 
 };
 
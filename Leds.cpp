@@ -20,10 +20,3 @@ void Leds::off()
   digitalWrite(_pin1, HIGH);
   digitalWrite(_pin2, HIGH);
 }
-
-void Leds::blink(int time)
-{
-  on();
-  delay(time);
-  off();
-}
\ No newline at end of file
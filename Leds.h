@@ -8,8 +8,7 @@ class Leds {
 public:
     Leds(int pin1, int pin2);
     void on();
-    void off();
-    void blink(int time);
+    void off();                                                          // Blinking is done by PatternPlayer
 
 private:
     int _pin1;
@@ -0,0 +1,228 @@
+#include "PageCodec.h"
+
+static uint32_t zigzag(int32_t v)
+{
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t u)
+{
+  return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+static uint8_t bitWidth(uint32_t v)
+{
+  uint8_t w = 0;
+  while (v)
+  {
+    w++;
+    v >>= 1;
+  }
+  return w;
+}
+
+static uint32_t getBits(const uint8_t* data, uint32_t& pos, uint8_t width)
+{
+  uint32_t v = 0;
+  for (uint8_t i = 0; i < width; i++, pos++)
+  {
+    v |= (uint32_t)((data[pos >> 3] >> (pos & 7)) & 1) << i;
+  }
+  return v;
+}
+
+PageCodec::PageCodec() : _page(nullptr), _count(0), _bits(0), _prevTime(0), _prevDelta(0), _blockLen(0)
+{
+}
+
+bool PageCodec::isOpen() const
+{
+  return _page != nullptr;
+}
+
+uint16_t PageCodec::count() const
+{
+  return _count;
+}
+
+void PageCodec::reset()
+{
+  _page = nullptr;
+}
+
+void PageCodec::begin(uint8_t* page)
+{
+  _page = page;
+  memset(_page, 0xFF, PAGE_SIZE);
+  _count = 0;
+  _bits = 0;
+  _blockLen = 0;
+}
+
+void PageCodec::residuals(const SamplePacket& packet, uint32_t* r) const
+{
+  int16_t axis[6];
+  uint32_t t;
+  memcpy(axis, packet.bytes, 12);
+  memcpy(&t, packet.bytes + 12, 4);
+  for (uint8_t c = 0; c < 6; c++)
+  {
+    r[c] = zigzag((int32_t)axis[c] - _prevAxis[c]);
+  }
+  r[6] = zigzag((int32_t)((t - _prevTime) - _prevDelta));
+}
+
+bool PageCodec::add(const SamplePacket& packet)
+{
+  if (_count == 0)                                                                // Keyframe: the packet as is
+  {
+    memcpy(_page + 2, packet.bytes, SamplePacket::PAIR_SIZE);
+  }
+  else
+  {
+    uint32_t r[CHANNELS];
+    residuals(packet, r);
+    bool newBlock = (_blockLen == BLOCK);
+    uint8_t n = newBlock ? 1 : _blockLen + 1;
+    uint32_t committed = _bits;
+    uint32_t pending = CHANNELS * 6;
+    for (uint8_t c = 0; c < CHANNELS; c++)
+    {
+      uint8_t w = bitWidth(r[c]);
+      if (!newBlock && _width[c] > w)
+      {
+        w = _width[c];
+      }
+      pending += (uint32_t)n * w;
+    }
+    if (newBlock)                                                                 // The full block would be written first
+    {
+      committed += CHANNELS * 6;
+      for (uint8_t c = 0; c < CHANNELS; c++)
+      {
+        committed += (uint32_t)BLOCK * _width[c];
+      }
+    }
+    if (committed + pending > (uint32_t)(PAGE_SIZE - HEADER) * 8)
+    {
+      return false;
+    }
+
+    if (newBlock)
+    {
+      flushBlock();
+    }
+    for (uint8_t c = 0; c < CHANNELS; c++)
+    {
+      uint8_t w = bitWidth(r[c]);
+      if (_blockLen == 0 || w > _width[c])
+      {
+        _width[c] = w;
+      }
+      _block[_blockLen][c] = r[c];
+    }
+    _blockLen++;
+  }
+
+  memcpy(_prevAxis, packet.bytes, 12);
+  uint32_t t;
+  memcpy(&t, packet.bytes + 12, 4);
+  _prevDelta = (_count == 0) ? 0 : t - _prevTime;
+  _prevTime = t;
+  _count++;
+  return true;
+}
+
+void PageCodec::flushBlock()
+{
+  for (uint8_t c = 0; c < CHANNELS; c++)
+  {
+    putBits(_width[c], 6);
+    for (uint8_t i = 0; i < _blockLen; i++)
+    {
+      putBits(_block[i][c], _width[c]);
+    }
+  }
+  _blockLen = 0;
+}
+
+void PageCodec::putBits(uint32_t value, uint8_t width)
+{
+  uint8_t* data = _page + HEADER;
+  for (uint8_t i = 0; i < width; i++, _bits++)
+  {
+    if (!((value >> i) & 1))
+    {
+      data[_bits >> 3] &= ~(1 << (_bits & 7));                                    // Buffer starts as 0xFF, only zeros are written
+    }
+  }
+}
+
+void PageCodec::finish()
+{
+  if (_blockLen > 0)
+  {
+    flushBlock();
+  }
+  _page[0] = _count & 0xFF;
+  _page[1] = _count >> 8;
+  _page = nullptr;
+}
+
+uint16_t PageCodec::decode(const uint8_t* page, SamplePacket* out, uint16_t maxPackets)
+{
+  uint16_t count = page[0] | (page[1] << 8);
+  if (count == 0 || count > RECORDS)                                              // Erased, or not a packed page
+  {
+    return 0;
+  }
+  int16_t axis[6];
+  uint32_t t, delta = 0;
+  memcpy(axis, page + 2, 12);
+  memcpy(&t, page + 14, 4);
+  if (maxPackets > 0)
+  {
+    memcpy(out[0].bytes, page + 2, SamplePacket::PAIR_SIZE);
+  }
+
+  const uint8_t* data = page + HEADER;
+  const uint32_t limit = (uint32_t)(PAGE_SIZE - HEADER) * 8;
+  uint32_t pos = 0;
+  uint16_t done = 1;
+  uint32_t block[BLOCK][CHANNELS];
+  while (done < count)
+  {
+    uint8_t n = (count - done < BLOCK) ? count - done : BLOCK;
+    for (uint8_t c = 0; c < CHANNELS; c++)
+    {
+      if (pos + 6 > limit)
+      {
+        return (done < maxPackets) ? done : maxPackets;
+      }
+      uint8_t w = getBits(data, pos, 6);
+      if (w > 32 || pos + (uint32_t)n * w > limit)                                // Corrupt page, keep what decoded
+      {
+        return (done < maxPackets) ? done : maxPackets;
+      }
+      for (uint8_t i = 0; i < n; i++)
+      {
+        block[i][c] = getBits(data, pos, w);
+      }
+    }
+    for (uint8_t i = 0; i < n; i++, done++)
+    {
+      for (uint8_t c = 0; c < 6; c++)
+      {
+        axis[c] = (int16_t)(axis[c] + unzigzag(block[i][c]));
+      }
+      delta += (uint32_t)unzigzag(block[i][6]);
+      t += delta;
+      if (done < maxPackets)
+      {
+        memcpy(out[done].bytes, axis, 12);
+        memcpy(out[done].bytes + 12, &t, 4);
+      }
+    }
+  }
+  return (count < maxPackets) ? count : maxPackets;
+}
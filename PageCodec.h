@@ -0,0 +1,50 @@
+#ifndef PAGE_CODEC_H
+#define PAGE_CODEC_H
+
+#include <Arduino.h>
+#include "IMUHandler.h"
+
+                                                                          // Packed page: [count u16][keyframe packet, 16 bytes][bitstream]
+                                                                          // Bitstream: blocks of up to 8 samples after the keyframe; per block and
+                                                                          // channel (6 axes, time) a 6-bit width, then the zigzag residuals of the
+                                                                          // block at that width, LSB first. Axes are deltas to the previous sample,
+                                                                          // time is a delta-of-delta. Every page decodes on its own.
+                                                                          // Worst case (17-bit axis and 32-bit time residuals) still fits 14
+                                                                          // samples; add() refuses any sample that would overflow the page.
+class PageCodec
+{
+public:
+  static const uint16_t PAGE_SIZE = 256;
+  static const uint8_t BLOCK = 8;
+  static const uint8_t CHANNELS = 7;
+  static const uint16_t HEADER = 2 + SamplePacket::PAIR_SIZE;
+  static const uint16_t RECORDS = 1 + (PAGE_SIZE - HEADER) * 8 / (CHANNELS * 6) * BLOCK;   // Most a page holds: keyframe, blocks of 0-bit residuals
+
+  PageCodec();
+
+  void begin(uint8_t* page);                                              // Starts a new page in the buffer
+  bool add(const SamplePacket& packet);                                   // false - the sample does not fit, finish() and start a new page
+  void finish();                                                          // Writes the pending block and the header, the rest stays 0xFF
+  void reset();                                                           // Drops an unfinished page
+  bool isOpen() const;
+  uint16_t count() const;
+
+  static uint16_t decode(const uint8_t* page, SamplePacket* out, uint16_t maxPackets);   // A stream running past the page: the records before it
+
+private:
+  uint8_t* _page;
+  uint16_t _count;
+  uint32_t _bits;                                                         // Bits of completed blocks
+  int16_t _prevAxis[6];
+  uint32_t _prevTime;
+  uint32_t _prevDelta;
+  uint32_t _block[BLOCK][CHANNELS];                                       // Residuals of the pending block
+  uint8_t _width[CHANNELS];
+  uint8_t _blockLen;
+
+  void residuals(const SamplePacket& packet, uint32_t* r) const;
+  void flushBlock();
+  void putBits(uint32_t value, uint8_t width);
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "PageRing.h"
+
+PageRing::PageRing()
+{
+  reset();
+}
+
+void PageRing::reset()
+{
+  _head = 0;
+  _tail = 0;
+  _count = 0;
+  memset(_written, 0, sizeof(_written));
+}
+
+uint8_t* PageRing::writeSlot()
+{
+  if (_count >= PAGES)
+  {
+    return nullptr;
+  }
+  return _pages[_head];
+}
+
+void PageRing::commit()
+{
+  _head = (_head + 1) % PAGES;
+  _count++;
+}
+
+uint8_t* PageRing::readSlot()
+{
+  if (_count == 0)
+  {
+    return nullptr;
+  }
+  return _pages[_tail];
+}
+
+void PageRing::release()
+{
+  _written[_tail] = false;
+  _tail = (_tail + 1) % PAGES;
+  _count--;
+}
+
+uint8_t* PageRing::fullSlot(uint8_t i)
+{
+  if (i >= _count)
+  {
+    return nullptr;
+  }
+  return _pages[(_tail + i) % PAGES];
+}
+
+void PageRing::markWritten(uint8_t i)
+{
+  _written[(_tail + i) % PAGES] = true;
+}
+
+bool PageRing::isWritten(uint8_t i) const
+{
+  return _written[(_tail + i) % PAGES];
+}
+
+uint8_t PageRing::count() const
+{
+  return _count;
+}
@@ -0,0 +1,33 @@
+#ifndef PAGE_RING_H
+#define PAGE_RING_H
+
+#include <Arduino.h>
+
+class PageRing
+{
+public:
+  static const uint16_t PAGE_SIZE = 256;                                  // One flash page
+  static const uint8_t PAGES = 16;                                        // Pages buffered in RAM (4 KB)
+
+  PageRing();
+  void reset();                                                           // Drop all pages
+
+  uint8_t* writeSlot();                                                   // Producer: page being filled (nullptr if the ring is full)
+  void commit();                                                          // Producer: the page is full, hand it over to the consumer
+  uint8_t* readSlot();                                                    // Consumer: oldest full page (nullptr if the ring is empty)
+  void release();                                                         // Consumer: the page has been sent to flash
+  uint8_t* fullSlot(uint8_t i);                                           // Consumer: i-th oldest full page, for writes out of order (nullptr past count())
+  void markWritten(uint8_t i);                                            // Consumer: that page is in flash, released once the older ones are
+  bool isWritten(uint8_t i) const;
+
+  uint8_t count() const;                                                  // Number of full pages waiting for flash
+
+private:
+  uint8_t _pages[PAGES][PAGE_SIZE];
+  volatile uint8_t _head;                                                 // Next page to be filled
+  volatile uint8_t _tail;                                                 // Next page to be written to flash
+  volatile uint8_t _count;
+  bool _written[PAGES];                                                   // Consumer only, by slot
+};
+
+#endif
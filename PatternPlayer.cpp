@@ -0,0 +1,76 @@
+#include "PatternPlayer.h"
+
+#define FLAG_REQUEST 0x01
+
+PatternPlayer::PatternPlayer(Buzzer* buzzerPtr, Leds* ledsPtr) : _thread(osPriorityBelowNormal, 768), _request(-1), _outputs(0)
+{
+  _bz = buzzerPtr;
+  _ld = ledsPtr;
+}
+
+const PatternPlayer::Step* PatternPlayer::pattern(int8_t index)
+{
+  static const Step chirp[] = {{OUT_BUZZER, 100}, {0, 0}};
+  static const Step doubleBeep[] = {{OUT_BUZZER, 80}, {0, 80}, {OUT_BUZZER, 80}, {0, 0}};
+  static const Step error[] = {{OUT_BUZZER | OUT_LEDS, 400}, {0, 150}, {OUT_BUZZER | OUT_LEDS, 400}, {0, 150}, {OUT_BUZZER | OUT_LEDS, 400}, {0, 0}};
+  static const Step ready[] = {{OUT_BUZZER, 100}, {OUT_LEDS, 250}, {0, 0}};
+  static const Step press[] = {{OUT_BUZZER, HOLD}, {0, 0}};
+  static const Step* const patterns[PATTERN_COUNT] = {chirp, doubleBeep, error, ready, press};
+  return (index >= 0 && index < PATTERN_COUNT) ? patterns[index] : nullptr;
+}
+
+void PatternPlayer::begin()
+{
+  _thread.start(mbed::callback(this, &PatternPlayer::task));
+}
+
+void PatternPlayer::play(Pattern pattern)
+{
+  _request = pattern;
+  _flags.set(FLAG_REQUEST);
+}
+
+void PatternPlayer::stop()
+{
+  _request = -1;
+  _flags.set(FLAG_REQUEST);
+}
+
+void PatternPlayer::apply(uint8_t outputs)
+{
+  uint8_t changed = outputs ^ _outputs;
+  if (changed & OUT_BUZZER)
+  {
+    if (outputs & OUT_BUZZER) _bz->sound();
+    else _bz->silence();
+  }
+  if (changed & OUT_LEDS)
+  {
+    if (outputs & OUT_LEDS) _ld->on();
+    else _ld->off();
+  }
+  _outputs = outputs;
+}
+
+void PatternPlayer::task()
+{
+  const Step* step = nullptr;
+  while (true)
+  {
+    uint32_t timeout = (step == nullptr || step->ms == HOLD) ? osWaitForever : step->ms;
+    uint32_t flags = _flags.wait_any(FLAG_REQUEST, timeout);
+    if (!(flags & osFlagsError) && (flags & FLAG_REQUEST))
+    {
+      step = pattern(_request);                                                   // A new request restarts from its first step
+    }
+    else if (step != nullptr)
+    {
+      step++;                                                                     // Step time is over
+    }
+    if (step != nullptr && step->ms == 0)
+    {
+      step = nullptr;
+    }
+    apply((step != nullptr) ? step->outputs : 0);
+  }
+}
@@ -0,0 +1,53 @@
+#ifndef PATTERN_PLAYER_H
+#define PATTERN_PLAYER_H
+
+#include <Arduino.h>
+#include <mbed.h>
+#include "Buzzer.h"
+#include "Leds.h"
+
+                                                                          // Buzzer/LED feedback played by a low-priority thread: play() returns at once,
+                                                                          // so a chirp at recording start or at a HIT never delays the first samples
+class PatternPlayer
+{
+public:
+  enum Pattern
+  {
+    CHIRP,                                                                // Key click, countdown second, start/stop
+    DOUBLE_BEEP,                                                          // Transfer finished
+    FAILURE,                                                              // Memory full
+    READY,                                                                // Power-up: chirp, then an LED blink
+    PRESS,                                                                // Tone for as long as the button is held, until stop()
+    PATTERN_COUNT
+  };
+
+  PatternPlayer(Buzzer* buzzerPtr, Leds* ledsPtr);
+
+  void begin();                                                           // Starts the thread (not from the constructor: the kernel isn't running yet)
+  void play(Pattern pattern);                                             // Replaces whatever is playing
+  void stop();                                                            // Buzzer and LEDs off
+
+private:
+  static const uint8_t OUT_BUZZER = 0x01;
+  static const uint8_t OUT_LEDS = 0x02;
+  static const uint16_t HOLD = 0xFFFF;                                    // Step lasts until the next play() or stop()
+
+  struct Step
+  {
+    uint8_t outputs;
+    uint16_t ms;                                                          // 0 - end of the pattern
+  };
+
+  Buzzer* _bz;
+  Leds* _ld;
+  rtos::Thread _thread;
+  rtos::EventFlags _flags;
+  volatile int8_t _request;                                               // Pattern asked for by play(), -1 - stop
+  uint8_t _outputs;                                                       // Currently driven
+
+  static const Step* pattern(int8_t index);
+  void apply(uint8_t outputs);
+  void task();
+};
+
+#endif
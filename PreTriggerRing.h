@@ -0,0 +1,76 @@
+#ifndef PRE_TRIGGER_RING_H
+#define PRE_TRIGGER_RING_H
+
+#include <stdint.h>
+#include <atomic>
+
+                                                                          // Circular history of the newest N items while waiting for a trigger.
+                                                                          // The producer overwrites the oldest item until freeze(); from then on the
+                                                                          // kept window is read out once by the consumer, oldest first.
+template <typename T, uint32_t N>
+class PreTriggerRing
+{
+  static_assert(N > 0 && (N & (N - 1)) == 0, "PreTriggerRing size must be a power of two");
+
+public:
+  PreTriggerRing() : _head(0), _next(0), _left(0) {}
+
+  void put(const T& item)                                                 // Producer, before freeze()
+  {
+    _items[_head & (N - 1)] = item;
+    _head++;
+  }
+
+  uint32_t freeze(uint32_t window)                                        // Producer: keep the newest window items for the consumer, returns how many
+  {
+    uint32_t keep = (window < N) ? window : N;
+    if (keep > _head)
+    {
+      keep = _head;
+    }
+    _next = _head - keep;
+    _left.store(keep, std::memory_order_release);                         // Publish after the items and the start index
+    return keep;
+  }
+
+  bool peek(T& item) const                                                // Consumer (false - nothing frozen or all read)
+  {
+    if (_left.load(std::memory_order_acquire) == 0)
+    {
+      return false;
+    }
+    item = _items[_next & (N - 1)];
+    return true;
+  }
+
+  bool pop(T& item)                                                       // Consumer
+  {
+    if (!peek(item))
+    {
+      return false;
+    }
+    _next++;
+    _left.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  uint32_t remaining() const
+  {
+    return _left.load(std::memory_order_acquire);
+  }
+
+  void reset()                                                            // Only while neither side is running
+  {
+    _head = 0;
+    _next = 0;
+    _left.store(0);
+  }
+
+private:
+  T _items[N];
+  uint32_t _head;                                                         // Items put so far (producer only)
+  uint32_t _next;                                                         // Next item for the consumer, set by freeze()
+  std::atomic<uint32_t> _left;                                            // Frozen items not read yet
+};
+
+#endif
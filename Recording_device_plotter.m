@@ -4,6 +4,7 @@
 
 %% BINARY SERIAL RECEIVER & DECODER
 % Description: Receives dual-sensor data, filters memory padding, and exports to CSV/MAT.
+% host/srd_host.cpp is the native equivalent (blocking reads, mmap'ed dumps, fast CSV/binary export).
 
 clear; clc; close all;
 
@@ -11,59 +12,140 @@ clear; clc; close all;
 cfg.port = "COM3";
 cfg.baud = 921600;
 cfg.packetSize = 16;            % 6B (S1) + 6B (S2) + 4B (Time)
-cfg.totalBytes = 65536 * 2 * 256; 
 cfg.timeout = 15;               % Seconds to wait before partial processing
+cfg.dumpFile = "";              % Decode a saved byte stream instead of the port (e.g. "stream.bin")
+cfg.saveStream = "";            % Save the received byte stream for later replay
+cfg.session = -1;               % Session index to download (-1 = the last one)
 
-% Sensor Mode Map
+% Sensor Mode Map (SENSORS menu; the modes past the pairs are recorded as channel sets)
 modes = {'Accel','Coil'; 'Accel','Gyro'; 'Accel','Mag'; ...
-         'Gyro','Mag'; 'Gyro','Coil'; 'Mag','Coil'};
+         'Gyro','Mag'; 'Gyro','Coil'; 'Mag','Coil'; ...
+         'Accel+Gyro','Mag'; 'Accel+Gyro','Mag+Coil'; 'Accel',''; 'Gyro',''; 'Mag',''; 'Coil',''};
 
-try
-    dev = serialport(cfg.port, cfg.baud);
-    flush(dev);
-catch
-    error('Port %s unavailable.', cfg.port);
-end
+%% --- 2. Data Acquisition ---
+% Framed stream: [0xA5][type][seq u32][len u16][payload][crc16], see Transfer.h
+DIR_SEQ = 2^32 - 1;
+if strlength(cfg.dumpFile) > 0
+    fid = fopen(cfg.dumpFile, 'r'); stream = fread(fid, Inf, '*uint8'); fclose(fid);
+    [frames, ~] = parseFrames(stream);
+else
+    try
+        dev = serialport(cfg.port, cfg.baud);
+        flush(dev);
+    catch
+        error('Port %s unavailable.', cfg.port);
+    end
+    fprintf('Waiting for session directory...\n');
 
-fprintf('Waiting for Mode Byte...\n');
+    stream = zeros(0, 1, 'uint8'); pending = zeros(0, 1, 'uint8');
+    frames = containers.Map('KeyType', 'double', 'ValueType', 'any');
+    ticUpdate = tic;
+    while ~isKey(frames, DIR_SEQ)                                       % Sent by the device on GETDATA
+        if dev.NumBytesAvailable > 0
+            chunk = uint8(read(dev, dev.NumBytesAvailable, "uint8"))';
+            stream = [stream; chunk]; %#ok<AGROW>
+            [frames, pending] = parseFrames([pending; chunk]);
+        elseif toc(ticUpdate) > 2
+            write(dev, uint8('L'), "uint8"); ticUpdate = tic;          % Ask again (started the script late)
+        end
+        pause(0.001);
+    end
+    sessions = frames(DIR_SEQ).sessions;
+    if isempty(sessions), error('No sessions on the device.'); end
+    printSessions(sessions, modes);
+    idx = cfg.session; if idx < 0, idx = numel(sessions) - 1; end
+    write(dev, [uint8('G'), typecast(uint16(idx), 'uint8')], "uint8");
+    fprintf('>>> Downloading session %d...\n', idx);
 
-%% --- 2. Data Acquisition ---
-% Read header to identify sensors
-mIdx = read(dev, 1, "uint8");
-if isempty(mIdx) || mIdx > 5, error('Invalid Mode Byte.'); end
+    frames = containers.Map('KeyType', 'double', 'ValueType', 'any');
+    total = Inf; ticUpdate = tic; nakRound = 0;
+    while true
+        if dev.NumBytesAvailable > 0
+            chunk = uint8(read(dev, dev.NumBytesAvailable, "uint8"))';
+            stream = [stream; chunk]; %#ok<AGROW>
+            [got, pending] = parseFrames([pending; chunk]);
+            for k = keys(got), frames(k{1}) = got(k{1}); end
+            if isKey(frames, 0), total = frames(0).frames; end
+            ticUpdate = tic;
+            if mod(frames.Count, 4096) == 0 && isfinite(total)
+                fprintf('Progress: %.1f%%\n', frames.Count / total * 100);
+            end
+        else
+            missing = [];
+            if isfinite(total), missing = setdiff(0:total-1, cell2mat(keys(frames))); end
+            if isfinite(total) && isempty(missing)
+                write(dev, uint8('A'), "uint8"); break;                 % Everything received
+            elseif toc(ticUpdate) > 0.5 && isfinite(total) && nakRound < 20
+                for seq = missing(1:min(end, 64))                          % Ask for lost/corrupt frames again
+                    write(dev, [uint8('N'), typecast(uint32(seq), 'uint8')], "uint8");
+                end
+                nakRound = nakRound + 1; ticUpdate = tic;
+            elseif toc(ticUpdate) > cfg.timeout
+                fprintf('\n[!] Timeout. Processing received data.\n');
+                break;
+            end
+            pause(0.001);
+        end
+    end
+    if strlength(cfg.saveStream) > 0
+        fid = fopen(cfg.saveStream, 'w'); fwrite(fid, stream, 'uint8'); fclose(fid);
+    end
+end
 
+if isKey(frames, DIR_SEQ), printSessions(frames(DIR_SEQ).sessions, modes); end
+if ~isKey(frames, 0), error('No HEADER frame received.'); end
+hdr = frames(0); ses = hdr.entry; mIdx = ses.mode;
+if mIdx > 11, error('Invalid Mode Byte.'); end
 s1N = modes{mIdx + 1, 1}; s2N = modes{mIdx + 1, 2};
-fprintf('>>> Mode: [%s] & [%s]. Downloading...\n', s1N, s2N);
-
-rawData = zeros(cfg.totalBytes, 1, 'uint8'); 
-ptr = 1; ticUpdate = tic; 
-
-while ptr <= cfg.totalBytes
-    if dev.NumBytesAvailable > 0
-        chunk = read(dev, dev.NumBytesAvailable, "uint8");
-        len = min(length(chunk), cfg.totalBytes - ptr + 1);
-        rawData(ptr : ptr + len - 1) = chunk;
-        ptr = ptr + len;
-        ticUpdate = tic; 
-        
-        if mod(ptr, 1048576) < 1024 % Progress update every 1MB
-            fprintf('Progress: %.1f%%\n', (ptr/cfg.totalBytes)*100);
-        end
-    elseif toc(ticUpdate) > cfg.timeout
-        fprintf('\n[!] Timeout. Processing received data.\n');
-        break; 
+fprintf('>>> Session %d: [%s] & [%s], %d Hz, gain %d. Pages: %d\n', ...
+        hdr.session, s1N, s2N, ses.freq, ses.gain, ses.endPage - ses.startPage);
+
+% Pages in recording order of the session = frame sequence order
+nPages = hdr.frames - 2;
+rawData = zeros(nPages * 256, 1, 'uint8'); have = false(nPages, 1);
+for seq = 1:nPages
+    if isKey(frames, seq)
+        rawData((seq-1)*256 + (1:256)) = frames(seq).data; have(seq) = true;
     end
-    pause(0.01); 
 end
-rawData = rawData(1 : ptr-1);
+if ~all(have), fprintf('[!] %d pages missing.\n', sum(~have)); end
+if isKey(frames, hdr.frames - 1) && isfield(frames(hdr.frames - 1), 'elapsedMs')
+    e = frames(hdr.frames - 1); sec = max(e.elapsedMs, 1) / 1000;
+    fprintf('>>> Transfer: %.2f s, link %.3f MB/s, flash data %.3f MB/s\n', ...
+            sec, e.bytesSent / sec / 1e6, e.bytesRead / sec / 1e6);
+end
+rawData = rawData(repelem(have, 256));
+if ses.schema == 2                                          % SCHEMA_PACKED16: records compressed per page
+    pages = reshape(rawData, 256, []); parts = cell(size(pages, 2), 1);
+    for k = 1:size(pages, 2), parts{k} = decodePacked(pages(:, k)); end
+    rawData = vertcat(parts{:});
+elseif ses.schema == 3                                      % SCHEMA_TIMEBASE14: 64-bit page time + 16-bit deltas
+    pages = reshape(rawData, 256, []); parts = cell(size(pages, 2), 1); times = cell(size(pages, 2), 1);
+    for k = 1:size(pages, 2), [parts{k}, times{k}] = decodeTimeBase(pages(:, k)); end
+    rawData = vertcat(parts{:}); t_us = vertcat(times{:});
+end
 
 %% --- 3. Decoding & Filtering ---
+if ses.schema == 4                                          % SCHEMA_CHANNELS: one bitstream, the channel set in front
+    [t_us, vals, chSensor] = decodeChannels(rawData);
+    t_sec = (t_us - t_us(1)) / 1e6;
+    names = {'Accel', 'Gyro', 'Mag', 'Coil'};
+    sensors = struct('name', {}, 'data', {});
+    for s = unique(chSensor, 'stable')
+        sensors(end + 1) = struct('name', names{s + 1}, 'data', vals(:, chSensor == s)); %#ok<SAGROW>
+    end
+    rawData = zeros(0, 1, 'uint8');                         % Nothing left for the fixed-size packet path below
+end
 numPkts = floor(length(rawData) / cfg.packetSize);
 pkts = reshape(rawData(1 : numPkts * cfg.packetSize), cfg.packetSize, [])';
 
-% Extract Time (uint32) & Data (int16)
-t_sec = (double(typecast(reshape(pkts(:, 13:16)', [], 1), 'uint32')) - ...
-         double(typecast(pkts(1, 13:16), 'uint32'))) / 1e6;
+% Extract Time & Data (int16). uint32 micros wraps every 71 minutes: accumulate the steps modulo 2^32
+if ses.schema == 3
+    t_sec = (t_us - t_us(1)) / 1e6;
+elseif ses.schema ~= 4
+    t32 = double(typecast(reshape(pkts(:, 13:16)', [], 1), 'uint32'));
+    t_sec = [0; cumsum(mod(diff(t32), 2^32))] / 1e6;
+end
 s1 = double(reshape(typecast(reshape(pkts(:, 1:6)', [], 1), 'int16'), 3, [])');
 s2 = double(reshape(typecast(reshape(pkts(:, 7:12)', [], 1), 'int16'), 3, [])');
 
@@ -77,14 +159,17 @@ if ~isempty(stopIdx)
     t_sec = t_sec(valid); s1 = s1(valid,:); s2 = s2(valid,:);
     fprintf('>>> Trimmed %d empty packets.\n', numPkts - length(valid));
 end
+if ses.schema ~= 4
+    sensors = struct('name', {s1N, s2N}, 'data', {s1, s2});
+end
 
 %% --- 4. Visualization ---
 clrs = [0.85 0.33 0.1; 0.47 0.67 0.19; 0 0.45 0.74];
-for fig = 1:2
-    name = eval(sprintf('s%dN', fig)); data = eval(sprintf('s%d', fig));
+for fig = 1:numel(sensors)
+    name = sensors(fig).name; data = sensors(fig).data; nAx = size(data, 2);
     figure('Name', name, 'Color', 'w');
-    for i = 1:3
-        subplot(3,1,i); plot(t_sec, data(:,i), 'Color', clrs(i,:));
+    for i = 1:nAx
+        subplot(nAx,1,i); plot(t_sec, data(:,i), 'Color', clrs(i,:));
         grid on; ylabel(['Axis ', num2str(i)]);
         if i==1, title(['Raw Data: ', name]); end
     end
@@ -92,9 +177,200 @@ for fig = 1:2
 end
 
 %% --- 5. Export ---
-fDir = sprintf('Data_%s_%s_%s', s1N, s2N, datestr(now, 'yyyy-mm-dd_HHMM'));
+fDir = sprintf('Data_%s_%s', strjoin({sensors.name}, '_'), datestr(now, 'yyyy-mm-dd_HHMM'));
 mkdir(fDir);
-save(fullfile(fDir, 'dataset.mat'), 't_sec', 's1', 's2', 's1N', 's2N');
-writetable(table(t_sec, s1(:,1), s1(:,2), s1(:,3)), fullfile(fDir, [s1N '.csv']));
-writetable(table(t_sec, s2(:,1), s2(:,2), s2(:,3)), fullfile(fDir, [s2N '.csv']));
+save(fullfile(fDir, 'dataset.mat'), 't_sec', 'sensors');
+for k = 1:numel(sensors)
+    writetable(array2table([t_sec, sensors(k).data]), fullfile(fDir, [sensors(k).name '.csv']));
+end
 fprintf('>>> Done. Saved to: %s\n', fDir);
+
+%% --- Local functions: reference decoder of the Transfer protocol ---
+function [frames, rest] = parseFrames(buf)
+% Splits a byte stream into CRC-checked frames keyed by sequence number.
+% Corrupt frames are skipped (and NAKed by the caller); rest = incomplete tail.
+    frames = containers.Map('KeyType', 'double', 'ValueType', 'any');
+    buf = buf(:); i = 1; n = numel(buf);
+    while i + 9 <= n
+        if buf(i) ~= 165, i = i + 1; continue; end              % 0xA5
+        len = double(typecast(buf(i+6:i+7), 'uint16'));
+        if i + 9 + len > n, break; end
+        body = buf(i+1 : i+7+len);
+        crc = double(typecast(buf(i+8+len:i+9+len), 'uint16'));
+        if crc16(body) ~= crc, i = i + 1; continue; end
+        type = body(1); seq = double(typecast(body(2:5), 'uint32'));
+        p = body(8:end);
+        switch type
+            case 1  % HEADER
+                f.session = double(typecast(p(5:6), 'uint16'));
+                f.frames = double(typecast(p(7:10), 'uint32'));
+                f.entry = parseEntry(p(11:42));
+            case 2  % PAGE
+                f = struct('chip', double(p(1)), 'page', double(typecast(p(2:3), 'uint16')));
+                if p(4) == 0, f.data = p(5:end); else, f.data = decodePage(p(5:end)); end
+            case 3  % END: link statistics measured by the device
+                st = double(typecast(p(1:12), 'uint32'));
+                f.elapsedMs = st(1); f.bytesSent = st(2); f.bytesRead = st(3);
+            case 4  % DIRECTORY
+                cnt = double(typecast(p(1:2), 'uint16'));
+                f.sessions = cell2mat(arrayfun(@(k) parseEntry(p(3 + 32*k : 34 + 32*k)), 0:cnt-1, 'UniformOutput', false));
+            otherwise
+                f = struct();
+        end
+        frames(seq) = f; clear f;
+        i = i + 10 + len;
+    end
+    rest = buf(i:end);
+end
+
+function e = parseEntry(b)
+% One 32-byte session directory entry (SessionLog::Entry)
+    e.schema = double(b(3)); e.mode = double(b(4));
+    e.freq = double(typecast(b(5:6), 'uint16')); e.gain = double(typecast(b(7:8), 'uint16'));
+    e.init = double(b(9)); e.packetSize = double(b(10));
+    e.startPage = double(typecast(b(13:16), 'uint32'));
+    e.endPage = double(typecast(b(17:20), 'uint32'));
+    e.startMillis = double(typecast(b(21:24), 'uint32'));
+end
+
+function printSessions(sessions, modes)
+    inits = {'TIM', 'HIT', 'STR'};
+    fprintf(' #  Sensors      Freq   Gain  Init    Pages\n');
+    for k = 1:numel(sessions)
+        e = sessions(k);
+        fprintf('%2d  %-5s/%-5s %5d  %5d  %-4s %8d\n', k - 1, modes{e.mode + 1, 1}, ...
+                modes{e.mode + 1, 2}, e.freq, e.gain, inits{min(e.init, 2) + 1}, e.endPage - e.startPage);
+    end
+end
+
+function crc = crc16(data)
+% CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+    crc = uint32(65535);
+    for b = data(:)'
+        crc = bitxor(crc, bitshift(uint32(b), 8));
+        for k = 1:8
+            if bitand(crc, 32768), crc = bitxor(bitand(bitshift(crc, 1), 65535), 4129);
+            else, crc = bitand(bitshift(crc, 1), 65535); end
+        end
+    end
+    crc = double(crc);
+end
+
+function page = decodePage(enc)
+% DELTA_RLE: 7 columns x 16 packets, zigzag varints, 0x00 + varint(run-1) = zero run
+    vals = zeros(112, 1); v = 1; j = 1;
+    while v <= 112
+        isRun = enc(j) == 0; if isRun, j = j + 1; end
+        u = 0; sh = 0;
+        while true
+            c = double(enc(j)); j = j + 1;
+            u = u + bitand(c, 127) * 2^sh; sh = sh + 7;
+            if c < 128, break; end
+        end
+        if isRun, v = v + u + 1;                                % vals are already zero
+        else, vals(v) = u; v = v + 1; end
+    end
+    d = reshape((1 - 2 * mod(vals, 2)) .* floor((vals + mod(vals, 2)) / 2), 16, 7);   % Un-zigzag
+    axes = mod(cumsum(d(:, 1:6)) + 32768, 65536) - 32768;
+    t = mod(cumsum(mod(cumsum(d(:, 7)), 2^32)), 2^32);
+    pkts = [reshape(typecast(reshape(int16(axes'), [], 1), 'uint8'), 12, 16)', ...
+            reshape(typecast(uint32(t), 'uint8'), 4, 16)'];
+    page = reshape(pkts', [], 1);
+end
+
+function out = decodePacked(page)
+% PACKED16: [count u16][keyframe 16 B][per block of 8: 7 x (6-bit width + residuals)], LSB first
+    n = double(typecast(uint8(page(1:2)), 'uint16'));
+    if n == 0 || n > 361, out = zeros(0, 1, 'uint8'); return; end   % Erased, or more than PageCodec::RECORDS
+    nb = numel(page) - 18;
+    bits = double(reshape(bitget(repmat(uint8(page(19:end))', 8, 1), repmat((1:8)', 1, nb)), [], 1));
+    w2 = 2.^(0:31); pos = 1;
+    axes = zeros(n, 6); t = zeros(n, 1);
+    axes(1, :) = double(typecast(uint8(page(3:14)), 'int16')); t(1) = double(typecast(uint8(page(15:18)), 'uint32'));
+    d = 0; k = 1;
+    while k < n
+        m = min(8, n - k); r = zeros(m, 7);
+        for c = 1:7
+            if pos + 5 > numel(bits), n = k; break; end   % Corrupt page: keep what decoded
+            w = w2(1:6) * bits(pos:pos+5); pos = pos + 6;
+            if w > 32 || pos + m * w - 1 > numel(bits), n = k; break; end
+            for i = 1:m, r(i, c) = w2(1:w) * bits(pos:pos+w-1); pos = pos + w; end
+        end
+        if n == k, break; end
+        r = (1 - 2 * mod(r, 2)) .* floor((r + mod(r, 2)) / 2);   % Un-zigzag
+        for i = 1:m
+            axes(k+1, :) = mod(axes(k, :) + r(i, 1:6) + 32768, 65536) - 32768;
+            d = mod(d + r(i, 7), 2^32); t(k+1) = mod(t(k) + d, 2^32); k = k + 1;
+        end
+    end
+    axes = axes(1:n, :); t = t(1:n);
+    pkts = [reshape(typecast(reshape(int16(axes'), [], 1), 'uint8'), 12, n)', ...
+            reshape(typecast(uint32(t), 'uint8'), 4, n)'];
+    out = reshape(pkts', [], 1);
+end
+
+function [out, t] = decodeTimeBase(page)
+% TIMEBASE14: [count u16][base u64][count x (6 x int16, delta u16)]; t = record times in us (double, exact below 2^53)
+    n = double(typecast(uint8(page(1:2)), 'uint16'));
+    if n == 0 || n > 17, out = zeros(0, 1, 'uint8'); t = zeros(0, 1); return; end   % Erased page
+    base = double(typecast(uint8(page(3:10)), 'uint64'));
+    recs = reshape(uint8(page(11 : 10 + 14 * n)), 14, n);
+    t = base + cumsum(double(typecast(reshape(recs(13:14, :), [], 1), 'uint16')));
+    pkts = [recs(1:12, :); reshape(typecast(uint32(mod(t, 2^32))', 'uint8'), 4, n)];
+    out = reshape(pkts, [], 1);
+end
+
+function [t, vals, chSensor] = decodeChannels(data)
+% CHANNELS: ['C' 'S'][version][ChannelSet 13 B][base u64], then fixed-size records LSB first:
+% per slot and axis a two's complement value of the slot width, then the time delta (all ones = end).
+% Version 2: a delta of all ones but bit 0 is a rate record (ADP), its first field the divider of the records after it
+% Version 3: a SPARSE slot (axes bit 3) has a presence bit ahead of its values, absent values come out as NaN
+    data = uint8(data(:));
+    if numel(data) < 24 || ~isequal(data(1:2)', uint8([67 83])) || ~ismember(data(3), [1 2 3]), error('Not a channel-set recording.'); end
+    sensor = double(data(4:7)); axes = double(data(8:11)); bits = double(data(12:15)); timeBits = double(data(16));
+    base = double(typecast(data(17:24), 'uint64'));
+    widths = []; chSensor = [];
+    for k = 1:4
+        if sensor(k) == 255, break; end
+        for a = 0:2
+            if bitand(axes(k), 2^a), widths(end + 1) = bits(k); chSensor(end + 1) = sensor(k); end %#ok<AGROW>
+        end
+    end
+    slots = find([sensor; 255] == 255, 1) - 1;
+    sparse = any(bitand(axes(1:slots), 8));
+    recBits = sum(widths) + timeBits + sum(bitand(axes(1:slots), 8) > 0);   % Longest record
+    bitsAll = reshape(bitget(repmat(data(25:end)', 8, 1), repmat((1:8)', 1, numel(data) - 24)), [], 1);
+    fields = [widths, timeBits];
+    if sparse                                                           % Records of varying size: one at a time
+        bitsAll = [double(bitsAll); ones(recBits, 1)];                  % Reads past the end see erased flash
+        w2 = 2.^(0:31); raw = nan(floor(numel(bitsAll) / (timeBits + 1)), numel(fields)); n = 0; pos = 1;
+        while pos + recBits <= numel(bitsAll)
+            row = nan(1, numel(fields)); c = 1;
+            for k = 1:slots
+                present = ~bitand(axes(k), 8) || bitsAll(pos) == 1;
+                pos = pos + (bitand(axes(k), 8) > 0);
+                for a = 0:2
+                    if ~bitand(axes(k), 2^a), continue; end
+                    if present, row(c) = w2(1:bits(k)) * bitsAll(pos:pos+bits(k)-1); pos = pos + bits(k); end
+                    c = c + 1;
+                end
+            end
+            row(end) = w2(1:timeBits) * bitsAll(pos:pos+timeBits-1); pos = pos + timeBits;
+            n = n + 1; raw(n, :) = row;
+            if row(end) == 2^timeBits - 1, break; end
+        end
+        raw = raw(1:n, :);
+    else
+        n = floor(numel(bitsAll) / recBits);
+        recs = double(reshape(bitsAll(1 : n * recBits), recBits, n)');  % One record per row, LSB first
+        at = cumsum([0, fields]);
+        raw = zeros(n, numel(fields));
+        for c = 1:numel(fields), raw(:, c) = recs(:, at(c) + (1:fields(c))) * (2.^(0:fields(c) - 1))'; end
+    end
+    last = find(raw(:, end) == 2^timeBits - 1, 1, 'first');              % Erased rest of the last page
+    if ~isempty(last), raw = raw(1:last - 1, :); end
+    if data(3) >= 2, raw = raw(raw(:, end) ~= 2^timeBits - 2, :); end   % Rate records: not samples, and their delta is no time step
+    w = repmat(widths, size(raw, 1), 1);
+    vals = raw(:, 1:end-1) - (raw(:, 1:end-1) >= 2.^(w - 1)) .* 2.^w;    % Sign extension
+    t = base + cumsum(raw(:, end));
+end
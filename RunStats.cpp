@@ -0,0 +1,121 @@
+#include "RunStats.h"
+
+static_assert(sizeof(RunStats::Record) == 256, "Run statistics must fill one flash page");
+
+RunStats::RunStats()
+{
+  begin(1000);
+}
+
+void RunStats::begin(uint32_t nominalUs)
+{
+  _nominalUs = nominalUs;
+  _binUs = (nominalUs >= 8) ? nominalUs / 8 : 1;
+  _ticks = 0;
+  _served = 0;
+  _samples = 0;
+  _lastTime = 0;
+  _minInterval = 0xFFFFFFFF;
+  _maxInterval = 0;
+  _peakQueue = 0;
+  _peakPages = 0;
+  _skipped = 0;
+  memset(_hist, 0, sizeof(_hist));
+  memset(_read, 0, sizeof(_read));
+  memset(&_program, 0, sizeof(_program));
+  memset(&_busy, 0, sizeof(_busy));
+}
+
+void RunStats::tick()
+{
+  _ticks = _ticks + 1;
+}
+
+void RunStats::tickServed()
+{
+  _served++;
+}
+
+void RunStats::sample(const uint8_t* timeBytes)
+{
+  uint32_t t;
+  memcpy(&t, timeBytes, 4);
+  if (_samples++ == 0)
+  {
+    _lastTime = t;
+    return;
+  }
+  uint32_t dt = t - _lastTime;                                                    // Wraps like micros()
+  _lastTime = t;
+  uint32_t bin = dt / _binUs;
+  _hist[(bin < BINS) ? bin : BINS - 1]++;
+  if (dt < _minInterval) _minInterval = dt;
+  if (dt > _maxInterval) _maxInterval = dt;
+}
+
+void RunStats::add(Acc& acc, uint32_t us)
+{
+  acc.count++;
+  acc.sumUs += us;
+  if (us > acc.maxUs) acc.maxUs = us;
+}
+
+void RunStats::store(const Acc& acc, Timing& out)
+{
+  uint64_t mean = acc.count ? acc.sumUs / acc.count : 0;
+  out.count = acc.count;
+  out.meanUs = (mean > 0xFFFF) ? 0xFFFF : mean;
+  out.maxUs = (acc.maxUs > 0xFFFF) ? 0xFFFF : acc.maxUs;
+}
+
+void RunStats::read(Channel channel, uint32_t us)
+{
+  add(_read[channel], us);
+}
+
+void RunStats::program(uint32_t us, uint32_t waitedUs)
+{
+  add(_program, us);
+  if (waitedUs > 0)
+  {
+    add(_busy, waitedUs);
+  }
+}
+
+void RunStats::depth(uint16_t queue, uint8_t pages)
+{
+  if (queue > _peakQueue) _peakQueue = queue;
+  if (pages > _peakPages) _peakPages = pages;
+}
+
+void RunStats::skipped(uint32_t reads)
+{
+  _skipped += reads;
+}
+
+void RunStats::snapshot(Record& out, uint32_t dropped, uint32_t summaryDropped) const
+{
+  memset(&out, 0xFF, sizeof(out));
+  out.magic = MAGIC;
+  out.version = VERSION;
+  out.bins = BINS;
+  out.nominalUs = _nominalUs;
+  out.binUs = _binUs;
+  out.samples = _samples;
+  out.dropped = dropped;
+  out.ticks = _ticks;
+  out.missedTicks = (_ticks > _served) ? _ticks - _served : 0;
+  out.minIntervalUs = (_samples > 1) ? _minInterval : 0;
+  out.maxIntervalUs = _maxInterval;
+  out.peakQueue = _peakQueue;
+  out.peakPages = _peakPages;
+  memcpy(out.hist, _hist, sizeof(_hist));
+  for (uint8_t c = 0; c < CHANNELS; c++)
+  {
+    store(_read[c], out.read[c]);
+  }
+  store(_program, out.program);
+  store(_busy, out.busy);
+  out.skippedReads = _skipped;
+  out.summaryDropped = summaryDropped;
+}
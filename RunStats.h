@@ -0,0 +1,91 @@
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+#include <Arduino.h>
+
+                                                                          // Always-on counters of one recording, a few adds per sample.
+                                                                          // Every field has one writer: ticker ISR, acquisition or storage thread.
+                                                                          // The snapshot is stored as one flash page after the session data.
+class RunStats
+{
+public:
+  enum Channel                                                            // Timed sensor reads (IMUHandler::Sensor order first)
+  {
+    ACC, GYR, MAG, COI, ACC_GYR, FIFO, CHANNELS
+  };
+  static const uint16_t MAGIC = 0x5A75;
+  static const uint8_t VERSION = 3;                                       // 2: skippedReads, 3: summaryDropped
+  static const uint8_t BINS = 32;                                         // Interval histogram: BINS bins of nominal / 8, the last one open-ended
+
+  struct Timing                                                           // 8 bytes, times saturate at 65535 us
+  {
+    uint32_t count;
+    uint16_t meanUs;
+    uint16_t maxUs;
+  };
+
+  struct Record                                                           // Stored as is, little-endian, 256 bytes
+  {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t bins;
+    uint32_t nominalUs;                                                   // Expected sample interval
+    uint32_t binUs;                                                       // Histogram bin width
+    uint32_t samples;                                                     // Records acquired (queued or dropped)
+    uint32_t dropped;                                                     // Records lost to a full queue
+    uint32_t ticks;                                                       // Ticker interrupts
+    uint32_t missedTicks;                                                 // Ticks that found the acquisition thread still busy
+    uint32_t minIntervalUs;
+    uint32_t maxIntervalUs;
+    uint16_t peakQueue;                                                   // Records waiting for storage
+    uint16_t peakPages;                                                   // Full pages waiting for flash
+    uint32_t hist[BINS];                                                  // Sample-to-sample intervals from the packed micros()
+    Timing read[CHANNELS];                                                // I2C / ADC read durations
+    Timing program;                                                       // Page program command (SPI transfer)
+    Timing busy;                                                          // Full page waiting for a chip still programming
+    uint32_t skippedReads;                                                // TWIM DMA reads that failed: no record for their tick
+    uint32_t summaryDropped;                                              // Summary pages lost (SummaryLog::dropped()), the data is complete
+    uint8_t spare[16];
+  };
+
+  RunStats();
+
+  void begin(uint32_t nominalUs);                                         // Clears everything, before the ticker starts
+  void tick();                                                            // Ticker ISR
+  void tickServed();                                                      // Acquisition thread, once per wake-up
+  void sample(const uint8_t* timeBytes);                                  // Acquisition thread, packed micros() of each record
+  void read(Channel channel, uint32_t us);                                // Acquisition thread
+  void program(uint32_t us, uint32_t waitedUs);                           // Storage thread, waitedUs = 0 if the chip was ready
+  void depth(uint16_t queue, uint8_t pages);                              // Acquisition thread, after queueing
+  void skipped(uint32_t reads);                                           // Acquisition thread, sensor reads that produced no record
+  void snapshot(Record& out, uint32_t dropped, uint32_t summaryDropped) const;   // After the flush, the threads are idle
+
+private:
+  struct Acc
+  {
+    uint32_t count;
+    uint32_t maxUs;
+    uint64_t sumUs;
+  };
+
+  uint32_t _nominalUs;
+  uint32_t _binUs;
+  volatile uint32_t _ticks;
+  uint32_t _served;
+  uint32_t _samples;
+  uint32_t _lastTime;
+  uint32_t _minInterval;
+  uint32_t _maxInterval;
+  uint16_t _peakQueue;
+  uint8_t _peakPages;
+  uint32_t _skipped;
+  uint32_t _hist[BINS];
+  Acc _read[CHANNELS];
+  Acc _program;
+  Acc _busy;
+
+  static void add(Acc& acc, uint32_t us);
+  static void store(const Acc& acc, Timing& out);
+};
+
+#endif
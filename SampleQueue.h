@@ -0,0 +1,69 @@
+#ifndef SAMPLE_QUEUE_H
+#define SAMPLE_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+                                                                          // Lock-free single-producer/single-consumer queue
+                                                                          // Only <atomic> is used, so the same header builds on the host
+template <typename T, uint32_t N>
+class SampleQueue
+{
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SampleQueue size must be a power of two");
+
+public:
+  SampleQueue() : _head(0), _tail(0) {}
+
+  bool push(const T& item)                                                // Producer only (false - queue is full, the item is not stored)
+  {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_acquire) >= N)
+    {
+      return false;
+    }
+    _items[head & (N - 1)] = item;
+    _head.store(head + 1, std::memory_order_release);                     // Publish the item after it has been copied
+    return true;
+  }
+
+  bool peek(T& item) const                                                // Consumer only, copies the oldest item without removing it
+  {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (_head.load(std::memory_order_acquire) == tail)
+    {
+      return false;
+    }
+    item = _items[tail & (N - 1)];
+    return true;
+  }
+
+  bool pop(T& item)                                                       // Consumer only (false - queue is empty)
+  {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (_head.load(std::memory_order_acquire) == tail)
+    {
+      return false;
+    }
+    item = _items[tail & (N - 1)];
+    _tail.store(tail + 1, std::memory_order_release);                     // Free the slot after it has been copied
+    return true;
+  }
+
+  uint32_t size() const
+  {
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+  }
+
+  void reset()                                                            // Only while neither side is running
+  {
+    _head.store(0);
+    _tail.store(0);
+  }
+
+private:
+  T _items[N];
+  std::atomic<uint32_t> _head;                                            // Free-running counters, wrap safely on uint32_t
+  std::atomic<uint32_t> _tail;
+};
+
+#endif
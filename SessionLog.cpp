@@ -0,0 +1,282 @@
+#include "SessionLog.h"
+
+static_assert(sizeof(SessionLog::Entry) == SessionLog::ENTRY_SIZE, "Session entry must stay 32 bytes");
+
+SessionLog::SessionLog(StorageArray* arrayPtr) : _count(0), _next(0), _summaryNext(0)
+{
+  _array = arrayPtr;
+  _m1 = arrayPtr->chip(0);
+}
+
+uint32_t SessionLog::entryAddr(uint16_t index) const
+{
+  return (uint32_t)index * ENTRY_SIZE;
+}
+
+void SessionLog::locate(uint32_t logicalPage, uint8_t& chip, uint32_t& physPage) const
+{
+  _array->stripe(logicalPage, chip, physPage);
+  physPage += DIR_PAGES;
+}
+
+void SessionLog::locateSummary(uint16_t summaryPage, uint8_t& chip, uint32_t& physPage) const
+{
+  _array->stripe(summaryPage, chip, physPage);
+  physPage += Storage::PAGE_COUNT - SUMMARY_PAGES;
+}
+
+uint32_t SessionLog::sectorOf(uint32_t logicalPage) const
+{
+  return (DIR_PAGES + logicalPage / _array->count()) / Storage::SECTOR_PAGES;
+}
+
+uint32_t SessionLog::sectorGroup() const
+{
+  return (uint32_t)_array->count() * Storage::SECTOR_PAGES;
+}
+
+uint32_t SessionLog::usedPages(uint8_t chip, uint32_t endPage) const
+{
+  return DIR_PAGES + _array->pagesBefore(chip, endPage);
+}
+
+uint32_t SessionLog::firstFree() const
+{
+  return (_next + sectorGroup() - 1) / sectorGroup() * sectorGroup();           // Sessions never share a sector, so it can be erased ahead
+}
+
+uint8_t SessionLog::chips() const
+{
+  return _array->count();
+}
+
+Storage* SessionLog::chip(uint8_t index) const
+{
+  return _array->chip(index);
+}
+
+uint32_t SessionLog::capacity() const
+{
+  return _array->count() * (Storage::PAGE_COUNT - DIR_PAGES - SUMMARY_PAGES);
+}
+
+uint16_t SessionLog::summaryCapacity() const
+{
+  return _array->count() * SUMMARY_PAGES;
+}
+
+uint16_t SessionLog::summaryNext() const
+{
+  return _summaryNext;
+}
+
+uint16_t SessionLog::count() const
+{
+  return _count;
+}
+
+uint32_t SessionLog::nextPage() const
+{
+  return _next;
+}
+
+void SessionLog::load()
+{
+  Entry entry;
+  _count = 0;
+  _next = 0;
+  _summaryNext = 0;
+  while (_count < MAX_SESSIONS && read(_count, entry))
+  {
+    _count++;
+    if (entry.endPage == OPEN)                                                    // Never closed: find where the data stops
+    {
+      close(findEnd(entry.startPage));
+      read(_count - 1, entry);
+    }
+    _next = (entry.statsPage != OPEN) ? entry.statsPage + 1 : entry.endPage;
+    if (entry.summaryPage == NO_SUMMARY)
+    {
+      continue;
+    }
+    if (entry.summaryPages == 0xFFFF)                                             // Summaries cut off with the data
+    {
+      _summaryNext = entry.summaryPage;
+      closeSummary(findSummaryEnd(entry.summaryPage) - entry.summaryPage);
+    }
+    else
+    {
+      _summaryNext = entry.summaryPage + entry.summaryPages;
+    }
+  }
+}
+
+bool SessionLog::read(uint16_t index, Entry& entry)
+{
+  if (index >= MAX_SESSIONS)
+  {
+    return false;
+  }
+  _m1->readBytes(entryAddr(index), (uint8_t*)&entry, ENTRY_SIZE);
+  return entry.magic == MAGIC;
+}
+
+uint32_t SessionLog::nextStart() const
+{
+  return firstFree();
+}
+
+bool SessionLog::hasRoom() const
+{
+  return _count < MAX_SESSIONS && firstFree() < capacity();
+}
+
+bool SessionLog::open(Entry& entry)
+{
+  if (!hasRoom())
+  {
+    return false;
+  }
+  entry.magic = MAGIC;
+  entry.summaryPage = (_summaryNext < summaryCapacity()) ? _summaryNext : NO_SUMMARY;
+  entry.startPage = firstFree();
+  entry.endPage = OPEN;                                                           // Left erased, programmed by close()
+  entry.statsPage = OPEN;                                                         // Left erased, programmed by writeStats()
+  entry.summaryPages = 0xFFFF;                                                    // Left erased, programmed by closeSummary()
+  _m1->writeBytes(entryAddr(_count), (const uint8_t*)&entry, ENTRY_SIZE);
+  _count++;
+  return true;
+}
+
+void SessionLog::close(uint32_t endPage)
+{
+  if (_count == 0)
+  {
+    return;
+  }
+  _m1->writeBytes(entryAddr(_count - 1) + offsetof(Entry, endPage), (const uint8_t*)&endPage, 4);
+  _next = endPage;
+}
+
+void SessionLog::closeSummary(uint16_t pages)
+{
+  if (_count == 0)
+  {
+    return;
+  }
+  _m1->writeBytes(entryAddr(_count - 1) + offsetof(Entry, summaryPages), (const uint8_t*)&pages, 2);
+  _summaryNext += pages;
+}
+
+bool SessionLog::writeStats(const uint8_t* page)
+{
+  if (_count == 0 || _next >= capacity())                                         // Erase-ahead keeps the page after the data erased
+  {
+    return false;
+  }
+  uint8_t c;
+  uint32_t phys;
+  uint8_t buffer[256];
+  memcpy(buffer, page, sizeof(buffer));
+  locate(_next, c, phys);
+  chip(c)->writePage(phys, buffer);
+  _m1->writeBytes(entryAddr(_count - 1) + offsetof(Entry, statsPage), (const uint8_t*)&_next, 4);
+  _next++;
+  return true;
+}
+
+bool SessionLog::readStats(uint16_t index, uint8_t* page)
+{
+  Entry entry;
+  if (!read(index, entry) || entry.statsPage == OPEN || entry.statsPage >= capacity())
+  {
+    return false;
+  }
+  uint8_t c;
+  uint32_t phys;
+  locate(entry.statsPage, c, phys);
+  chip(c)->readPage(phys, page);
+  return true;
+}
+
+bool SessionLog::clear()
+{
+  uint32_t start = millis();
+  while (_m1->isBusy())                                                   // A page program or an erase left running by the last session
+  {
+    if (millis() - start > CLEAR_WAIT_MS) return false;
+  }
+  if (!_m1->startEraseSector(0)) return false;                            // Directory left as it is, so the sessions stay listed
+  _count = 0;
+  _next = 0;
+  _summaryNext = 0;
+  return true;
+}
+
+bool SessionLog::isBusy()
+{
+  return _m1->isBusy();
+}
+
+uint32_t SessionLog::findEnd(uint32_t startPage)
+{
+                                                                                  // Pages of a session are written without gaps, except the last
+                                                                                  // ring of pages that may land out of order (pages after a hole
+                                                                                  // are dropped), and at least the next sector group is erased
+                                                                                  // before any write (EraseAhead), so the first erased probe at
+                                                                                  // this stride is within reach of the end. Stale data further on
+                                                                                  // is never looked at.
+  const uint32_t stride = Storage::SECTOR_PAGES;
+  uint32_t lo = startPage, hi = startPage;
+  while (hi < capacity())
+  {
+    uint8_t c;
+    uint32_t phys;
+    locate(hi, c, phys);
+    if (chip(c)->isPageErased(phys))
+    {
+      break;
+    }
+    lo = hi + 1;
+    hi += stride;
+  }
+  if (hi > capacity())
+  {
+    hi = capacity();
+  }
+  while (lo < hi)
+  {
+    uint32_t mid = lo + (hi - lo) / 2;
+    uint8_t c;
+    uint32_t phys;
+    locate(mid, c, phys);
+    if (chip(c)->isPageErased(phys))
+    {
+      hi = mid;
+    }
+    else
+    {
+      lo = mid + 1;
+    }
+  }
+  return lo;
+}
+
+uint16_t SessionLog::findSummaryEnd(uint16_t startPage)
+{
+  uint16_t page = startPage;                                                      // A few pages per minute of recording: a linear scan is enough
+  while (page < summaryCapacity())
+  {
+    uint8_t c;
+    uint32_t phys;
+    locateSummary(page, c, phys);
+    uint8_t level;
+    chip(c)->readBytes(phys * 256, &level, 1);                                    // SummaryLog::PageHeader::level, 0xFF only if erased
+    if (level == 0xFF)
+    {
+      break;
+    }
+    page++;
+  }
+  return page;
+}
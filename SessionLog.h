@@ -0,0 +1,87 @@
+#ifndef SESSION_LOG_H
+#define SESSION_LOG_H
+
+#include <Arduino.h>
+#include "Storage.h"
+#include "StorageArray.h"
+
+                                                                          // Append-only session directory in the first sector of M1
+                                                                          // Data pages are logical: page k -> chip k % N, physical page DIR_PAGES + k / N
+                                                                          // The top SUMMARY_PAGES of every chip hold the summary pages (SummaryLog)
+                                                                          // of all sessions, striped the same way, appended like the data
+class SessionLog
+{
+public:
+  static const uint8_t DIR_PAGES = 16;                                    // One 4 KB sector, reserved on every chip to keep them in step
+  static const uint8_t ENTRY_SIZE = 32;
+  static const uint16_t MAX_SESSIONS = DIR_PAGES * 256 / ENTRY_SIZE;      // 128
+  static const uint16_t SUMMARY_PAGES = 4096;                             // Per chip, 1 MB: about 1/16 of the data they describe
+  static const uint16_t NO_SUMMARY = 0xFFFF;                              // summaryPage of sessions recorded without summaries
+  static const uint16_t MAGIC = 0x5E55;
+  static const uint8_t SCHEMA_PAIR16 = 1;                                 // 2 x 3 int16 + uint32 micros, 16 bytes
+  static const uint8_t SCHEMA_PACKED16 = 2;                               // SCHEMA_PAIR16 records compressed per page (PageCodec)
+  static const uint8_t SCHEMA_TIMEBASE14 = 3;                             // 64-bit time per page, 12 axis bytes + 16-bit delta per record (TimeBaseCodec)
+  static const uint8_t SCHEMA_CHANNELS = 4;                               // Channel-set bitstream over the session's pages (ChannelPacker)
+  static const uint32_t OPEN = 0xFFFFFFFF;                                // endPage of a session that is still recording
+
+  struct Entry                                                            // Stored as is, little-endian, 32 bytes
+  {
+    uint16_t magic;
+    uint8_t schema;
+    uint8_t mode;                                                         // SENSORS menu index
+    uint16_t freq;                                                        // Hz
+    uint16_t gain;
+    uint8_t init;                                                         // 0: TIM, 1: HIT, 2: STR (streamed while recording)
+    uint8_t packetSize;
+    uint16_t summaryPage;                                                 // First summary page (NO_SUMMARY - none)
+    uint32_t startPage;                                                   // First logical data page
+    uint32_t endPage;                                                     // One past the last logical data page
+    uint32_t startMillis;                                                 // Uptime when the session was opened
+    uint32_t statsPage;                                                   // Logical page of the run statistics after the data (OPEN - none)
+    uint16_t preTrigger;                                                  // HIT: records stored before the trigger record
+    uint16_t summaryPages;                                                // Left erased while recording, programmed by closeSummary()
+  };
+
+  SessionLog(StorageArray* arrayPtr);
+
+  void load();                                                            // Scans the directory, closes a session cut off by power loss
+  uint16_t count() const;
+  bool read(uint16_t index, Entry& entry);
+  bool open(Entry& entry);                                                // Appends at the next sector pair (false - directory or flash full)
+  void close(uint32_t endPage);
+  void closeSummary(uint16_t pages);                                      // Summary pages the open session wrote
+  bool writeStats(const uint8_t* page);                                   // Blocking: one page after the closed session's data, linked from its entry
+  bool readStats(uint16_t index, uint8_t* page);                          // false - the session has no statistics
+  bool clear();                                                           // Erases the directory only, data sectors are erased ahead of recording
+                                                                          // (false - M1 stayed busy, nothing was forgotten)
+  bool isBusy();
+  uint32_t nextPage() const;                                              // First free logical page
+  uint32_t nextStart() const;                                             // Where open() will place the next session
+  bool hasRoom() const;                                                   // open() would succeed
+  uint32_t capacity() const;                                              // Logical data pages of all chips
+  uint16_t summaryCapacity() const;                                       // Summary pages of all chips
+  uint16_t summaryNext() const;                                           // Where the next session's summaries start
+
+  void locate(uint32_t logicalPage, uint8_t& chip, uint32_t& physPage) const;
+  void locateSummary(uint16_t summaryPage, uint8_t& chip, uint32_t& physPage) const;
+  uint32_t sectorOf(uint32_t logicalPage) const;                          // Physical sector index (same on every chip)
+  uint32_t sectorGroup() const;                                           // Logical pages sharing one sector index on every chip
+  uint32_t usedPages(uint8_t chip, uint32_t endPage) const;               // Physical pages of chip below logical endPage, directory included
+  uint8_t chips() const;
+  Storage* chip(uint8_t index) const;
+
+private:
+  static const uint32_t CLEAR_WAIT_MS = 1000;                             // Covers a sector erase, the longest single M1 operation
+  StorageArray* _array;
+  Storage* _m1;                                                           // Holds the directory
+  uint16_t _count;
+  uint32_t _next;
+  uint16_t _summaryNext;
+
+  uint32_t entryAddr(uint16_t index) const;
+  uint32_t findEnd(uint32_t startPage);                                   // First erased logical page at or after startPage
+  uint16_t findSummaryEnd(uint16_t startPage);                            // First erased summary page at or after startPage
+  uint32_t firstFree() const;                                             // _next rounded up to a sector pair
+};
+
+#endif
@@ -1,8 +1,8 @@
 #include "Storage.h"
 
-Storage::Storage(int csPin) : _cs(csPin)
+Storage::Storage(int csPin) : _cs(csPin), _writePending(false)
 {
-
+  memset(_erased, 0, sizeof(_erased));
 }
 
 void Storage::init()
@@ -36,55 +36,201 @@ void Storage::writeEnable()
   digitalWrite(_cs, HIGH);
 }
 
-void Storage::eraseSector(uint32_t addr)
+void Storage::sendCommand(uint8_t cmd, uint32_t addr)
 {
   writeEnable();
   digitalWrite(_cs, LOW);
-  SPI.transfer(SE);
+  SPI.transfer(cmd);
   SPI.transfer((addr >> 16) & 0xFF);
   SPI.transfer((addr >> 8) & 0xFF);
   SPI.transfer(addr & 0xFF);
   digitalWrite(_cs, HIGH);
+}
+
+void Storage::markErased(uint32_t sector, bool erased)
+{
+  if (erased)
+  {
+    _erased[sector >> 5] |= (1UL << (sector & 31));
+  }
+  else
+  {
+    _erased[sector >> 5] &= ~(1UL << (sector & 31));
+  }
+}
+
+bool Storage::isSectorErased(uint32_t sector) const
+{
+  return (_erased[sector >> 5] >> (sector & 31)) & 1;
+}
+
+bool Storage::isBlockUnknown(uint32_t block) const
+{
+  return (_erased[block >> 1] & (0xFFFFUL << ((block & 1) * 16))) == 0;           // 16 sectors = half a bitmap word
+}
+
+void Storage::eraseSector(uint32_t addr)
+{
   waitForReady();
+  sendCommand(SE, addr);
+  markErased(addr / (SECTOR_PAGES * 256), true);
+  waitForReady();
+}
+
+bool Storage::startEraseSector(uint32_t sector)
+{
+  if (isBusy())
+  {
+    return false;
+  }
+  sendCommand(SE, sector * SECTOR_PAGES * 256);
+  markErased(sector, true);                                                       // Programs wait for WIP, so the sector is usable once the chip is ready
+  return true;
+}
+
+bool Storage::startEraseBlock(uint32_t block)
+{
+  if (isBusy())
+  {
+    return false;
+  }
+  sendCommand(BKE, block * BLOCK_SECTORS * SECTOR_PAGES * 256);
+  for (uint16_t i = 0; i < BLOCK_SECTORS; i++)
+  {
+    markErased(block * BLOCK_SECTORS + i, true);
+  }
+  return true;
+}
+
+bool Storage::checkSectorBlank(uint32_t sector)
+{
+  uint8_t data[256];
+  bool blank = true;
+  beginRead(sector * SECTOR_PAGES * 256);                                         // Whole sector in one command
+  for (uint16_t p = 0; p < SECTOR_PAGES && blank; p++)
+  {
+    readChunk(data, sizeof(data));
+    for (int i = 0; i < 256; i++)
+    {
+      if (data[i] != 0xFF)
+      {
+        blank = false;
+        break;
+      }
+    }
+  }
+  endRead();
+  if (blank)
+  {
+    markErased(sector, true);
+  }
+  return blank;
 }
 
 void Storage::writePage(uint32_t pageAddr, uint8_t* data)
 {
-    uint32_t addr = pageAddr * 256; 
-    writeEnable();
-    digitalWrite(_cs, LOW);
-    SPI.transfer(PP);
-    SPI.transfer((addr >> 16) & 0xFF);
-    SPI.transfer((addr >> 8) & 0xFF);
-    SPI.transfer(addr & 0xFF);
-    SPI.transfer(data, 256);
-    digitalWrite(_cs, HIGH);
-    SPI.endTransaction();
+  waitForReady();                                                                 // WREN is ignored while the previous program is running
+  startWritePage(pageAddr, data);
 }
 
-void Storage::readPage(uint32_t pageAddr, uint8_t* data)
+bool Storage::startWritePage(uint32_t pageAddr, uint8_t* data)
 {
+  if (isBusy())
+  {
+    return false;
+  }
   uint32_t addr = pageAddr * 256;
+  writeEnable();
   digitalWrite(_cs, LOW);
-  SPI.transfer(READ);
+  SPI.transfer(PP);
   SPI.transfer((addr >> 16) & 0xFF);
   SPI.transfer((addr >> 8) & 0xFF);
   SPI.transfer(addr & 0xFF);
-  for (int i = 0; i < 256; i++) 
+  SPI.transfer(data, 256);                                                        // Page is latched by the chip, the buffer may be reused
+  digitalWrite(_cs, HIGH);
+  markErased(pageAddr / SECTOR_PAGES, false);
+  _writePending = true;
+  return true;
+}
+
+bool Storage::isWriteComplete()
+{
+  if (_writePending && !isBusy())
   {
-    data[i] = SPI.transfer(0);
+    _writePending = false;
   }
+  return !_writePending;
+}
+
+void Storage::readPage(uint32_t pageAddr, uint8_t* data)
+{
+  readPages(pageAddr, data, 1);
+}
+
+void Storage::readPages(uint32_t pageAddr, uint8_t* data, uint16_t count)
+{
+  beginRead(pageAddr * 256);
+  readChunk(data, count * 256);
+  endRead();
+}
+
+void Storage::beginRead(uint32_t addr)
+{
+  digitalWrite(_cs, LOW);
+  SPI.transfer(FAST_READ);
+  SPI.transfer((addr >> 16) & 0xFF);
+  SPI.transfer((addr >> 8) & 0xFF);
+  SPI.transfer(addr & 0xFF);
+  SPI.transfer(0);                                                                // Dummy byte
+}
+
+void Storage::readChunk(uint8_t* data, uint16_t len)
+{
+  SPI.transfer(data, len);                                                        // In place: whatever is in data goes out on MOSI and is ignored
+}
+
+void Storage::endRead()
+{
   digitalWrite(_cs, HIGH);
 }
 
-void Storage::writeTo(Storage::ChipSelect chip, uint32_t pageAddr, uint8_t* data, Storage& m1, Storage& m2)
+bool Storage::isPageErased(uint32_t pageAddr)
 {
-  if (chip == Storage::MEM_1) {
-    m1.writePage(pageAddr, data);
-  } 
-  else {
-    m2.writePage(pageAddr, data);
+  uint8_t data[256];
+  readPage(pageAddr, data);
+  for (int i = 0; i < 256; i++)
+  {
+    if (data[i] != 0xFF)
+    {
+      return false;
+    }
   }
+  return true;
+}
+
+void Storage::readBytes(uint32_t addr, uint8_t* data, uint16_t len)
+{
+  beginRead(addr);
+  readChunk(data, len);
+  endRead();
+}
+
+void Storage::writeBytes(uint32_t addr, const uint8_t* data, uint16_t len)
+{
+  waitForReady();
+  writeEnable();
+  digitalWrite(_cs, LOW);
+  SPI.transfer(PP);
+  SPI.transfer((addr >> 16) & 0xFF);
+  SPI.transfer((addr >> 8) & 0xFF);
+  SPI.transfer(addr & 0xFF);
+  for (uint16_t i = 0; i < len; i++)
+  {
+    SPI.transfer(data[i]);
+  }
+  digitalWrite(_cs, HIGH);
+  markErased(addr / (SECTOR_PAGES * 256), false);
+  waitForReady();
 }
 
 void Storage::startBulkErase()
@@ -93,4 +239,5 @@ void Storage::startBulkErase()
   digitalWrite(_cs, LOW);
   SPI.transfer(BE);
   digitalWrite(_cs, HIGH);
+  memset(_erased, 0xFF, sizeof(_erased));
 }
\ No newline at end of file
@@ -6,35 +6,57 @@
 
 class Storage {
 public:
-  enum ChipSelect
-  { 
-    MEM_1, MEM_2 
-  };
   enum Commands
   {
     WREN = 0x06,
     RDSR = 0x05,
     READ = 0x03,
+    FAST_READ = 0x0B,                                                     // READ + one dummy byte, valid at any SPI clock
     PP   = 0x02,                                                          // Page Program
     SE   = 0x20,                                                          // Sector Erase
+    BKE  = 0xD8,                                                          // Block Erase (64KB)
     BE   = 0x60                                                           // Bulk Erase
   };
+  static const uint32_t PAGE_COUNT = 65536;                               // 16 MB chip, 256-byte pages
+  static const uint16_t SECTOR_PAGES = 16;                                // 4KB sector
+  static const uint16_t BLOCK_SECTORS = 16;                               // 64KB block
+  static const uint16_t SECTOR_COUNT = PAGE_COUNT / SECTOR_PAGES;
+
   Storage(int csPin);
   void init();
     
                                                                           // Working with pages (0...65535)
-  void writePage(uint32_t pageAddr, uint8_t* data);
+  void writePage(uint32_t pageAddr, uint8_t* data);                      // Blocking: waits for the chip before programming
+  bool startWritePage(uint32_t pageAddr, uint8_t* data);                  // Non-blocking: programs only if the chip is ready (false - busy, try later)
+  bool isWriteComplete();                                                 // Polls WIP of the last started page program
   void readPage(uint32_t pageAddr, uint8_t* data);
+  void readPages(uint32_t pageAddr, uint8_t* data, uint16_t count);      // One FAST_READ over consecutive pages
+                                                                          // Streaming read: one command for any length, chunks use buffered SPI
+  void beginRead(uint32_t addr);
+  void readChunk(uint8_t* data, uint16_t len);
+  void endRead();
+  bool isPageErased(uint32_t pageAddr);                                   // All 0xFF
+  void readBytes(uint32_t addr, uint8_t* data, uint16_t len);             // Byte-addressed access for small records
+  void writeBytes(uint32_t addr, const uint8_t* data, uint16_t len);      // Blocking, must not cross a page; only 1 -> 0 bits change
   void eraseSector(uint32_t addr);                                        // Sector 4KB
+  bool startEraseSector(uint32_t sector);                                 // Non-blocking erase by index (false - busy, try later)
+  bool startEraseBlock(uint32_t block);
+  bool checkSectorBlank(uint32_t sector);                                 // Reads the sector back, marks it erased if it is all 0xFF
+                                                                          // Erase tracking (RAM only: after reset nothing is known to be erased)
+  bool isSectorErased(uint32_t sector) const;                             // Erased and no page programmed since
+  bool isBlockUnknown(uint32_t block) const;                              // No sector of the block is known to be erased
   void eraseChip();                                                       // Full cleanup
   bool isBusy();                                                          // Check status
   void startBulkErase();
-  static void writeTo(ChipSelect chip, uint32_t pageAddr, uint8_t* data, Storage& m1, Storage& m2);
 
 private:
   int _cs;
+  bool _writePending;                                                     // Page program started and not yet confirmed by WIP
+  uint32_t _erased[SECTOR_COUNT / 32];                                    // One bit per sector
   void writeEnable();
   void waitForReady();
+  void sendCommand(uint8_t cmd, uint32_t addr);
+  void markErased(uint32_t sector, bool erased);
 };
 
 #endif
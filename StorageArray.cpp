@@ -0,0 +1,54 @@
+#include "StorageArray.h"
+
+StorageArray::StorageArray(Storage* const* chips, uint8_t count) : _count(count), _busy(0)
+{
+  for (uint8_t i = 0; i < count; i++)
+  {
+    _chips[i] = chips[i];
+  }
+}
+
+void StorageArray::init()
+{
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    _chips[i]->init();
+  }
+}
+
+uint8_t StorageArray::count() const
+{
+  return _count;
+}
+
+Storage* StorageArray::chip(uint8_t index) const
+{
+  return _chips[index];
+}
+
+void StorageArray::stripe(uint32_t index, uint8_t& chip, uint32_t& offset) const
+{
+  chip = index % _count;
+  offset = index / _count;
+}
+
+uint32_t StorageArray::pagesBefore(uint8_t chip, uint32_t index) const
+{
+  return (index + _count - 1 - chip) / _count;
+}
+
+void StorageArray::beginPass()
+{
+  _busy = 0;
+}
+
+bool StorageArray::tryProgram(uint8_t chip, uint32_t page, uint8_t* data)
+{
+  uint8_t bit = 1 << chip;
+  if (_busy & bit)                                                                // One status poll per chip and pass is enough
+  {
+    return false;
+  }
+  _busy |= bit;                                                                   // Busy either way: still programming, or from now on
+  return _chips[chip]->startWritePage(page, data);
+}
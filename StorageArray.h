@@ -0,0 +1,41 @@
+#ifndef STORAGE_ARRAY_H
+#define STORAGE_ARRAY_H
+
+#include <Arduino.h>
+#include "Storage.h"
+
+                                                                          // 1 to MAX_CHIPS flash chips on the SPI bus seen as one striped page space:
+                                                                          // stripe index k -> chip k % N, offset k / N. The map is fixed, so nothing
+                                                                          // has to be stored to read a session back; the writer overlaps the chips
+                                                                          // by programming whichever waiting page has an idle chip (tryProgram()).
+class StorageArray
+{
+public:
+  static const uint8_t MAX_CHIPS = 4;                                     // More: raise it, _busy has room for 8
+
+  template <size_t N>
+  explicit StorageArray(Storage* const (&chips)[N]) : StorageArray(chips, (uint8_t)N)   // A chip array that doesn't fit fails the build
+  {
+    static_assert(N > 0 && N <= MAX_CHIPS, "StorageArray: 1 to MAX_CHIPS chips");
+  }
+
+  void init();
+  uint8_t count() const;
+  Storage* chip(uint8_t index) const;
+  void stripe(uint32_t index, uint8_t& chip, uint32_t& offset) const;
+  uint32_t pagesBefore(uint8_t chip, uint32_t index) const;              // Stripe indexes below index that land on chip
+
+  void beginPass();                                                       // Start of a write pass: every chip may be polled again
+  bool tryProgram(uint8_t chip, uint32_t page, uint8_t* data);            // Non-blocking (false - chip busy, not polled again in this pass)
+
+private:
+  Storage* _chips[MAX_CHIPS];
+  uint8_t _count;
+  uint8_t _busy;                                                          // Chips found busy in this pass, one bit each
+
+  static_assert(MAX_CHIPS <= 8 * sizeof(_busy), "StorageArray: one _busy bit per chip");
+
+  StorageArray(Storage* const* chips, uint8_t count);
+};
+
+#endif
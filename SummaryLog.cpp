@@ -0,0 +1,234 @@
+#include "SummaryLog.h"
+
+static_assert(sizeof(SummaryLog::PageHeader) == 8, "Summary page header must stay 8 bytes");
+
+SummaryLog::SummaryLog(SessionLog* logPtr, StorageArray* arrayPtr) : _channels(0), _perPage(0), _head(0), _count(0), _open(false),
+  _next(0), _written(0), _dropped(0)
+{
+  _log = logPtr;
+  _array = arrayPtr;
+}
+
+void SummaryLog::start(const ChannelSet& set)
+{
+  _channels = 0;
+  _sparse = 0;
+  for (uint8_t k = 0; k < ChannelSet::SLOTS; k++)
+  {
+    for (uint8_t a = 0; a < 3; a++)
+    {
+      if (set.axes[k] & (1 << a))
+      {
+        _slot[_channels] = k;
+        _offset[_channels++] = SamplePacket::slotOffset(k) + 2 * a;
+      }
+    }
+    _sparse |= (set.axes[k] & ChannelSet::SPARSE) ? 1 << k : 0;
+  }
+  _perPage = (PAGE_SIZE - sizeof(PageHeader)) / blockSize();
+  for (uint8_t l = 0; l < LEVELS; l++)
+  {
+    clear(_acc[l]);
+    _blocks[l] = 0;
+    _fillBlocks[l] = 0;
+    memset(_fill[l], 0xFF, PAGE_SIZE);
+  }
+  _head = 0;
+  _count = 0;
+  _dropped = 0;
+}
+
+void SummaryLog::open(uint16_t firstPage)
+{
+  _next = firstPage;
+  _written = 0;
+  _open = (firstPage != SessionLog::NO_SUMMARY);                                  // Region full: the session is recorded without summaries
+}
+
+uint8_t SummaryLog::blockSize() const
+{
+  return BLOCK_HEADER + _channels * 8;
+}
+
+uint32_t SummaryLog::blockRecords(uint8_t level)
+{
+  uint32_t n = BLOCK;
+  while (level-- > 0)
+  {
+    n *= FACTOR;
+  }
+  return n;
+}
+
+void SummaryLog::clear(Acc& a)
+{
+  for (uint8_t c = 0; c < MAX_CHANNELS; c++)
+  {
+    a.min[c] = INT16_MAX;
+    a.max[c] = INT16_MIN;
+    a.sum[c] = 0;
+    a.squares[c] = 0;
+    a.count[c] = 0;
+  }
+  a.page = 0;
+  a.records = 0;
+}
+
+void SummaryLog::add(const SamplePacket& packet, uint32_t page)
+{
+  Acc& a = _acc[0];
+  if (a.records == 0)
+  {
+    a.page = page;
+  }
+  uint8_t absent = _sparse & ~packet.present;
+  for (uint8_t c = 0; c < _channels; c++)
+  {
+    if (absent & (1 << _slot[c]))
+    {
+      continue;
+    }
+    int16_t v;
+    memcpy(&v, packet.bytes + _offset[c], 2);
+    if (v < a.min[c]) a.min[c] = v;
+    if (v > a.max[c]) a.max[c] = v;
+    a.sum[c] += v;
+    a.squares[c] += (uint32_t)((int32_t)v * v);
+    a.count[c]++;
+  }
+  if (++a.records == BLOCK)
+  {
+    closeBlock(0);
+  }
+}
+
+void SummaryLog::closeBlock(uint8_t level)
+{
+  Acc& a = _acc[level];
+  uint8_t* p = _fill[level] + sizeof(PageHeader) + _fillBlocks[level] * blockSize();
+  memcpy(p, &a.page, 4);
+  memcpy(p + 4, &a.records, 2);
+  p += BLOCK_HEADER;
+  for (uint8_t c = 0; c < _channels; c++)
+  {
+    uint16_t n = (a.count[c] > 0) ? a.count[c] : 1;
+    float rms = sqrtf((float)a.squares[c] / n);
+    int16_t v[4] = {a.min[c], a.max[c], (int16_t)(a.sum[c] / n), (int16_t)((rms < 32767.0f) ? rms + 0.5f : 32767.0f)};
+    memcpy(p, v, sizeof(v));
+    p += sizeof(v);
+  }
+  _blocks[level]++;
+  if (++_fillBlocks[level] == _perPage)
+  {
+    closePage(level);
+  }
+
+  if (level + 1 < LEVELS)                                                         // Sums carry over exactly, the mean and RMS are not averaged
+  {
+    Acc& up = _acc[level + 1];
+    if (up.records == 0)
+    {
+      up.page = a.page;
+    }
+    for (uint8_t c = 0; c < _channels; c++)
+    {
+      if (a.min[c] < up.min[c]) up.min[c] = a.min[c];
+      if (a.max[c] > up.max[c]) up.max[c] = a.max[c];
+      up.sum[c] += a.sum[c];
+      up.squares[c] += a.squares[c];
+      up.count[c] += a.count[c];
+    }
+    up.records += a.records;
+    if (up.records >= blockRecords(level + 1))
+    {
+      closeBlock(level + 1);
+    }
+  }
+  clear(a);
+}
+
+void SummaryLog::closePage(uint8_t level)
+{
+  PageHeader h = {level, _channels, _fillBlocks[level], 0xFF, _blocks[level] - _fillBlocks[level]};
+  memcpy(_fill[level], &h, sizeof(h));
+  if (_count < PENDING)
+  {
+    memcpy(_pending[(_head + _count) % PENDING], _fill[level], PAGE_SIZE);
+    _count++;
+  }
+  else
+  {
+    _dropped++;                                                                   // The host sees the gap in firstBlock
+  }
+  _fillBlocks[level] = 0;
+  memset(_fill[level], 0xFF, PAGE_SIZE);
+}
+
+bool SummaryLog::step()
+{
+  if (!_open || _count == 0)
+  {
+    return false;
+  }
+  if (_next >= _log->summaryCapacity())                                           // Region full: the data goes on without summaries
+  {
+    _dropped += _count;
+    _count = 0;
+    return false;
+  }
+  uint8_t c;
+  uint32_t phys;
+  _log->locateSummary(_next, c, phys);
+  Storage* chip = _log->chip(c);
+  uint32_t sector = phys / Storage::SECTOR_PAGES;
+  if (phys % Storage::SECTOR_PAGES == 0 && !chip->isSectorErased(sector))       // First page of a sector: it must be fresh
+  {
+    if (!chip->isBusy() && !chip->checkSectorBlank(sector))                      // A few per MB of data, erased when they are reached
+    {
+      chip->startEraseSector(sector);
+    }
+    return true;
+  }
+  if (!_array->tryProgram(c, phys, _pending[_head]))
+  {
+    return true;
+  }
+  _head = (_head + 1) % PENDING;
+  _count--;
+  _next++;
+  _written++;
+  return _count > 0;
+}
+
+void SummaryLog::finish()
+{
+  for (uint8_t l = 0; l < LEVELS; l++)                                            // A partial block still carries over to the next level first
+  {
+    if (_acc[l].records > 0)
+    {
+      closeBlock(l);
+    }
+  }
+  for (uint8_t l = 0; l < LEVELS; l++)
+  {
+    if (_fillBlocks[l] > 0)
+    {
+      closePage(l);
+    }
+  }
+  while (step())
+  {
+    _array->beginPass();
+  }
+  _open = false;
+}
+
+uint16_t SummaryLog::pagesWritten() const
+{
+  return _written;
+}
+
+uint32_t SummaryLog::dropped() const
+{
+  return _dropped;
+}
@@ -0,0 +1,84 @@
+#ifndef SUMMARY_LOG_H
+#define SUMMARY_LOG_H
+
+#include <Arduino.h>
+#include "SessionLog.h"
+#include "StorageArray.h"
+#include "ChannelSet.h"
+#include "IMUHandler.h"
+
+                                                                          // Envelope of a recording while it is recorded: min, max, mean and RMS of every
+                                                                          // channel per block of records, at LEVELS decimations. Full pages of blocks go to
+                                                                          // the summary region (SessionLog::locateSummary), so a host can look at a whole
+                                                                          // session in a few KB before it downloads any of the data.
+class SummaryLog
+{
+public:
+  static const uint8_t LEVELS = 2;
+  static const uint16_t BLOCK = 256;                                      // Records per level 0 block
+  static const uint8_t FACTOR = 16;                                       // Level n + 1 blocks hold FACTOR level n blocks (4096 records)
+  static const uint8_t MAX_CHANNELS = ChannelSet::SLOTS * 3;
+  static const uint16_t PAGE_SIZE = 256;
+  static const uint8_t PENDING = 4;                                       // Full pages waiting for flash (1 KB); more are dropped
+  static const uint8_t BLOCK_HEADER = 6;                                  // Per block: session page of its first record (u32), records (u16),
+                                                                          // then min, max, mean, RMS (int16) of each channel in ChannelSet order; a
+                                                                          // SPARSE channel counts only the records it is in (none: min > max, 0, 0)
+
+  struct PageHeader                                                       // Little-endian, at the start of every summary page
+  {
+    uint8_t level;                                                        // 0xFF only if the page is erased
+    uint8_t channels;
+    uint8_t blocks;                                                       // Blocks in this page, the rest is 0xFF
+    uint8_t reserved;
+    uint32_t firstBlock;                                                  // Index of the first block in its level of the session
+  };
+
+  SummaryLog(SessionLog* logPtr, StorageArray* arrayPtr);
+
+  void start(const ChannelSet& set);                                      // New recording, before any record is taken (the session may already be open)
+  void open(uint16_t firstPage);                                          // Session opened: pages go to flash from summary page firstPage on
+  void add(const SamplePacket& packet, uint32_t page);                    // Storage thread: record placed in session page `page`
+  bool step();                                                            // Storage thread: programs the oldest waiting page if its chip is idle (true - more waiting)
+  void finish();                                                          // Storage thread, blocking: partial blocks and every waiting page go to flash, closes
+  uint16_t pagesWritten() const;                                          // Summary pages of the session in flash, from firstPage on
+  uint32_t dropped() const;                                               // Pages lost to a full buffer or a full summary region
+
+private:
+  struct Acc
+  {
+    int16_t min[MAX_CHANNELS];
+    int16_t max[MAX_CHANNELS];
+    int32_t sum[MAX_CHANNELS];
+    uint64_t squares[MAX_CHANNELS];
+    uint16_t count[MAX_CHANNELS];                                         // Records the channel is in
+    uint32_t page;
+    uint16_t records;
+  };
+
+  SessionLog* _log;
+  StorageArray* _array;
+  uint8_t _channels;
+  uint8_t _offset[MAX_CHANNELS];                                          // Byte offset of each channel in the SamplePacket
+  uint8_t _slot[MAX_CHANNELS];
+  uint8_t _sparse;                                                        // Slots whose channels count only where SamplePacket::present says
+  uint8_t _perPage;                                                       // Blocks that fit in a page
+  Acc _acc[LEVELS];                                                       // Block being summed at each level
+  uint32_t _blocks[LEVELS];                                               // Blocks of each level closed so far
+  uint8_t _fill[LEVELS][PAGE_SIZE];                                       // Page being filled at each level
+  uint8_t _fillBlocks[LEVELS];
+  uint8_t _pending[PENDING][PAGE_SIZE];
+  uint8_t _head;                                                          // Oldest waiting page
+  uint8_t _count;
+  bool _open;
+  uint16_t _next;                                                         // Summary page the oldest waiting page goes to
+  uint16_t _written;
+  uint32_t _dropped;
+
+  uint8_t blockSize() const;
+  static uint32_t blockRecords(uint8_t level);
+  static void clear(Acc& a);
+  void closeBlock(uint8_t level);
+  void closePage(uint8_t level);
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "TextScreen.h"
+
+TextScreen::TextScreen(ACROBOTIC_SSD1306* oledPtr) : _cursorRow(-1), _cursorCol(-1)
+{
+  _oled = oledPtr;
+  memset(_frame, ' ', sizeof(_frame));
+  invalidate();
+}
+
+void TextScreen::mark(uint8_t row, uint8_t col)
+{
+  if (_frame[row][col] != _shown[row][col])
+  {
+    _dirty[row] |= (1U << col);
+  }
+  else
+  {
+    _dirty[row] &= ~(1U << col);
+  }
+}
+
+void TextScreen::clear()
+{
+  for (uint8_t r = 0; r < ROWS; r++)
+  {
+    for (uint8_t c = 0; c < COLS; c++)
+    {
+      _frame[r][c] = ' ';
+      mark(r, c);
+    }
+  }
+}
+
+void TextScreen::print(uint8_t row, uint8_t col, const char* text)
+{
+  if (row >= ROWS)
+  {
+    return;
+  }
+  for (; *text && col < COLS; text++, col++)
+  {
+    _frame[row][col] = *text;
+    mark(row, col);
+  }
+}
+
+void TextScreen::invalidate()
+{
+  memset(_shown, UNKNOWN, sizeof(_shown));
+  for (uint8_t r = 0; r < ROWS; r++)
+  {
+    _dirty[r] = 0xFFFF;
+  }
+  _cursorRow = -1;
+}
+
+bool TextScreen::flush(uint32_t budgetUs)
+{
+  uint32_t t0 = micros();
+  for (uint8_t r = 0; r < ROWS; r++)
+  {
+    while (_dirty[r])
+    {
+      if (micros() - t0 >= budgetUs)                                              // One cell costs ~8 I2C transactions, checked before each
+      {
+        return false;
+      }
+      uint8_t c = 0;
+      while (!((_dirty[r] >> c) & 1))
+      {
+        c++;
+      }
+      if (_cursorRow != r || _cursorCol != c)                                     // Runs of changed cells need one positioning only
+      {
+        _oled->setTextXY(r, c);
+      }
+      _oled->putChar(_frame[r][c]);
+      _shown[r][c] = _frame[r][c];
+      _dirty[r] &= ~(1U << c);
+      _cursorRow = r;
+      _cursorCol = c + 1;
+    }
+  }
+  return true;
+}
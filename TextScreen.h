@@ -0,0 +1,36 @@
+#ifndef TEXT_SCREEN_H
+#define TEXT_SCREEN_H
+
+#include <Arduino.h>
+#include <ACROBOTIC_SSD1306.h>
+
+                                                                          // 16 x 8 character framebuffer in front of the OLED.
+                                                                          // Drawing only changes RAM; flush() sends the cells that differ from
+                                                                          // what the panel shows, a few at a time, so loop() never blocks on I2C.
+class TextScreen
+{
+public:
+  static const uint8_t ROWS = 8;
+  static const uint8_t COLS = 16;
+  static const uint8_t UNKNOWN = 0;                                       // Panel content not known: the cell is always resent
+  static const uint32_t NO_BUDGET = 0xFFFFFFFF;                           // flush() until done (outside recording only)
+
+  TextScreen(ACROBOTIC_SSD1306* oledPtr);
+
+  void clear();                                                           // Blank frame, the panel catches up in flush()
+  void print(uint8_t row, uint8_t col, const char* text);                 // Clipped at the end of the row
+  void invalidate();                                                      // Someone drew on the panel directly: resend everything
+  bool flush(uint32_t budgetUs);                                          // Sends changed cells for about budgetUs (true - panel up to date)
+
+private:
+  ACROBOTIC_SSD1306* _oled;
+  char _frame[ROWS][COLS];                                                // What should be shown
+  char _shown[ROWS][COLS];                                                // What the panel shows
+  uint16_t _dirty[ROWS];                                                  // Bit per cell: _frame != _shown
+  int8_t _cursorRow;                                                      // Panel write position, -1 - unknown
+  int8_t _cursorCol;
+
+  void mark(uint8_t row, uint8_t col);
+};
+
+#endif
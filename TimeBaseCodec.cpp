@@ -0,0 +1,89 @@
+#include "TimeBaseCodec.h"
+
+TimeBaseCodec::TimeBaseCodec() : _page(nullptr), _count(0), _time(0), _timeValid(false)
+{
+}
+
+bool TimeBaseCodec::isOpen() const
+{
+  return _page != nullptr;
+}
+
+uint16_t TimeBaseCodec::count() const
+{
+  return _count;
+}
+
+void TimeBaseCodec::reset()
+{
+  _page = nullptr;
+  _timeValid = false;
+}
+
+void TimeBaseCodec::begin(uint8_t* page)
+{
+  _page = page;
+  memset(_page, 0xFF, PAGE_SIZE);
+  _count = 0;
+}
+
+bool TimeBaseCodec::add(const SamplePacket& packet)
+{
+  uint32_t t;
+  memcpy(&t, packet.bytes + 12, 4);
+  uint32_t delta = _timeValid ? t - (uint32_t)_time : 0;                          // Modulo 2^32: micros() wrapping in between is a normal step
+  if (_count > 0 && (_count >= RECORDS || delta > 0xFFFF))
+  {
+    return false;
+  }
+
+  _time = _timeValid ? _time + delta : t;
+  _timeValid = true;
+  uint8_t* rec = _page + HEADER + _count * RECORD;
+  memcpy(rec, packet.bytes, 12);
+  if (_count == 0)
+  {
+    memcpy(_page + 2, &_time, 8);
+    delta = 0;
+  }
+  rec[12] = delta & 0xFF;
+  rec[13] = delta >> 8;
+  _count++;
+  return true;
+}
+
+void TimeBaseCodec::finish()
+{
+  _page[0] = _count & 0xFF;
+  _page[1] = _count >> 8;
+  _page = nullptr;
+}
+
+uint64_t TimeBaseCodec::baseTime(const uint8_t* page)
+{
+  uint64_t base;
+  memcpy(&base, page + 2, 8);
+  return base;
+}
+
+uint16_t TimeBaseCodec::decode(const uint8_t* page, SamplePacket* out, uint16_t maxPackets)
+{
+  uint16_t count = page[0] | (page[1] << 8);
+  if (count == 0 || count > RECORDS)                                              // Erased or not a time-base page
+  {
+    return 0;
+  }
+  if (count > maxPackets)
+  {
+    count = maxPackets;
+  }
+  uint32_t t = (uint32_t)baseTime(page);
+  for (uint16_t i = 0; i < count; i++)
+  {
+    const uint8_t* rec = page + HEADER + i * RECORD;
+    t += rec[12] | (rec[13] << 8);
+    memcpy(out[i].bytes, rec, 12);
+    memcpy(out[i].bytes + 12, &t, 4);
+  }
+  return count;
+}
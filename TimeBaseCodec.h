@@ -0,0 +1,39 @@
+#ifndef TIME_BASE_CODEC_H
+#define TIME_BASE_CODEC_H
+
+#include <Arduino.h>
+#include "IMUHandler.h"
+
+                                                                          // Time-base page: [count u16][base time u64][count x (6 x int16 axes, delta u16)]
+                                                                          // base is the time of the first record in us, 64 bits so it never wraps: the
+                                                                          // 32-bit record times are extended from the start of the session. Each delta
+                                                                          // is the time since the previous record (0 for the first). 17 records per page
+                                                                          // instead of 16; a gap longer than 65.5 ms starts a new page with a new base.
+class TimeBaseCodec
+{
+public:
+  static const uint16_t PAGE_SIZE = 256;
+  static const uint16_t HEADER = 2 + 8;
+  static const uint16_t RECORD = 12 + 2;
+  static const uint16_t RECORDS = (PAGE_SIZE - HEADER) / RECORD;
+
+  TimeBaseCodec();
+
+  void begin(uint8_t* page);                                              // Starts a new page in the buffer
+  bool add(const SamplePacket& packet);                                   // false - page full or gap too long, finish() and start a new page
+  void finish();                                                          // Writes the header, the rest stays 0xFF
+  void reset();                                                           // Drops an unfinished page, the next record restarts the time line
+  bool isOpen() const;
+  uint16_t count() const;
+
+  static uint16_t decode(const uint8_t* page, SamplePacket* out, uint16_t maxPackets);   // Times are the low 32 bits, like the raw records
+  static uint64_t baseTime(const uint8_t* page);
+
+private:
+  uint8_t* _page;
+  uint16_t _count;
+  uint64_t _time;                                                         // Time of the last record added, extended to 64 bits
+  bool _timeValid;
+};
+
+#endif
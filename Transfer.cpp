@@ -0,0 +1,625 @@
+#include "Transfer.h"
+
+#define FLAG_LOAD   0x01
+#define FLAG_LOADED 0x02
+
+static uint32_t zigzag(int32_t v)
+{
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static uint16_t putVarint(uint8_t* out, uint16_t n, uint32_t v)
+{
+  while (v >= 0x80)
+  {
+    out[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  out[n++] = (uint8_t)v;
+  return n;
+}
+
+Transfer::Transfer(SessionLog* logPtr, Stream* portPtr) : _state(IDLE), _session(0), _next(0), _found(0), _lastActivity(0), _crc(0),
+  _startMillis(0), _bytesOut(0), _reader(osPriorityAboveNormal, 1024), _readerStarted(false), _loading(-1)
+{
+  _log = logPtr;
+  _port = portPtr;
+  _bufChunk[0] = _bufChunk[1] = -1;
+  memset(&_entry, 0, sizeof(_entry));
+  memset(&_job, 0, sizeof(_job));
+  _job.command = GET;
+}
+
+void Transfer::begin()
+{
+  if (!_readerStarted)                                                            // Not from the constructor: the kernel isn't running yet
+  {
+    _reader.start(mbed::callback(this, &Transfer::readerTask));
+    _readerStarted = true;
+  }
+  _log->load();
+  memset(&_entry, 0, sizeof(_entry));
+  _job.command = GET;
+  _next = 0;
+  _requests.reset();
+  sendDirectory();
+  _state = WAIT_COMMAND;
+  _lastActivity = millis();
+}
+
+void Transfer::cancel()
+{
+  _state = IDLE;
+}
+
+void Transfer::beginLive(uint16_t index)
+{
+  _log->read(index, _entry);
+  _session = index;
+  _job.command = GET;
+  waitReader();
+  _bufChunk[0] = _bufChunk[1] = -1;                                               // Chunks of an earlier download are not this session's
+  _live.reset();
+  _startMillis = millis();
+  _bytesOut = 0;
+  _state = LIVE;
+  sendFrameBySeq(0);
+  _next = 1;
+}
+
+bool Transfer::offerLive(uint32_t page, const uint8_t* data)
+{
+  _livePage.index = page;
+  memcpy(_livePage.data, data, PAGE_SIZE);
+  return _live.push(_livePage);
+}
+
+void Transfer::endLive()
+{
+  LivePage page;
+  while (_live.pop(page))
+  {
+    sendPage(page.index + 1, page.data);
+  }
+  _log->read(_session, _entry);                                                   // Closed: the page count is known now
+  _next = frameCount();
+  sendFrameBySeq(_next - 1);
+  _state = LINGER;
+  _lastActivity = millis();
+}
+
+void Transfer::startNext()
+{
+  Request req;
+  if (!_requests.pop(req))
+  {
+    return;
+  }
+  waitReader();                                                                   // SPI belongs to the reader while it loads a chunk
+  SessionLog::Entry entry;
+  if (req.command != READ && !_log->read(req.session, entry))
+  {
+    sendDirectory();                                                              // Unknown index: show the host what exists
+    return;
+  }
+  if (req.command == OVERVIEW)                                                    // Still recording or recorded without summaries: none to look through
+  {
+    bool closed = entry.summaryPage != SessionLog::NO_SUMMARY && entry.summaryPages != 0xFFFF;
+    req.first = entry.summaryPage;
+    req.count = closed ? entry.summaryPages : 0;
+  }
+  if (req.command == GET)
+  {
+    _entry = entry;
+  }
+  _job = req;
+  _bufChunk[0] = _bufChunk[1] = -1;
+  _startMillis = millis();
+  _bytesOut = 0;
+  _state = SENDING;
+  if (req.command == OVERVIEW)
+  {
+    _next = 0;
+    _found = 0;
+    return;
+  }
+  if (req.command == READ)
+  {
+    _next = 0;
+    requestChunk(0);
+    return;
+  }
+  _session = req.session;
+  _next = min(req.first, frameCount() - 1);
+  requestChunk((_next > 1) ? (_next - 1) / chunkPages() : 0);
+  if (_next > 0)                                                                  // RESUME: the HEADER first, the host may have lost it
+  {
+    sendFrameBySeq(0);
+  }
+}
+
+void Transfer::finishJob()
+{
+  _state = LINGER;                                                                // NAKs, ACK or the next request
+  _lastActivity = millis();
+}
+
+uint32_t Transfer::frameCount() const
+{
+  return sessionPages() + 2;
+}
+
+uint32_t Transfer::sessionPages() const
+{
+  return _entry.endPage - _entry.startPage;
+}
+
+uint32_t Transfer::jobPages() const
+{
+  return (_job.command == GET) ? sessionPages() : _job.count;
+}
+
+uint8_t Transfer::stripe() const
+{
+  return (_job.command == READ) ? 1 : _log->chips();                             // A READ is one chip's consecutive pages
+}
+
+uint8_t Transfer::chunkPages() const
+{
+  return CHUNK_PAGES / stripe() * stripe();
+}
+
+void Transfer::jobPage(uint32_t index, uint8_t& chip, uint32_t& page) const
+{
+  if (_job.command == READ)
+  {
+    chip = _job.chip;
+    page = _job.first + index;
+    return;
+  }
+  _log->locate(_entry.startPage + index, chip, page);
+}
+
+uint32_t Transfer::getPages() const
+{
+  return jobPages();
+}
+
+uint32_t Transfer::getSent() const
+{
+  if (_job.command != GET)
+  {
+    return _next;
+  }
+  return (_next > 1) ? min(_next - 1, sessionPages()) : 0;
+}
+
+bool Transfer::step()
+{
+  if (_state == IDLE)
+  {
+    return false;
+  }
+
+  if (_state == LIVE)                                                             // Host requests wait for END: a NAK now would race the live pages
+  {
+    LivePage page;
+    if (_live.pop(page))
+    {
+      sendPage(page.index + 1, page.data);
+      _next = page.index + 2;
+    }
+    return true;
+  }
+
+  serveRequests();
+  if (_state == WAIT_COMMAND || _state == LINGER)
+  {
+    startNext();
+  }
+
+  if (_state == SENDING && _job.command == READ)
+  {
+    sendBlock();
+    if (_next >= _job.count)
+    {
+      finishJob();
+    }
+  }
+  else if (_state == SENDING && _job.command == OVERVIEW)
+  {
+    sendSummary();
+  }
+  else if (_state == SENDING)
+  {
+    sendFrameBySeq(_next++, true);
+    if (_next >= frameCount())
+    {
+      finishJob();
+    }
+  }
+  else if (_state == LINGER && millis() - _lastActivity > LINGER_MS)             // Host went quiet without ACK
+  {
+    _state = IDLE;
+  }
+  return _state != IDLE;
+}
+
+void Transfer::serveRequests()
+{
+  while (_port->available() > 0)
+  {
+    uint8_t cmd = _port->peek();
+    uint8_t need = (cmd == READ) ? 8 : (cmd == RESUME) ? 7 : (cmd == NAK) ? 5 : (cmd == OVERVIEW) ? 4 : (cmd == GET || cmd == STAT) ? 3 : 1;
+    if (_port->available() < need)                                                // Wait for the whole request
+    {
+      return;
+    }
+    _port->read();
+    _lastActivity = millis();
+    if (cmd == ACK)
+    {
+      _state = IDLE;
+      return;
+    }
+    else if (cmd == LIST)
+    {
+      sendDirectory();
+    }
+    else if (cmd == GET || cmd == RESUME)
+    {
+      Request req = {GET, 0, 0, 0, 0};
+      req.session = _port->read();
+      req.session |= _port->read() << 8;
+      for (uint8_t i = 0; cmd == RESUME && i < 4; i++)
+      {
+        req.first |= (uint32_t)_port->read() << (8 * i);
+      }
+      _requests.push(req);                                                        // Full: dropped, the host asks again
+    }
+    else if (cmd == OVERVIEW)
+    {
+      Request req = {OVERVIEW, 0, 0, 0, 0};
+      req.session = _port->read();
+      req.session |= _port->read() << 8;
+      req.chip = _port->read();
+      _requests.push(req);
+    }
+    else if (cmd == READ)
+    {
+      Request req = {READ, 0, 0, 0, 0};
+      req.chip = _port->read();
+      for (uint8_t i = 0; i < 4; i++)
+      {
+        req.first |= (uint32_t)_port->read() << (8 * i);
+      }
+      req.count = _port->read();
+      req.count |= _port->read() << 8;
+      if (req.chip < _log->chips() && req.first < Storage::PAGE_COUNT && req.count > 0)
+      {
+        req.count = min(req.count, Storage::PAGE_COUNT - req.first);
+        _requests.push(req);
+      }
+    }
+    else if (cmd == STAT)
+    {
+      uint16_t index = _port->read();
+      index |= _port->read() << 8;
+      sendStats(index);
+    }
+    else if (cmd == NAK)
+    {
+      uint32_t seq = 0;
+      for (uint8_t i = 0; i < 4; i++)
+      {
+        seq |= (uint32_t)_port->read() << (8 * i);
+      }
+      if (seq == DIR_SEQ)
+      {
+        sendDirectory();
+      }
+      else if (_entry.magic == SessionLog::MAGIC && seq < frameCount())           // Frames of the session selected last
+      {
+        sendFrameBySeq(seq);
+      }
+    }                                                                             // Anything else is line noise
+  }
+}
+
+void Transfer::sendDirectory()
+{
+  uint16_t count = _log->count();
+  beginFrame(DIRECTORY, DIR_SEQ, 2 + count * SessionLog::ENTRY_SIZE);
+  framePart((const uint8_t*)&count, 2);
+  SessionLog::Entry entry;
+  for (uint16_t i = 0; i < count; i++)
+  {
+    _log->read(i, entry);
+    framePart((const uint8_t*)&entry, SessionLog::ENTRY_SIZE);
+  }
+  endFrame();
+}
+
+void Transfer::sendStats(uint16_t index)
+{
+  waitReader();                                                                   // SPI belongs to the reader while it loads a chunk
+  bool saved = _log->readStats(index, _page);
+  beginFrame(STATS, DIR_SEQ, 2 + (saved ? PAGE_SIZE : 0));
+  framePart((const uint8_t*)&index, 2);
+  if (saved)
+  {
+    framePart(_page, PAGE_SIZE);
+  }
+  endFrame();
+}
+
+void Transfer::sendFrameBySeq(uint32_t seq, bool sequential)                     // Frames are rebuilt from flash, so any of them can be re-sent
+{
+  if (seq == 0)
+  {
+    uint8_t* p = _payload;
+    p[0] = 'S'; p[1] = 'R'; p[2] = 'D';
+    p[3] = VERSION;
+    memcpy(p + 4, &_session, 2);
+    uint32_t frames = (_state == LIVE) ? 0 : frameCount();                        // Live: not known until END
+    memcpy(p + 6, &frames, 4);
+    memcpy(p + 10, &_entry, SessionLog::ENTRY_SIZE);
+    sendFrame(HEADER, seq, p, 10 + SessionLog::ENTRY_SIZE);
+    return;
+  }
+  if (seq == frameCount() - 1)
+  {
+    uint32_t stats[3] = { (uint32_t)(millis() - _startMillis), _bytesOut, sessionPages() * PAGE_SIZE };
+    sendFrame(END, seq, (const uint8_t*)stats, sizeof(stats));
+    return;
+  }
+
+  sendPage(seq, fetchPage(seq - 1, sequential));
+}
+
+void Transfer::sendPage(uint32_t seq, const uint8_t* data)
+{
+  uint8_t chip;                                                                   // Recording order of the session
+  uint32_t page;
+  _log->locate(_entry.startPage + seq - 1, chip, page);
+
+  _payload[0] = chip;
+  _payload[1] = page & 0xFF;
+  _payload[2] = page >> 8;
+  uint16_t len = (_entry.schema == SessionLog::SCHEMA_PAIR16) ? encodePage(data, _payload + 4, PAGE_SIZE) : 0;   // Packed pages are sent as stored
+  if (len > 0)
+  {
+    _payload[3] = DELTA_RLE;
+  }
+  else
+  {
+    _payload[3] = RAW;
+    memcpy(_payload + 4, data, PAGE_SIZE);
+    len = PAGE_SIZE;
+  }
+  sendFrame(PAGE, seq, _payload, len + 4);
+}
+
+void Transfer::sendBlock()
+{
+  const uint8_t* data = fetchPage(_next, true);
+  uint32_t page = _job.first + _next++;
+  _payload[0] = _job.chip;
+  _payload[1] = page & 0xFF;
+  _payload[2] = page >> 8;
+  _payload[3] = RAW;                                                              // Any page, the session's schema is not known here
+  memcpy(_payload + 4, data, PAGE_SIZE);
+  sendFrame(BLOCK, page, _payload, PAGE_SIZE + 4);
+}
+
+void Transfer::sendSummary()
+{
+  if (_next >= _job.count)                                                        // Done: how many the host should have
+  {
+    uint8_t done[6];
+    memcpy(done, &_job.session, 2);
+    memcpy(done + 2, &_found, 4);
+    sendFrame(SUMMARY, _next, done, sizeof(done));
+    finishJob();
+    return;
+  }
+  uint8_t chip;
+  uint32_t page;
+  _log->locateSummary(_job.first + _next, chip, page);
+  _log->chip(chip)->readPage(page, _page);
+  SummaryLog::PageHeader h;
+  memcpy(&h, _page, sizeof(h));
+  if (h.level == _job.chip)                                                       // Levels are interleaved in the order their pages filled up
+  {
+    uint16_t len = sizeof(h) + h.blocks * (SummaryLog::BLOCK_HEADER + h.channels * 8);
+    len = (len < PAGE_SIZE) ? len : PAGE_SIZE;
+    beginFrame(SUMMARY, _next, 2 + len);
+    framePart((const uint8_t*)&_job.session, 2);
+    framePart(_page, len);
+    endFrame();
+    _found++;
+  }
+  _next++;
+}
+
+const uint8_t* Transfer::fetchPage(uint32_t index, bool sequential)
+{
+  uint8_t n = stripe();
+  int32_t chunk = index / chunkPages();
+  uint8_t b = chunk & 1;
+  if (!sequential && (_job.command != GET || _bufChunk[b] != chunk))             // Re-sent page: read it directly, keep the pipeline as it is
+  {
+    waitReader();
+    uint8_t chip;
+    uint32_t page;
+    _log->locate(_entry.startPage + index, chip, page);
+    _log->chip(chip)->readPage(page, _page);
+    return _page;
+  }
+  if (_bufChunk[b] != chunk)
+  {
+    if (_loading != chunk)
+    {
+      requestChunk(chunk);
+    }
+    waitReader();
+  }
+  if (sequential && _bufChunk[(chunk + 1) & 1] != chunk + 1 && _loading != chunk + 1)   // Start reading the next chunk while this one is sent
+  {
+    requestChunk(chunk + 1);
+  }
+  uint32_t i = index % chunkPages();                                              // Chunk starts are whole stripes: page i is on chip i % n
+  return _chunks[b] + (i % n) * (CHUNK_PAGES / n) * PAGE_SIZE + (i / n) * PAGE_SIZE;
+}
+
+void Transfer::requestChunk(int32_t chunk)
+{
+  if ((uint32_t)chunk * chunkPages() >= jobPages() || _bufChunk[chunk & 1] == chunk)
+  {
+    return;
+  }
+  waitReader();                                                                   // One read in flight; SPI belongs to the reader until it is done
+  _bufChunk[chunk & 1] = -1;
+  _loading = chunk;
+  _flags.set(FLAG_LOAD);
+}
+
+void Transfer::waitReader()
+{
+  while (_loading >= 0)
+  {
+    _flags.wait_any(FLAG_LOADED);
+  }
+}
+
+void Transfer::readerTask()
+{
+  while (true)
+  {
+    _flags.wait_any(FLAG_LOAD);
+    int32_t chunk = _loading;
+    uint8_t* buf = _chunks[chunk & 1];
+    uint8_t chips = stripe();
+    uint32_t first = chunk * chunkPages();
+    uint32_t count = min((uint32_t)chunkPages(), jobPages() - first);
+    for (uint8_t c = 0; c < chips; c++)                                           // Session and chunk starts are whole stripes: chip 0 pages first
+    {
+      uint16_t n = (count + chips - 1 - c) / chips;
+      if (n == 0)
+      {
+        continue;
+      }
+      uint8_t chip;
+      uint32_t page;
+      jobPage(first + c, chip, page);
+      _log->chip(chip)->readPages(page, buf + c * (CHUNK_PAGES / chips) * PAGE_SIZE, n);
+    }
+    _bufChunk[chunk & 1] = chunk;
+    _loading = -1;
+    _flags.set(FLAG_LOADED);
+  }
+}
+
+void Transfer::sendFrame(uint8_t type, uint32_t seq, const uint8_t* payload, uint16_t len)
+{
+  beginFrame(type, seq, len);
+  framePart(payload, len);
+  endFrame();
+}
+
+void Transfer::beginFrame(uint8_t type, uint32_t seq, uint16_t len)
+{
+  uint8_t head[8];
+  head[0] = SYNC;
+  head[1] = type;
+  memcpy(head + 2, &seq, 4);
+  memcpy(head + 6, &len, 2);
+  _crc = crc16(head + 1, 7);
+  _port->write(head, 8);
+  _bytesOut += 10 + len;
+}
+
+void Transfer::framePart(const uint8_t* data, uint16_t len)
+{
+  _crc = crc16(data, len, _crc);
+  _port->write(data, len);
+}
+
+void Transfer::endFrame()
+{
+  _port->write((const uint8_t*)&_crc, 2);
+}
+
+uint16_t Transfer::crc16(const uint8_t* data, uint16_t len, uint16_t crc)
+{
+  for (uint16_t i = 0; i < len; i++)
+  {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t b = 0; b < 8; b++)
+    {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+uint16_t Transfer::encodePage(const uint8_t* page, uint8_t* out, uint16_t maxLen)
+{
+                                                                                  // Column-major over 16 packets: 6 axes as deltas, time as delta-of-delta
+                                                                                  // Non-zero values are zigzag varints, zero runs are 0x00 + varint(run - 1)
+  uint16_t n = 0;
+  uint16_t zeros = 0;
+  for (uint8_t col = 0; col < 7; col++)
+  {
+    int32_t prev = 0;
+    uint32_t prevTime = 0, prevDelta = 0;
+    for (uint8_t p = 0; p < PAGE_SIZE / 16; p++)
+    {
+      const uint8_t* pkt = page + p * 16;
+      uint32_t zz;
+      if (col < 6)
+      {
+        int16_t v;
+        memcpy(&v, pkt + col * 2, 2);
+        zz = zigzag((int32_t)v - prev);
+        prev = v;
+      }
+      else
+      {
+        uint32_t t;
+        memcpy(&t, pkt + 12, 4);
+        uint32_t delta = t - prevTime;
+        zz = zigzag((int32_t)(delta - prevDelta));
+        prevTime = t;
+        prevDelta = delta;
+      }
+
+      if (zz == 0)
+      {
+        zeros++;
+        continue;
+      }
+      if (n + 10 > maxLen)                                                        // Run + varint could not fit: send the page raw
+      {
+        return 0;
+      }
+      if (zeros > 0)
+      {
+        out[n++] = 0;
+        n = putVarint(out, n, zeros - 1);
+        zeros = 0;
+      }
+      n = putVarint(out, n, zz);
+    }
+  }
+  if (zeros > 0)
+  {
+    if (n + 4 > maxLen)
+    {
+      return 0;
+    }
+    out[n++] = 0;
+    n = putVarint(out, n, zeros - 1);
+  }
+  return (n < maxLen) ? n : 0;
+}
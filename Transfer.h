@@ -0,0 +1,139 @@
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include <Arduino.h>
+#include <mbed.h>
+#include "Storage.h"
+#include "SessionLog.h"
+#include "SummaryLog.h"
+#include "SampleQueue.h"
+
+                                                                          // Framed download: [0xA5][type][seq u32][len u16][payload][crc16]
+                                                                          // CRC-16/CCITT over type..payload, all fields little-endian
+                                                                          // Live (STREAM): the same frames while recording, HEADER with frames = 0,
+                                                                          // PAGE frames as pages reach flash, END once the session is closed
+                                                                          // GET, RESUME, READ and OVERVIEW are queued and served in order, so a host can keep
+                                                                          // several outstanding and the link never waits for a round trip
+class Transfer
+{
+public:
+  enum FrameType
+  {
+    HEADER    = 0x01,                                                     // "SRD" version session(u16) frames(u32) + session entry (32)
+    PAGE      = 0x02,                                                     // chip page(u16) encoding data
+    END       = 0x03,                                                     // elapsed ms(u32) bytes sent(u32) bytes read from flash(u32)
+    DIRECTORY = 0x04,                                                     // count(u16) + session entries (32 each), seq = DIR_SEQ
+    STATS     = 0x05,                                                     // session(u16) + RunStats::Record (256, none if not saved), seq = DIR_SEQ
+    BLOCK     = 0x06,                                                     // Answer to READ: chip page(u16) RAW data, seq = physical page
+    SUMMARY   = 0x07                                                      // Answer to OVERVIEW: session(u16) + used part of a summary page (SummaryLog),
+                                                                          // seq = page of the session's summaries; last: session(u16) frames sent(u32)
+  };
+  enum Encoding
+  {
+    RAW       = 0,                                                        // 256 bytes as stored
+    DELTA_RLE = 1                                                         // Column deltas, zigzag varints, zero runs
+  };
+  static const uint8_t SYNC = 0xA5;
+  static const uint8_t NAK = 'N';                                         // Host -> device: 'N' seq(u32), re-send that frame
+  static const uint8_t ACK = 'A';                                         // Host -> device: everything received
+  static const uint8_t LIST = 'L';                                        // Host -> device: re-send the directory
+  static const uint8_t GET = 'G';                                         // Host -> device: 'G' index(u16), send that session
+  static const uint8_t STAT = 'S';                                        // Host -> device: 'S' index(u16), send the run statistics of that session
+  static const uint8_t RESUME = 'C';                                      // Host -> device: 'C' index(u16) seq(u32), send that session from frame seq on (HEADER first)
+  static const uint8_t READ = 'R';                                        // Host -> device: 'R' chip(u8) page(u32) count(u16), send those physical pages
+  static const uint8_t OVERVIEW = 'O';                                    // Host -> device: 'O' index(u16) level(u8), send that session's summary pages of level
+  static const uint8_t VERSION = 2;
+  static const uint32_t DIR_SEQ = 0xFFFFFFFF;
+  static const uint16_t PAGE_SIZE = 256;
+  static const uint16_t LINGER_MS = 3000;                                 // Time to wait for NAKs after END
+  static const uint8_t CHUNK_PAGES = 16;                                  // Read-ahead buffer: consecutive pages from each chip, a whole stripe count
+  static const uint8_t LIVE_PAGES = 8;                                    // Pages waiting for USB while streaming (2 KB); more and they stay in flash only
+  static const uint8_t REQUESTS = 8;                                      // Queued GET/RESUME/READ/OVERVIEW; one more is dropped, the host re-sends it
+
+  Transfer(SessionLog* logPtr, Stream* portPtr);
+
+  void begin();                                                           // Sends the directory and waits for the host to pick a session
+  bool step();                                                            // Takes host requests, then sends the next frame (false - ACK or LINGER_MS quiet)
+  void cancel();
+
+  void beginLive(uint16_t index);                                         // Open session index: sends the HEADER, pages follow from offerLive()
+  bool offerLive(uint32_t page, const uint8_t* data);                     // Storage thread, page just written (false - link behind, the host NAKs it later)
+  void endLive();                                                         // Session closed: sends what is queued and END, then serves NAKs from flash
+
+  uint32_t getSent() const;                                               // Pages of the request being served sent so far
+  uint32_t getPages() const;                                              // Pages of the request being served
+
+  static uint16_t crc16(const uint8_t* data, uint16_t len, uint16_t crc = 0xFFFF);
+  static uint16_t encodePage(const uint8_t* page, uint8_t* out, uint16_t maxLen);  // Returns 0 if the page does not get smaller
+
+private:
+  enum State
+  {
+    IDLE, WAIT_COMMAND, SENDING, LIVE, LINGER
+  };
+  struct Request
+  {
+    uint8_t command;                                                      // GET (also for RESUME), READ or OVERVIEW
+    uint8_t chip;                                                         // READ: chip, OVERVIEW: level
+    uint16_t session;                                                     // GET, OVERVIEW
+    uint32_t first;                                                       // GET: first frame after the HEADER, READ: first physical page, OVERVIEW: first summary page
+    uint32_t count;                                                       // READ: pages, OVERVIEW: summary pages to look through
+  };
+  struct LivePage
+  {
+    uint32_t index;                                                       // Page of the session
+    uint8_t data[PAGE_SIZE];
+  };
+
+  SessionLog* _log;
+  Stream* _port;
+  State _state;
+  uint16_t _session;
+  SessionLog::Entry _entry;                                               // Selected session, NAKs refer to it
+  Request _job;                                                           // Being served
+  uint32_t _next;                                                         // GET: next frame sequence number to send, READ/OVERVIEW: next page of the range
+  uint32_t _found;                                                        // OVERVIEW: summary frames sent
+  uint32_t _lastActivity;
+  uint16_t _crc;                                                          // Running CRC of the frame being sent
+  uint8_t _page[PAGE_SIZE];
+  uint8_t _payload[PAGE_SIZE + 4];
+  uint32_t _startMillis;
+  uint32_t _bytesOut;
+                                                                          // Read-ahead: the reader thread fills one buffer from flash
+                                                                          // while the other one is encoded and drained to USB
+  rtos::Thread _reader;
+  rtos::EventFlags _flags;
+  bool _readerStarted;
+  uint8_t _chunks[2][CHUNK_PAGES * PAGE_SIZE];                            // Chunk k lives in buffer k & 1: [chip 0 pages][chip 1 pages]...
+  volatile int32_t _bufChunk[2];                                          // Chunk held by each buffer (-1 - none)
+  volatile int32_t _loading;                                              // Chunk being read (-1 - reader idle)
+  SampleQueue<LivePage, LIVE_PAGES> _live;                                // Producer: storage thread, consumer: step() in loop()
+  LivePage _livePage;                                                     // Built by offerLive(), storage thread only
+  SampleQueue<Request, REQUESTS> _requests;                               // Both sides in loop(): serveRequests() and step()
+
+  uint32_t frameCount() const;                                            // HEADER + pages + END
+  uint32_t sessionPages() const;
+  uint32_t jobPages() const;                                              // Pages _job reads from flash
+  uint8_t stripe() const;                                                 // Chips a chunk of _job is spread over
+  uint8_t chunkPages() const;                                             // Pages per chunk: CHUNK_PAGES rounded down to a multiple of stripe()
+  void jobPage(uint32_t index, uint8_t& chip, uint32_t& page) const;      // Where page index of _job is stored
+  void startNext();                                                       // Takes the next queued request (none - state unchanged)
+  void finishJob();
+  void sendDirectory();
+  void sendStats(uint16_t index);
+  void sendFrameBySeq(uint32_t seq, bool sequential = false);
+  void sendPage(uint32_t seq, const uint8_t* data);
+  void sendBlock();                                                       // Next page of a READ
+  void sendSummary();                                                     // Next page of an OVERVIEW, if it has the level asked for
+  void sendFrame(uint8_t type, uint32_t seq, const uint8_t* payload, uint16_t len);
+  void beginFrame(uint8_t type, uint32_t seq, uint16_t len);              // A frame may be sent in parts: begin, part..., end
+  void framePart(const uint8_t* data, uint16_t len);
+  void endFrame();
+  void serveRequests();
+  void readerTask();
+  void requestChunk(int32_t chunk);
+  void waitReader();
+  const uint8_t* fetchPage(uint32_t index, bool sequential);             // Page of the session, from the read-ahead buffers if possible
+};
+
+#endif
@@ -0,0 +1,214 @@
+#include "TwimSampler.h"
+
+TwimSampler* TwimSampler::_active = nullptr;
+
+TwimSampler::TwimSampler() : _reg(0), _addr(0), _frameBytes(MAX_FRAME), _periodTicks(0), _startUs(0), _errors(0), _logged(0), _lostFrom(0),
+  _lostTo(0), _polled(0), _done(0)
+{
+  memset(_ring, 0, sizeof(_ring));
+  memset(_failed, 0, sizeof(_failed));
+}
+
+uint32_t TwimSampler::errors() const
+{
+  return _errors;
+}
+
+static bool sameLap(uint32_t a, uint32_t b)
+{
+  return ((a ^ b) & ~(uint32_t)(TwimSampler::RING - 1)) == 0;
+}
+
+void TwimSampler::lose(uint32_t from, uint32_t last)
+{
+  if ((int32_t)(from - _lostTo) > 0 || (int32_t)(from - _lostFrom) < 0)
+  {
+    _lostFrom = from;                                                             // Else it joins the range still open
+  }
+  _lostTo = (last | (RING - 1)) + 1;
+}
+
+void TwimSampler::logFailures(uint32_t count, uint32_t last)
+{
+  if (count > 1)
+  {
+    lose(_polled, last);                                                          // Only the newest was captured, the others are after the last call
+  }
+  uint32_t& entry = _failed[_logged & (FAIL_LOG - 1)];
+  if (_logged >= FAIL_LOG && sameLap(entry, last))
+  {
+    lose(entry + 1, last);                                                        // The reads after the one forgotten can't be placed any more
+  }
+  entry = last;
+  _logged++;
+  _errors += count;
+}
+
+bool TwimSampler::failed(uint32_t n) const
+{
+  if ((int32_t)(n - _lostFrom) >= 0 && (int32_t)(n - _lostTo) < 0)
+  {
+    return true;
+  }
+  for (uint32_t i = 0; i < _logged && i < FAIL_LOG; i++)
+  {
+    if (_failed[i] == n) return true;
+  }
+  return false;
+}
+
+const uint8_t* TwimSampler::frame(uint32_t n) const
+{
+  uint32_t slot = n;
+  for (uint32_t i = 0; i < _logged && i < FAIL_LOG; i++)
+  {
+    uint32_t f = _failed[i];
+    if ((int32_t)(n - f) > 0 && sameLap(n, f)) slot--;                           // Failed earlier in the same lap: the DMA pointer stayed behind
+  }
+  return _ring + (slot & (RING - 1)) * _frameBytes;
+}
+
+uint32_t TwimSampler::frameTime(uint32_t n) const
+{
+  return _startUs + (uint32_t)((uint64_t)(n + 1) * _periodTicks / 16);           // Wraps like micros()
+}
+
+#if defined(NRF52840_XXAA)                                                        // The host simulation has its own start()/stop()/completed() (host/sim)
+
+#define IMU_TWIM NRF_TWIM1                                                        // Instance behind Wire1, the on-board sensor bus
+#define READ_TIMER NRF_TIMER3                                                     // Starts the reads
+#define COUNT_TIMER NRF_TIMER4                                                    // Counts the finished reads
+#define TRIGGER_PPI_CH 8                                                          // Fixed PPI channels after the coil's: TIMER3 COMPARE0 -> STARTTX,
+#define COUNT_PPI_CH 9                                                            // STOPPED -> TIMER4 COUNT,
+#define ERROR_TIMER NRF_TIMER2                                                    // Counts the failed reads
+#define ERROR_PPI_CH 10                                                           // ERROR -> STOP (a NACKed read still ends and is counted), fork: the
+                                                                                  // read count into TIMER4 CC[2], the index of the failed read,
+#define ERROR_COUNT_PPI_CH 11                                                     // ERROR -> TIMER2 COUNT
+#define STOP_WAIT_US 2000                                                         // Longest read: address, register and 12 bytes at 100 kHz
+
+static uint32_t savedEnable;
+static uint32_t savedShorts;
+static uint32_t savedInten;
+
+void TwimSampler::irq()
+{
+  COUNT_TIMER->EVENTS_COMPARE[0] = 0;
+  COUNT_TIMER->CC[0] += RING;
+  IMU_TWIM->RXD.PTR = (uint32_t)_active->_ring;                                   // The last read of the lap has STOPPED, the next one is up to a period away
+}
+
+bool TwimSampler::start(uint8_t addr, uint8_t reg, uint8_t frameBytes, uint32_t rate)
+{
+  if (frameBytes == 0 || frameBytes > MAX_FRAME || rate == 0)
+  {
+    return false;
+  }
+  _addr = addr;
+  _reg = reg;
+  _frameBytes = frameBytes;
+  _periodTicks = 16000000UL / rate;
+  _errors = 0;
+  _logged = 0;
+  _lostFrom = 0;
+  _lostTo = 0;
+  _polled = 0;
+  _active = this;
+
+  savedEnable = IMU_TWIM->ENABLE;                                                 // Wire1 may drive the instance as a legacy TWI
+  savedShorts = IMU_TWIM->SHORTS;
+  savedInten = IMU_TWIM->INTEN;
+  IMU_TWIM->ENABLE = TWIM_ENABLE_ENABLE_Disabled << TWIM_ENABLE_ENABLE_Pos;
+  IMU_TWIM->INTENCLR = 0xFFFFFFFF;                                                // Nothing for the Wire1 driver to handle meanwhile
+  IMU_TWIM->ADDRESS = addr;                                                       // Pins and FREQUENCY stay as Wire1 set them
+  IMU_TWIM->TXD.PTR = (uint32_t)&_reg;
+  IMU_TWIM->TXD.MAXCNT = 1;
+  IMU_TWIM->TXD.LIST = TWIM_TXD_LIST_LIST_Disabled;                               // The same register address ahead of every read
+  IMU_TWIM->RXD.PTR = (uint32_t)_ring;
+  IMU_TWIM->RXD.MAXCNT = frameBytes;
+  IMU_TWIM->RXD.LIST = TWIM_RXD_LIST_LIST_ArrayList;                              // PTR moves on by MAXCNT after every read
+  IMU_TWIM->SHORTS = TWIM_SHORTS_LASTTX_STARTRX_Msk | TWIM_SHORTS_LASTRX_STOP_Msk;
+  IMU_TWIM->EVENTS_ERROR = 0;
+  IMU_TWIM->ERRORSRC = IMU_TWIM->ERRORSRC;                                        // Write 1 to clear
+  IMU_TWIM->EVENTS_STOPPED = 0;
+  IMU_TWIM->ENABLE = TWIM_ENABLE_ENABLE_Enabled << TWIM_ENABLE_ENABLE_Pos;
+
+  COUNT_TIMER->TASKS_STOP = 1;
+  COUNT_TIMER->MODE = TIMER_MODE_MODE_LowPowerCounter;
+  COUNT_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+  COUNT_TIMER->TASKS_CLEAR = 1;
+  COUNT_TIMER->CC[0] = RING;                                                      // Free-running count, the compare moves on by a lap each time
+  COUNT_TIMER->EVENTS_COMPARE[0] = 0;
+  COUNT_TIMER->INTENSET = TIMER_INTENSET_COMPARE0_Msk;
+  NVIC_SetVector(TIMER4_IRQn, (uint32_t)&TwimSampler::irq);
+  NVIC_SetPriority(TIMER4_IRQn, 2);                                               // Ahead of the SAADC: it has to land between two reads
+  NVIC_ClearPendingIRQ(TIMER4_IRQn);
+  NVIC_EnableIRQ(TIMER4_IRQn);
+  COUNT_TIMER->TASKS_START = 1;
+
+  ERROR_TIMER->TASKS_STOP = 1;
+  ERROR_TIMER->MODE = TIMER_MODE_MODE_LowPowerCounter;
+  ERROR_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+  ERROR_TIMER->TASKS_CLEAR = 1;
+  ERROR_TIMER->TASKS_START = 1;
+
+  READ_TIMER->TASKS_STOP = 1;
+  READ_TIMER->MODE = TIMER_MODE_MODE_Timer;
+  READ_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+  READ_TIMER->PRESCALER = 0;                                                      // 16 MHz from the HFCLK, like micros()
+  READ_TIMER->CC[0] = _periodTicks;
+  READ_TIMER->SHORTS = TIMER_SHORTS_COMPARE0_CLEAR_Msk;
+  READ_TIMER->TASKS_CLEAR = 1;
+
+  NRF_PPI->CH[TRIGGER_PPI_CH].EEP = (uint32_t)&READ_TIMER->EVENTS_COMPARE[0];
+  NRF_PPI->CH[TRIGGER_PPI_CH].TEP = (uint32_t)&IMU_TWIM->TASKS_STARTTX;
+  NRF_PPI->CH[COUNT_PPI_CH].EEP = (uint32_t)&IMU_TWIM->EVENTS_STOPPED;
+  NRF_PPI->CH[COUNT_PPI_CH].TEP = (uint32_t)&COUNT_TIMER->TASKS_COUNT;
+  NRF_PPI->CH[ERROR_PPI_CH].EEP = (uint32_t)&IMU_TWIM->EVENTS_ERROR;
+  NRF_PPI->CH[ERROR_PPI_CH].TEP = (uint32_t)&IMU_TWIM->TASKS_STOP;
+  NRF_PPI->FORK[ERROR_PPI_CH].TEP = (uint32_t)&COUNT_TIMER->TASKS_CAPTURE[2];
+  NRF_PPI->CH[ERROR_COUNT_PPI_CH].EEP = (uint32_t)&IMU_TWIM->EVENTS_ERROR;
+  NRF_PPI->CH[ERROR_COUNT_PPI_CH].TEP = (uint32_t)&ERROR_TIMER->TASKS_COUNT;
+  NRF_PPI->CHENSET = (1UL << TRIGGER_PPI_CH) | (1UL << COUNT_PPI_CH) | (1UL << ERROR_PPI_CH) | (1UL << ERROR_COUNT_PPI_CH);
+
+  _startUs = micros();
+  READ_TIMER->TASKS_START = 1;                                                    // First read one period from now
+  return true;
+}
+
+void TwimSampler::stop()
+{
+  NRF_PPI->CHENCLR = 1UL << TRIGGER_PPI_CH;                                       // No new reads
+  READ_TIMER->TASKS_STOP = 1;
+  delayMicroseconds(STOP_WAIT_US);                                                // The read in flight, if any, is counted by then
+  NRF_PPI->CHENCLR = (1UL << COUNT_PPI_CH) | (1UL << ERROR_PPI_CH) | (1UL << ERROR_COUNT_PPI_CH);
+  NRF_PPI->FORK[ERROR_PPI_CH].TEP = 0;
+  ERROR_TIMER->TASKS_STOP = 1;
+  NVIC_DisableIRQ(TIMER4_IRQn);
+  COUNT_TIMER->INTENCLR = TIMER_INTENCLR_COMPARE0_Msk;
+  COUNT_TIMER->TASKS_STOP = 1;                                                    // Keeps its count: completed() still answers
+
+  IMU_TWIM->ENABLE = TWIM_ENABLE_ENABLE_Disabled << TWIM_ENABLE_ENABLE_Pos;
+  IMU_TWIM->SHORTS = savedShorts;
+  IMU_TWIM->RXD.LIST = TWIM_RXD_LIST_LIST_Disabled;
+  IMU_TWIM->INTENSET = savedInten;
+  IMU_TWIM->ENABLE = savedEnable;
+  _active = nullptr;
+}
+
+uint32_t TwimSampler::completed()
+{
+  COUNT_TIMER->TASKS_CAPTURE[1] = 1;                                              // First: a failure counted below then has an index of at least done
+  uint32_t done = COUNT_TIMER->CC[1];
+  ERROR_TIMER->TASKS_CAPTURE[0] = 1;
+  uint32_t errors = ERROR_TIMER->CC[0];
+  if (errors != _errors)
+  {
+    IMU_TWIM->EVENTS_ERROR = 0;
+    IMU_TWIM->ERRORSRC = IMU_TWIM->ERRORSRC;                                      // Write 1 to clear
+    logFailures(errors - _errors, COUNT_TIMER->CC[2]);
+  }
+  _polled = done;
+  return done;
+}
+
+#endif
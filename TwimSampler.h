@@ -0,0 +1,55 @@
+#ifndef TWIM_SAMPLER_H
+#define TWIM_SAMPLER_H
+
+#include <Arduino.h>
+#include <atomic>
+
+                                                                          // Register reads of one device on the Wire1 bus without the CPU: TIMER3 fires
+                                                                          // every record period and PPI starts a TWIM transaction set up once (register
+                                                                          // address, repeated start, burst read). EasyDMA list mode moves the receive
+                                                                          // pointer on by one frame after every read, so the frames fill a RAM ring;
+                                                                          // TIMER4 counts the finished reads and interrupts once per lap, only to point
+                                                                          // the DMA back at the start of the ring. Read n starts n + 1 timer periods
+                                                                          // after start(), so its time is known without looking at the clock. A NACKed
+                                                                          // read leaves the DMA pointer where it was, so the rest of that lap lands a
+                                                                          // slot early; frame() follows the failed reads completed() has placed, reads
+                                                                          // it can't place are reported failed up to the end of their lap.
+class TwimSampler
+{
+public:
+  static const uint16_t RING = 256;                                       // Frames (power of two): 160 ms at 1600 Hz
+  static const uint8_t MAX_FRAME = 12;                                    // Bytes per read: ACC + GYR
+  static const uint8_t FAIL_LOG = 8;                                      // Failed reads remembered (power of two), more in a lap lose the rest of it
+
+  TwimSampler();
+
+  bool start(uint8_t addr, uint8_t reg, uint8_t frameBytes, uint32_t rate);   // Takes the TWIM over from Wire1 (false - frame too long or no rate)
+  void stop();                                                            // Waits for the read in flight, Wire1 can use the TWIM again
+  uint32_t completed();                                                   // Reads finished since start(), failed ones included
+  uint32_t errors() const;                                                // Failed reads seen by completed()
+  bool failed(uint32_t n) const;                                          // Read n was NACKed, or its slot is unknown: no frame
+  const uint8_t* frame(uint32_t n) const;                                 // Read n, valid while completed() - n < RING and !failed(n)
+  uint32_t frameTime(uint32_t n) const;                                   // micros() when the timer started read n
+
+private:
+  uint8_t _ring[RING * MAX_FRAME];                                        // EasyDMA target, frames back to back
+  uint8_t _reg;                                                           // EasyDMA source: the register address sent ahead of every read
+  uint8_t _addr;
+  uint8_t _frameBytes;
+  uint32_t _periodTicks;                                                  // 16 MHz timer ticks between reads
+  uint32_t _startUs;
+  uint32_t _errors;
+  uint32_t _failed[FAIL_LOG];                                             // Indexes of the last failed reads, newest at _logged - 1
+  uint32_t _logged;
+  uint32_t _lostFrom;                                                     // Reads from here to _lostTo (a lap end) are in unknown slots
+  uint32_t _lostTo;
+  uint32_t _polled;                                                       // completed() at the call before
+  std::atomic<uint32_t> _done;                                            // Host simulation: reads finished (TIMER4 counts them on the device)
+
+  static TwimSampler* _active;                                            // Instance served by the TIMER4 interrupt
+  static void irq();                                                      // Once per lap: the next read goes to the start of the ring
+  void logFailures(uint32_t count, uint32_t last);                        // completed(): count more reads failed, the newest was read `last`
+  void lose(uint32_t from, uint32_t last);                                // Reads from `from` to the end of the lap of `last` can't be placed
+};
+
+#endif
@@ -0,0 +1,219 @@
+// Host stress test for SampleQueue.h, the lock-free queue between the acquisition and storage threads
+// Build (from the repository root):
+//   g++ -O2 -std=c++17 -pthread -I . -o queue_stress host/queue_stress.cpp
+//   (add -fsanitize=thread to have the data race checker watch the stress runs)
+// Usage:  queue_stress [--items N] [--counter-wrap]
+// Single-threaded: full and empty exactly at N items, FIFO order and peek() over many laps of the slots.
+// Threaded: a producer and a consumer on their own threads with random pauses, so the queue keeps running
+// full and empty. Blocking: every item arrives once, in order and intact. Dropping (as queueSample() does
+// when storage is behind): the items that arrive are the ones pushed, in order, none twice.
+// --counter-wrap also pushes 2^32 items through a small queue, so the free-running counters wrap (about 20 s).
+
+#include "SampleQueue.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+
+struct Item                                                                 // Record sized like SamplePacket, every byte derived from seq
+{
+  uint32_t seq;
+  uint8_t payload[25];
+};
+
+static void fill(Item& it, uint32_t seq)
+{
+  it.seq = seq;
+  for (uint8_t i = 0; i < sizeof(it.payload); i++)
+  {
+    it.payload[i] = (uint8_t)(seq * 31 + i * 7);
+  }
+}
+
+static bool intact(const Item& it)                                          // Torn copy: payload of another seq
+{
+  for (uint8_t i = 0; i < sizeof(it.payload); i++)
+  {
+    if (it.payload[i] != (uint8_t)(it.seq * 31 + i * 7)) return false;
+  }
+  return true;
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char* what, uint32_t at)
+{
+  if (!ok && failures++ < 10)
+  {
+    printf("FAIL %s (item %u)\n", what, at);
+  }
+}
+
+template <uint32_t N>
+static void laps(uint32_t count)                                            // One thread: fill to full, drain to empty, then uneven steps
+{
+  static SampleQueue<Item, N> q;
+  q.reset();
+  Item it;
+  uint32_t in = 0;
+  uint32_t out = 0;
+  for (uint32_t lap = 0; lap < count; lap++)
+  {
+    uint32_t room = N - q.size();
+    uint32_t burst = (lap % 3 == 0) ? room : (1 + lap % N < room) ? 1 + lap % N : room;   // Every third lap fills the queue and empties
+    for (uint32_t i = 0; i < burst; i++)                                      // it, the rest leave it part full at other offsets
+    {
+      fill(it, in);
+      check(q.push(it), "push refused below N items", in);
+      in++;
+    }
+    if (q.size() == N)
+    {
+      fill(it, in);
+      check(!q.push(it), "push accepted at N items", in);
+    }
+    uint32_t take = (lap % 3 == 0) ? N : (burst + 1) / 2;
+    for (uint32_t i = 0; i < take && q.size() > 0; i++)
+    {
+      Item peeked;
+      check(q.peek(peeked) && peeked.seq == out, "peek() is not the oldest item", out);
+      check(q.pop(it) && it.seq == out && intact(it), "pop() out of order", out);
+      out++;
+    }
+    check(q.size() == in - out, "size() after pops", out);
+  }
+  while (q.pop(it))
+  {
+    check(it.seq == out++ && intact(it), "pop() out of order while draining", it.seq);
+  }
+  check(in == out, "items left behind", in);
+  check(!q.pop(it) && !q.peek(it) && q.size() == 0, "empty queue returns an item", out);
+  printf("laps     N=%-4u %9u items, full/empty at every lap\n", N, in);
+}
+
+static void pause(std::mt19937& rng)                                        // Mostly none, sometimes a yield or a short sleep
+{
+  uint32_t r = rng() % 1000;
+  if (r < 5) std::this_thread::sleep_for(std::chrono::microseconds(r * 20));
+  else if (r < 50) std::this_thread::yield();
+}
+
+template <uint32_t N>
+static void threaded(uint32_t items, bool drop)
+{
+  static SampleQueue<Item, N> q;
+  q.reset();
+  uint32_t fulls = 0;
+  uint32_t drops = 0;
+  std::atomic<bool> done(false);
+  std::thread producer([&]
+  {
+    std::mt19937 rng(1);
+    Item it;
+    for (uint32_t seq = 0; seq < items; seq++)
+    {
+      fill(it, seq);
+      while (!q.push(it))
+      {
+        fulls++;
+        if (drop)
+        {
+          drops++;                                                          // Lost, like droppedSamples in the firmware
+          break;
+        }
+        std::this_thread::yield();
+      }
+      pause(rng);
+    }
+    done.store(true, std::memory_order_release);
+  });
+  std::mt19937 rng(2);
+  uint32_t received = 0;
+  uint32_t empties = 0;
+  int64_t last = -1;
+  Item it;
+  while (true)
+  {
+    bool finished = done.load(std::memory_order_acquire);                   // Before pop(): nothing is pushed after it turns true
+    if (!q.pop(it))
+    {
+      if (finished) break;
+      empties++;
+      std::this_thread::yield();
+      continue;
+    }
+    check(intact(it), "torn item", it.seq);
+    if (drop)
+    {
+      check((int64_t)it.seq > last, "item duplicated or out of order", it.seq);
+    }
+    else
+    {
+      check(it.seq == (uint32_t)(last + 1), "item lost, duplicated or out of order", it.seq);
+    }
+    last = it.seq;
+    received++;
+    pause(rng);
+  }
+  producer.join();
+  check(received + drops == items, drop ? "items neither received nor counted as dropped" : "items lost", received);
+  check(fulls > 0 && empties > 0, "the queue never ran full and empty", fulls);
+  printf("%s N=%-4u %9u items, %u received, %u dropped, %u pushes on a full queue, %u pops on an empty one\n",
+         drop ? "dropping" : "blocking", N, items, received, drops, fulls, empties);
+}
+
+static void counterWrap()                                                   // 2^32 + a few laps: head and tail wrap past 0
+{
+  static SampleQueue<uint32_t, 4> q;
+  q.reset();
+  uint32_t in = 0;
+  uint32_t out = 0;
+  uint64_t total = 0;
+  do
+  {
+    for (uint32_t i = 0; i < 4; i++)
+    {
+      if (!q.push(in)) check(false, "push refused below N items", in);
+      in++;
+    }
+    if (q.push(in)) check(false, "push accepted at N items", in);
+    uint32_t v;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+      if (!q.pop(v) || v != out) check(false, "pop() out of order", out);
+      out++;
+    }
+    if (q.pop(v)) check(false, "pop() from an empty queue", out);
+    total += 4;
+  } while (total < (1ull << 32) + 64);
+  printf("wrap     N=4    %9llu items, counters wrapped past 0\n", (unsigned long long)total);
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t items = 2000000;
+  bool wrap = false;
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--items") && i + 1 < argc) items = strtoul(argv[++i], nullptr, 0);
+    else if (!strcmp(argv[i], "--counter-wrap")) wrap = true;
+    else
+    {
+      printf("Usage: %s [--items N] [--counter-wrap]\n", argv[0]);
+      return 2;
+    }
+  }
+  laps<8>(100000);
+  laps<128>(10000);
+  threaded<8>(items, false);
+  threaded<256>(items, false);
+  threaded<8>(items, true);
+  threaded<256>(items, true);
+  if (wrap) counterWrap();
+  printf(failures ? "FAIL: %d checks\n" : "OK\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,24 @@
+#ifndef SIM_ACROBOTIC_SSD1306_H
+#define SIM_ACROBOTIC_SSD1306_H
+
+#include "Arduino.h"
+
+class ACROBOTIC_SSD1306                                                   // 16 x 8 text screen kept in RAM, Sim::screen() dumps it
+{
+public:
+  void init() { clearDisplay(); }
+  void clearDisplay();
+  void setTextXY(unsigned char row, unsigned char col);
+  void putString(const char* s);
+  void putChar(unsigned char c);
+  void sendCommand(unsigned char cmd) { (void)cmd; }
+  char text[8][17];
+
+private:
+  unsigned char _row = 0;
+  unsigned char _col = 0;
+};
+
+extern ACROBOTIC_SSD1306 oled;
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+                                                                          // Host simulation: the part of the Arduino core the firmware uses
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdio.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define F(x) (x)
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+int analogRead(int pin);
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void tone(int pin, unsigned int frequency, unsigned long duration = 0);
+void noTone(int pin);
+
+template <class T, class U> auto min(T a, U b) { return (a < b) ? a : b; }
+template <class T, class U> auto max(T a, U b) { return (a > b) ? a : b; }
+
+class Stream
+{
+public:
+  virtual ~Stream() {}
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t* data, size_t len);
+
+  size_t print(const char* s);
+  size_t print(long v);
+  size_t print(unsigned long v);
+  size_t print(int v) { return print((long)v); }
+  size_t print(unsigned int v) { return print((unsigned long)v); }
+  size_t print(double v, int digits = 2);
+  size_t println();
+  template <class T> size_t println(T v) { return print(v) + println(); }
+};
+
+class HardwareSerial : public Stream                                      // USB CDC: device side of the link, Sim::host*() is the PC side
+{
+public:
+  void begin(unsigned long baud);
+  operator bool() const { return true; }
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* data, size_t len) override;
+  using Stream::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef SIM_ARDUINO_BMI270_BMM150_H
+#define SIM_ARDUINO_BMI270_BMM150_H
+
+#include "Arduino.h"
+
+class BoschSensorClass                                                    // The firmware only calls begin(), registers go through Wire1
+{
+public:
+  int begin() { return 1; }
+};
+
+extern BoschSensorClass IMU;
+
+#endif
@@ -0,0 +1,40 @@
+#include "../../CoilSampler.h"
+#include "mbed.h"
+#include "Sim.h"
+
+                                                                          // SAADC stand-in: a ticker plays the END interrupt once per DMA buffer and
+                                                                          // fills the block from the coil waveform at each conversion's time
+
+static mbed::Ticker blockTicker;
+static uint64_t nextConversionUs = 0;
+
+void CoilSampler::irq()
+{
+  CoilSampler* self = _active;
+  if (self == nullptr)
+  {
+    return;
+  }
+  int16_t* block = self->_buffers[self->_filling];
+  for (uint16_t i = 0; i < self->_block; i++)
+  {
+    block[i] = (int16_t)(Sim::coil(nextConversionUs + (uint64_t)i * 1000000 / ADC_RATE) * 4);   // Model is 10-bit like analogRead()
+  }
+  nextConversionUs += (uint64_t)self->_block * 1000000 / ADC_RATE;
+  self->consume(block, self->_block);
+  self->_filling ^= 1;
+}
+
+void CoilSampler::start(uint32_t recordHz, uint16_t gain)
+{
+  configure(recordHz, gain);
+  _active = this;
+  nextConversionUs = Sim::nowUs();
+  blockTicker.attach_us(&CoilSampler::irq, (uint32_t)((uint64_t)_block * 1000000 / ADC_RATE));
+}
+
+void CoilSampler::stop()
+{
+  blockTicker.detach();
+  _active = nullptr;
+}
@@ -0,0 +1,335 @@
+#include "ImuModel.h"
+#include "Sim.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#define REG_ACC_DATA 0x0C
+#define REG_GYR_DATA 0x12
+#define REG_FIFO_LENGTH 0x24
+#define REG_FIFO_DATA 0x26
+#define REG_ACC_CONF 0x40
+#define REG_GYR_CONF 0x42
+#define REG_FIFO_CONFIG_1 0x49
+#define REG_CMD 0x7E
+#define REG_MAG_DATA 0x42
+#define REG_MAG_OPMODE 0x4C
+#define REG_MAG_REP_XY 0x51
+#define REG_MAG_REP_Z 0x52
+
+#define FIFO_CMD_FLUSH 0xB0
+#define FIFO_HDR_ACC_GYR 0x8C
+#define FIFO_HDR_TIME 0x44
+#define FIFO_HDR_EMPTY 0x80
+#define FIFO_FRAME_LEN 13
+
+static const double PI = 3.14159265358979323846;
+
+Waveform::Waveform() : _periodUs(0)
+{
+}
+
+bool Waveform::load(const char* csvPath)
+{
+  FILE* f = fopen(csvPath, "r");
+  if (f == nullptr)
+  {
+    return false;
+  }
+  static const char* prefixes[4] = {"Accel_", "Gyro_", "Mag_", "Coil_"};
+  int map[7] = {-1, -1, -1, -1, -1, -1, -1};                                      // CSV column -> first channel of its sensor
+  char line[512];
+  if (fgets(line, sizeof(line), f) == nullptr)
+  {
+    fclose(f);
+    return false;
+  }
+  char* tok = strtok(line, ",\r\n");
+  for (int col = 0; tok != nullptr && col < 7; col++, tok = strtok(nullptr, ",\r\n"))
+  {
+    for (int s = 0; s < 4; s++)
+    {
+      size_t n = strlen(prefixes[s]);
+      if (strncmp(tok, prefixes[s], n) == 0)
+      {
+        int axis = tok[n] - 'x';
+        map[col] = (s == 3) ? (axis == 0 ? COIL : -1) : s * 3 + axis;
+      }
+    }
+  }
+
+  std::vector<int16_t> cols[7];
+  double first = -1, last = 0;
+  while (fgets(line, sizeof(line), f) != nullptr)
+  {
+    double t;
+    int v[6];
+    if (sscanf(line, "%lf,%d,%d,%d,%d,%d,%d", &t, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) != 7)
+    {
+      continue;
+    }
+    if (first < 0)
+    {
+      first = t;
+    }
+    last = t;
+    for (int c = 0; c < 6; c++)
+    {
+      cols[c + 1].push_back((int16_t)v[c]);
+    }
+  }
+  fclose(f);
+  size_t n = cols[1].size();
+  if (n < 2)
+  {
+    return false;
+  }
+  _periodUs = (uint32_t)((last - first) * 1e6 / (n - 1));                         // Recordings are uniformly sampled
+  if (_periodUs == 0)
+  {
+    _periodUs = 1;
+  }
+  for (int col = 1; col < 7; col++)
+  {
+    if (map[col] >= 0)
+    {
+      _samples[map[col]] = cols[col];
+    }
+  }
+  return true;
+}
+
+int16_t Waveform::value(uint8_t channel, uint64_t us) const
+{
+  const std::vector<int16_t>& s = _samples[channel];
+  if (!s.empty())
+  {
+    return s[(us / _periodUs) % s.size()];
+  }
+  double t = us * 1e-6;                                                           // Synthetic: a few tones per channel plus deterministic noise
+  double f = 1.0 + channel * 0.7;
+  uint32_t h = (uint32_t)(us / 100) * 2654435761u + channel * 40503u;
+  double noise = ((h >> 16) & 0xFF) - 128.0;
+  double amp = (channel <= ACC_Z) ? 4000 : (channel <= GYR_Z) ? 6000 : (channel <= MAG_Z) ? 300 : 200;
+  double base = (channel == COIL) ? 512 : 0;
+  return (int16_t)(base + amp * sin(2 * PI * f * t) + 0.25 * amp * sin(2 * PI * 37 * f * t) + noise * amp / 2000);
+}
+
+ImuModel::ImuModel(const Waveform* wave) : _wave(wave), _bmiPtr(0), _bmmPtr(0), _fifoStartUs(0), _fifoNext(0), _frameLen(0), _framePos(0),
+  _timeSent(false), _magForced(false), _magDoneUs(0), _magLastUs(0)
+{
+  memset(_bmi, 0, sizeof(_bmi));
+  memset(_bmm, 0, sizeof(_bmm));
+  memset(&stats, 0, sizeof(stats));
+  _bmi[REG_ACC_CONF] = 0xA8;                                                      // Power-on defaults: 100 Hz
+  _bmi[REG_GYR_CONF] = 0xA9;                                                      // 200 Hz
+}
+
+uint32_t ImuModel::accOdr() const
+{
+  uint8_t odr = _bmi[REG_ACC_CONF] & 0x0F;
+  return (odr >= 1) ? (uint32_t)(25600 >> (16 - odr)) : 100;                      // 8 -> 100 Hz, 12 -> 1600 Hz
+}
+
+uint32_t ImuModel::gyrOdr() const
+{
+  uint8_t odr = _bmi[REG_GYR_CONF] & 0x0F;
+  return (odr >= 6) ? (uint32_t)(25600 >> (16 - odr)) : 25;                       // 13 -> 3200 Hz
+}
+
+bool ImuModel::fifoEnabled() const
+{
+  return (_bmi[REG_FIFO_CONFIG_1] & 0xC0) != 0;
+}
+
+uint64_t ImuModel::fifoProduced(uint64_t now) const
+{
+  return (now - _fifoStartUs) * accOdr() / 1000000;
+}
+
+uint16_t ImuModel::fifoLevel(uint64_t now)
+{
+  if (!fifoEnabled())
+  {
+    return 0;
+  }
+  uint64_t produced = fifoProduced(now);
+  uint64_t capacity = FIFO_BYTES / FIFO_FRAME_LEN;
+  if (produced - _fifoNext > capacity)                                            // Overwrite the oldest frames
+  {
+    uint64_t lost = produced - _fifoNext - capacity;
+    stats.fifoDropped += lost;
+    _fifoNext += lost;
+  }
+  uint16_t level = (produced - _fifoNext) * FIFO_FRAME_LEN;
+  if (_frameLen > 0)                                                              // A partly read frame is sent again in full
+  {
+    level += _frameLen;
+  }
+  return level;
+}
+
+void ImuModel::sample(uint8_t first, uint64_t us, uint32_t odr, uint8_t* out) const
+{
+  uint64_t t = us - us % (1000000 / odr);                                         // Data registers update once per ODR period
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    int16_t v = _wave->value(first + i, t);
+    memcpy(out + 2 * i, &v, 2);
+  }
+}
+
+uint8_t ImuModel::readFifoByte(uint64_t now)
+{
+  if (_framePos < _frameLen)
+  {
+    uint8_t b = _frame[_framePos++];
+    if (_framePos == _frameLen)
+    {
+      _frameLen = _framePos = 0;
+      if (_frame[0] == FIFO_HDR_ACC_GYR)
+      {
+        stats.fifoFrames++;
+      }
+    }
+    return b;
+  }
+  fifoLevel(now);
+  if (fifoEnabled() && _fifoNext < fifoProduced(now))
+  {
+    uint64_t frameUs = _fifoStartUs + (_fifoNext * 1000000 + accOdr() - 1) / accOdr();
+    _frame[0] = FIFO_HDR_ACC_GYR;
+    sample(Waveform::GYR_X, frameUs, accOdr(), _frame + 1);                       // GYR first, then ACC
+    sample(Waveform::ACC_X, frameUs, accOdr(), _frame + 7);
+    _fifoNext++;
+    _frameLen = FIFO_FRAME_LEN;
+    _framePos = 0;
+    _timeSent = false;
+    return readFifoByte(now);
+  }
+  if (fifoEnabled() && !_timeSent)                                                // Past the fill level: sensortime of the newest frame
+  {
+    uint64_t last = (_fifoNext > 0) ? _fifoNext - 1 : 0;
+    uint64_t ticks = _fifoStartUs * 16 / 625 + last * (25600 / accOdr());         // 25.6 kHz
+    _frame[0] = FIFO_HDR_TIME;
+    _frame[1] = ticks & 0xFF;
+    _frame[2] = (ticks >> 8) & 0xFF;
+    _frame[3] = (ticks >> 16) & 0xFF;
+    _frameLen = 4;
+    _framePos = 0;
+    _timeSent = true;
+    return readFifoByte(now);
+  }
+  return FIFO_HDR_EMPTY;
+}
+
+int16_t ImuModel::coil(uint64_t us) const
+{
+  return _wave->value(Waveform::COIL, us);
+}
+
+bool ImuModel::write(uint8_t addr, const uint8_t* data, size_t len)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  if (addr != BMI270 && addr != BMM150)
+  {
+    return false;
+  }
+  if (len == 0)
+  {
+    return true;
+  }
+  uint8_t* regs = (addr == BMI270) ? _bmi : _bmm;
+  uint8_t& ptr = (addr == BMI270) ? _bmiPtr : _bmmPtr;
+  ptr = data[0] & 0x7F;
+  for (size_t i = 1; i < len; i++, ptr = (ptr + 1) & 0x7F)
+  {
+    regs[ptr] = data[i];
+    if (addr == BMM150 && ptr == REG_MAG_OPMODE && ((data[i] >> 1) & 3) == 1)   // Forced measurement: 145 us per XY and 500 us per Z repetition + 980 us
+    {
+      uint64_t now = Sim::nowUs();
+      _magLastUs = (_magForced && now < _magDoneUs) ? _magLastUs : _magDoneUs;
+      _magDoneUs = now + 145 * (2 * _bmm[REG_MAG_REP_XY] + 1) + 500 * (_bmm[REG_MAG_REP_Z] + 1) + 980;
+      _magForced = true;
+    }
+    if (addr == BMI270 && ptr == REG_CMD && data[i] == FIFO_CMD_FLUSH)
+    {
+      _fifoStartUs = Sim::nowUs();
+      _fifoNext = 0;
+      _frameLen = _framePos = 0;
+      _timeSent = false;
+    }
+  }
+  if (addr == BMI270 && len == 1 && _frameLen > 0)                                // New burst: a partly read frame starts over
+  {
+    _framePos = 0;
+  }
+  return true;
+}
+
+bool ImuModel::read(uint8_t addr, uint8_t* out, size_t len)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  uint64_t now = Sim::nowUs();
+  if (addr == BMM150)
+  {
+    uint8_t data[6] = {0};
+    int16_t v[3];
+    uint64_t at = now - now % 3333;
+    if (_magForced && _bmmPtr == REG_MAG_DATA)
+    {
+      stats.magReads++;
+      stats.magEarly += (now < _magDoneUs);
+      at = (now < _magDoneUs) ? _magLastUs : _magDoneUs;
+    }
+    for (uint8_t i = 0; i < 3; i++)
+    {
+      v[i] = _wave->value(Waveform::MAG_X + i, at);                             // Encoded the way IMUHandler::readMag decodes it
+    }
+    uint16_t x = (uint16_t)(v[0] << 3), y = (uint16_t)(v[1] << 3), z = (uint16_t)(v[2] << 5);
+    memcpy(data, &x, 2);
+    memcpy(data + 2, &y, 2);
+    memcpy(data + 4, &z, 2);
+    for (size_t i = 0; i < len; i++, _bmmPtr = (_bmmPtr + 1) & 0x7F)
+    {
+      out[i] = (_bmmPtr >= REG_MAG_DATA && _bmmPtr < REG_MAG_DATA + 6) ? data[_bmmPtr - REG_MAG_DATA] : _bmm[_bmmPtr];
+    }
+    return true;
+  }
+  if (addr != BMI270)
+  {
+    return false;
+  }
+
+  uint8_t data[12];
+  sample(Waveform::ACC_X, now, accOdr(), data);
+  sample(Waveform::GYR_X, now, gyrOdr(), data + 6);
+  uint16_t level = fifoLevel(now);
+  for (size_t i = 0; i < len; i++)
+  {
+    if (_bmiPtr == REG_FIFO_DATA)                                                 // FIFO data does not auto-increment
+    {
+      out[i] = readFifoByte(now);
+      continue;
+    }
+    if (_bmiPtr >= REG_ACC_DATA && _bmiPtr < REG_ACC_DATA + 12)
+    {
+      out[i] = data[_bmiPtr - REG_ACC_DATA];
+    }
+    else if (_bmiPtr == REG_FIFO_LENGTH || _bmiPtr == REG_FIFO_LENGTH + 1)
+    {
+      out[i] = (_bmiPtr == REG_FIFO_LENGTH) ? (level & 0xFF) : (level >> 8);
+    }
+    else
+    {
+      out[i] = _bmi[_bmiPtr];
+    }
+    _bmiPtr = (_bmiPtr + 1) & 0x7F;
+  }
+  if (_bmiPtr == REG_FIFO_DATA && _frameLen > 0 && _framePos > 0)                 // Burst ended inside a frame
+  {
+    _framePos = 0;
+  }
+  return true;
+}
@@ -0,0 +1,81 @@
+#ifndef IMU_MODEL_H
+#define IMU_MODEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <vector>
+
+                                                                          // Signals fed to the sensor models: 10 channels on a common time axis
+                                                                          // Synthetic by default, or replayed (looped) from an srd_host CSV export
+class Waveform
+{
+public:
+  enum Channel
+  {
+    ACC_X, ACC_Y, ACC_Z, GYR_X, GYR_Y, GYR_Z, MAG_X, MAG_Y, MAG_Z, COIL, CHANNELS
+  };
+
+  Waveform();
+  bool load(const char* csvPath);                                         // Header names pick the channels, the others stay synthetic
+  int16_t value(uint8_t channel, uint64_t us) const;
+
+private:
+  std::vector<int16_t> _samples[CHANNELS];
+  uint32_t _periodUs;
+};
+
+                                                                          // BMI270 (0x68) and BMM150 (0x10) as seen through Wire1 registers
+                                                                          // Data registers sample the waveform at the configured ODR; the FIFO
+                                                                          // fills with headered ACC+GYR frames at the ACC ODR, drops the oldest
+                                                                          // when full and returns a sensortime frame when read past its fill level.
+                                                                          // The BMM150 measures every 3.3 ms until it is put in forced mode; then
+                                                                          // each trigger measures once, done after the time its repetitions take
+class ImuModel
+{
+public:
+  static const uint8_t BMI270 = 0x68;
+  static const uint8_t BMM150 = 0x10;
+  static const uint16_t FIFO_BYTES = 2048;
+
+  struct Stats
+  {
+    uint64_t fifoFrames;                                                  // Frames delivered
+    uint64_t fifoDropped;                                                 // Frames overwritten before they were read
+    uint64_t magReads;
+    uint64_t magEarly;                                                    // Forced mode: read before the measurement was done (old values)
+  };
+
+  ImuModel(const Waveform* wave);
+  bool write(uint8_t addr, const uint8_t* data, size_t len);              // false - NACK
+  bool read(uint8_t addr, uint8_t* out, size_t len);
+  int16_t coil(uint64_t us) const;                                        // Analog coil input (A0)
+  Stats stats;
+
+private:
+  const Waveform* _wave;
+  std::mutex _lock;
+  uint8_t _bmi[128];
+  uint8_t _bmm[128];
+  uint8_t _bmiPtr;
+  uint8_t _bmmPtr;
+  uint64_t _fifoStartUs;                                                  // Time of frame 0 after the last flush
+  uint64_t _fifoNext;                                                     // Index of the next frame to deliver
+  uint8_t _frame[13];                                                     // Frame being read out
+  uint8_t _frameLen;
+  uint8_t _framePos;
+  bool _timeSent;
+  bool _magForced;
+  uint64_t _magDoneUs;                                                    // Forced mode: the last triggered measurement completes then
+  uint64_t _magLastUs;                                                    // and the one before it completed then
+
+  uint32_t accOdr() const;
+  uint32_t gyrOdr() const;
+  bool fifoEnabled() const;
+  uint64_t fifoProduced(uint64_t now) const;
+  uint16_t fifoLevel(uint64_t now);
+  void sample(uint8_t first, uint64_t us, uint32_t odr, uint8_t* out) const;
+  uint8_t readFifoByte(uint64_t now);
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include "NorFlash.h"
+#include "Sim.h"
+#include <string.h>
+
+#define CMD_WREN      0x06
+#define CMD_RDSR      0x05
+#define CMD_READ      0x03
+#define CMD_FAST_READ 0x0B
+#define CMD_PP        0x02
+#define CMD_SE        0x20
+#define CMD_BKE       0xD8
+#define CMD_BE        0x60
+#define CMD_BE_ALT    0xC7
+
+NorFlash::NorFlash() : _mem(SIZE, 0xFF), _phase(COMMAND), _cmd(0), _addrBytes(0), _addr(0), _wel(false), _busyUntil(0), _programLen(0)
+{
+  memset(&stats, 0, sizeof(stats));
+}
+
+bool NorFlash::isBusy() const
+{
+  return Sim::nowUs() < _busyUntil;
+}
+
+const uint8_t* NorFlash::data() const
+{
+  return _mem.data();
+}
+
+uint8_t NorFlash::status() const
+{
+  return (isBusy() ? 0x01 : 0) | (_wel ? 0x02 : 0);
+}
+
+void NorFlash::select()
+{
+  _phase = COMMAND;
+  _addrBytes = 0;
+  _addr = 0;
+  _programLen = 0;
+}
+
+uint8_t NorFlash::transfer(uint8_t mosi)
+{
+  switch (_phase)
+  {
+    case COMMAND:
+      _cmd = mosi;
+      if (_cmd != CMD_RDSR && isBusy())
+      {
+        stats.busyRejects++;
+        _phase = IGNORE;
+      }
+      else if (_cmd == CMD_RDSR || _cmd == CMD_WREN || _cmd == CMD_BE || _cmd == CMD_BE_ALT)
+      {
+        _phase = DATA;
+      }
+      else if (_cmd == CMD_READ || _cmd == CMD_FAST_READ || _cmd == CMD_PP || _cmd == CMD_SE || _cmd == CMD_BKE)
+      {
+        _phase = ADDRESS;
+      }
+      else
+      {
+        _phase = IGNORE;
+      }
+      return 0xFF;
+
+    case ADDRESS:
+      _addr = (_addr << 8) | mosi;
+      if (++_addrBytes == 3)
+      {
+        _addr &= SIZE - 1;
+        _phase = (_cmd == CMD_FAST_READ) ? DUMMY : DATA;
+      }
+      return 0xFF;
+
+    case DUMMY:
+      _phase = DATA;
+      return 0xFF;
+
+    case DATA:
+      if (_cmd == CMD_RDSR)
+      {
+        return status();
+      }
+      if (_cmd == CMD_READ || _cmd == CMD_FAST_READ)
+      {
+        uint8_t v = _mem[_addr];
+        _addr = (_addr + 1) & (SIZE - 1);
+        stats.bytesRead++;
+        return v;
+      }
+      if (_cmd == CMD_PP)
+      {
+        if (_programLen == PAGE)                                                  // More than a page: the last 256 bytes win
+        {
+          memmove(_program, _program + 1, PAGE - 1);
+          _programLen--;
+        }
+        _program[_programLen++] = mosi;
+      }
+      return 0xFF;
+
+    default:
+      return 0xFF;
+  }
+}
+
+void NorFlash::transfer(uint8_t* buf, size_t len)
+{
+  if (_phase == DATA && (_cmd == CMD_READ || _cmd == CMD_FAST_READ))            // Fast path for streaming reads
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      buf[i] = _mem[_addr];
+      _addr = (_addr + 1) & (SIZE - 1);
+    }
+    stats.bytesRead += len;
+    return;
+  }
+  for (size_t i = 0; i < len; i++)
+  {
+    buf[i] = transfer(buf[i]);
+  }
+}
+
+void NorFlash::deselect()
+{
+  if (_phase == DATA)
+  {
+    execute();
+  }
+  _phase = COMMAND;
+}
+
+void NorFlash::execute()
+{
+  uint64_t now = Sim::nowUs();
+  if (_cmd == CMD_WREN)
+  {
+    _wel = true;
+    return;
+  }
+  if (_cmd != CMD_PP && _cmd != CMD_SE && _cmd != CMD_BKE && _cmd != CMD_BE && _cmd != CMD_BE_ALT)
+  {
+    return;
+  }
+  if (!_wel)
+  {
+    stats.noWriteEnable++;
+    return;
+  }
+  _wel = false;
+
+  if (_cmd == CMD_PP)
+  {
+    uint32_t page = _addr & ~(PAGE - 1);
+    for (uint16_t i = 0; i < _programLen; i++)
+    {
+      uint32_t a = page | ((_addr + i) & (PAGE - 1));                             // Wraps inside the page like the real chip
+      if ((_mem[a] & _program[i]) != _program[i])
+      {
+        stats.overwrites++;
+      }
+      _mem[a] &= _program[i];
+    }
+    stats.programs++;
+    _busyUntil = now + T_PAGE_US;
+  }
+  else if (_cmd == CMD_SE)
+  {
+    memset(&_mem[_addr & ~(SECTOR - 1)], 0xFF, SECTOR);
+    stats.sectorErases++;
+    _busyUntil = now + T_SECTOR_US;
+  }
+  else if (_cmd == CMD_BKE)
+  {
+    memset(&_mem[_addr & ~(BLOCK - 1)], 0xFF, BLOCK);
+    stats.blockErases++;
+    _busyUntil = now + T_BLOCK_US;
+  }
+  else
+  {
+    memset(_mem.data(), 0xFF, SIZE);
+    stats.chipErases++;
+    _busyUntil = now + T_CHIP_US;
+  }
+}
@@ -0,0 +1,64 @@
+#ifndef NOR_FLASH_H
+#define NOR_FLASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+                                                                          // SPI NOR flash model (W25Q128-like, the subset Storage uses)
+                                                                          // Program only clears bits (memory &= data), erase sets them back to 0xFF
+                                                                          // Program/erase keep WIP set for the typical datasheet time; while busy
+                                                                          // only RDSR is answered, everything else is dropped and counted
+class NorFlash
+{
+public:
+  static const uint32_t PAGE = 256;
+  static const uint32_t SECTOR = 4096;
+  static const uint32_t BLOCK = 65536;
+  static const uint32_t SIZE = 16UL * 1024 * 1024;
+  static const uint32_t T_PAGE_US = 700;                                  // tPP typ
+  static const uint32_t T_SECTOR_US = 45000;                              // tSE typ
+  static const uint32_t T_BLOCK_US = 150000;                              // tBE2 typ (64 KB)
+  static const uint32_t T_CHIP_US = 40000000;                             // tCE typ
+
+  struct Stats
+  {
+    uint64_t programs;
+    uint64_t sectorErases;
+    uint64_t blockErases;
+    uint64_t chipErases;
+    uint64_t bytesRead;
+    uint64_t busyRejects;                                                 // Commands sent while WIP was set
+    uint64_t noWriteEnable;                                               // Program/erase without WREN
+    uint64_t overwrites;                                                  // Programmed bytes that needed a 0 -> 1 change (not erased)
+  };
+
+  NorFlash();
+  void select();                                                          // CS falling edge
+  uint8_t transfer(uint8_t mosi);
+  void transfer(uint8_t* buf, size_t len);                                // In place, MISO replaces MOSI
+  void deselect();                                                        // CS rising edge: program/erase starts here
+  bool isBusy() const;
+  const uint8_t* data() const;
+  Stats stats;
+
+private:
+  enum Phase
+  {
+    COMMAND, ADDRESS, DUMMY, DATA, IGNORE
+  };
+  std::vector<uint8_t> _mem;
+  Phase _phase;
+  uint8_t _cmd;
+  uint8_t _addrBytes;
+  uint32_t _addr;
+  bool _wel;
+  uint64_t _busyUntil;
+  uint8_t _program[PAGE];
+  uint16_t _programLen;
+
+  uint8_t status() const;
+  void execute();
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SIM_SPI_H
+#define SIM_SPI_H
+
+#include "Arduino.h"
+
+#define MSBFIRST 1
+#define SPI_MODE0 0
+
+class SPISettings
+{
+public:
+  SPISettings(uint32_t clockHz = 4000000, uint8_t bitOrder = MSBFIRST, uint8_t dataMode = SPI_MODE0) : clock(clockHz) { (void)bitOrder; (void)dataMode; }
+  uint32_t clock;
+};
+
+class SPIClass                                                            // Routed to the NorFlash whose CS pin is LOW, timed at the SPI clock
+{
+public:
+  void begin() {}
+  void end() {}
+  void beginTransaction(SPISettings settings);
+  void endTransaction() {}
+  uint8_t transfer(uint8_t data);
+  void transfer(void* buf, size_t count);
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+class NorFlash;
+class ImuModel;
+
+                                                                          // Control side of the host simulation: wiring of the models, the PC end
+                                                                          // of the USB link and bus counters for the benchmarks
+namespace Sim
+{
+  struct Stats
+  {
+    uint64_t spiBytes;
+    uint64_t i2cTransactions;
+    uint64_t i2cBytes;
+    uint64_t i2cNacks;
+    uint64_t busConflicts;                                                // A CS went low while another chip was selected
+    uint64_t tickerFires;
+    uint64_t tickerMaxLateUs;                                             // Host scheduling delay of the Ticker thread
+    uint64_t serialOut;
+    uint64_t oledBusUs;                                                   // Wire time spent on the display
+  };
+
+  uint64_t nowUs();                                                       // Monotonic, since the simulation started
+  void waitUntilUs(uint64_t deadline);                                    // Sleeps, then spins the last stretch for accuracy
+
+  void attachFlash(int csPin, NorFlash* chip);
+  void attachImu(ImuModel* imu);
+  void setPin(int pin, int level);                                        // Drives an input (button)
+  void setLinkRate(uint32_t bytesPerSecond);                              // USB CDC model, 0 - unlimited
+  void setMicrosStart(uint32_t us);                                       // micros() at the start, to reach the 32-bit wrap early
+  int16_t coil(uint64_t us);                                              // Coil input of the attached model at a time, 10-bit like analogRead()
+  void setTwimNacks(uint32_t every);                                      // TwimSampler: every Nth read is NACKed, 0 - none
+
+  size_t hostRead(uint8_t* buf, size_t max, uint32_t timeoutMs);          // PC side of Serial
+  void hostWrite(const uint8_t* data, size_t len);
+  void hostFlush();                                                       // Drops anything the device sent and the PC didn't read
+
+  Stats& stats();
+  void resetStats();
+}
+
+#endif
@@ -0,0 +1,795 @@
+// Host simulation of the firmware: main.ino and the sketch sources run unchanged on the mocked Arduino/mbed
+// APIs in this folder, with a NorFlash model on each chip select and an ImuModel on Wire1.
+// Build (from the repository root):
+//   g++ -O2 -std=gnu++17 -pthread -I host/sim -I . -o firmware_sim *.cpp host/sim/*.cpp
+// Usage:
+//   firmware_sim [--seconds S] [--mode 0-11] [--freq HZ | --freq menu] [--replay recording.csv] [--link MBPS] [--wrap] [--stream] [--adaptive] [--nack N]
+// Every sensor mode / frequency pair is recorded for S seconds through startRecording()/stopRecording(),
+// checked against the flash image (data and summary pages) and then downloaded through Transfer by a simulated
+// host, which also fetches its overview, resumes it half way and reads its pages back chip by chip with pipelined READs.
+// --wrap starts micros() 1 s before its 32-bit wraparound. Build with -DMEM3_CS=6 for a third flash chip. --stream records in STREAM with a live host on the link.
+// --adaptive records in ADP and checks every record's spacing against the rate records around it (modes with ACC, as the menu allows).
+// Build with -DTWIM_DMA=0 to read the A/G, A and G modes on the ticks instead of through TwimSampler (A/G 1600 through the FIFO).
+// --nack N fails every Nth TwimSampler read, as a NACK would: the records of the other reads must stay in place.
+
+#include "../../main.ino"
+#include "Sim.h"
+#include "NorFlash.h"
+#include "ImuModel.h"
+#include <atomic>
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static const char* MODE_NAMES[ChannelSet::MODES] = {"A/C", "A/G", "A/M", "G/M", "G/C", "M/C", "AGM", "ALL", "A", "G", "M", "C"};
+static const int MENU_FREQS[] = {50, 100, 150, 200, 250, 300, 350, 400, 450, 500, 550, 600, 650, 700, 750, 800, 850, 900, 950, 1000, 1600};
+static const int DEFAULT_FREQS[] = {100, 500, 1000, 1600};
+
+static NorFlash Flash1;
+static NorFlash Flash2;
+#ifdef MEM3_CS
+static NorFlash Flash3;
+static const NorFlash* const FLASHES[] = {&Flash1, &Flash2, &Flash3};            // Same order as Chips in main.ino
+#else
+static const NorFlash* const FLASHES[] = {&Flash1, &Flash2};
+#endif
+static Waveform Wave;
+static ImuModel Imu(&Wave);
+
+struct Result
+{
+  uint32_t records;
+  uint32_t pushed;                                                        // Records the acquisition thread queued (samplesInSecond)
+  uint64_t ticks;
+  uint32_t queueDrops;
+  uint32_t gaps;                                                          // Missing sample slots seen in the timestamps
+  double rate;
+  double jitterRms;
+  double jitterMax;
+  uint32_t pages;
+  double downloadMBs;
+  uint64_t oledMaxUs;                                                     // Most display bus time in one loop() pass while recording
+  bool downloadOk;
+  RunStats::Record stats;                                                 // As saved after the session and sent in the STATS frame
+  bool statsOk;
+  bool timeOk;                                                            // SCHEMA_TIMEBASE14: page base times only increase
+  uint32_t livePages;                                                     // --stream: PAGE frames that arrived while recording
+  uint32_t liveBehind;                                                    // --stream: pages the link fell behind on, NAKed from flash after END
+  bool liveOk;                                                            // --stream: every frame of the session arrived in the end
+  bool requestsOk;                                                        // RESUME from the middle and pipelined READs of the session's pages
+  bool summaryOk;                                                         // Summary pages in flash match the stored records at every level
+  bool ratesOk;                                                           // --adaptive: records are spaced as their rate records say
+  uint32_t fullRate;                                                      // --adaptive: records kept at the full rate
+  uint32_t rateChanges;
+  uint32_t magSamples;                                                    // SPARSE MAG slot: records that hold a reading
+  uint32_t coilRepeats;                                                   // COI slot: records with the same values as the record before
+};
+
+static void sessionRecords(const SessionLog::Entry& e, std::vector<SamplePacket>& out, std::vector<uint8_t>& rates, bool& timeOk)   // Straight from the flash models
+{
+  const NorFlash* const* chips = FLASHES;
+  SamplePacket packed[PageCodec::PAGE_SIZE * 8 / 42 + 2];
+  out.clear();
+  rates.clear();
+  timeOk = true;
+  uint64_t lastBase = 0;
+  if (e.schema == SessionLog::SCHEMA_CHANNELS)                                    // One bitstream over all pages
+  {
+    std::vector<uint8_t> data;
+    for (uint32_t logical = e.startPage; logical < e.endPage; logical++)
+    {
+      uint8_t chip;
+      uint32_t phys;
+      Log.locate(logical, chip, phys);
+      const uint8_t* page = chips[chip]->data() + phys * NorFlash::PAGE;
+      data.insert(data.end(), page, page + NorFlash::PAGE);
+    }
+    ChannelSet set;
+    out.resize(data.size() * 8 / 16 + 1);
+    rates.resize(out.size());
+    out.resize(ChannelPacker::decode(data.data(), data.size(), set, out.data(), out.size(), rates.data()));
+    rates.resize(e.init == INIT_ADAPTIVE ? out.size() : 0);
+    return;
+  }
+  for (uint32_t logical = e.startPage; logical < e.endPage; logical++)
+  {
+    uint8_t chip;
+    uint32_t phys;
+    Log.locate(logical, chip, phys);
+    const uint8_t* page = chips[chip]->data() + phys * NorFlash::PAGE;
+    if (e.schema == SessionLog::SCHEMA_PACKED16)
+    {
+      uint16_t n = PageCodec::decode(page, packed, sizeof(packed) / sizeof(packed[0]));
+      out.insert(out.end(), packed, packed + n);
+      continue;
+    }
+    if (e.schema == SessionLog::SCHEMA_TIMEBASE14)
+    {
+      uint16_t n = TimeBaseCodec::decode(page, packed, sizeof(packed) / sizeof(packed[0]));
+      if (n > 0)
+      {
+        uint64_t base = TimeBaseCodec::baseTime(page);
+        timeOk = timeOk && (base > lastBase || out.empty());
+        lastBase = base;
+      }
+      out.insert(out.end(), packed, packed + n);
+      continue;
+    }
+    for (uint16_t i = 0; i < 256; i += SamplePacket::PAIR_SIZE)
+    {
+      SamplePacket p;
+      memcpy(p.bytes, page + i, SamplePacket::PAIR_SIZE);
+      static const uint8_t erased[16] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+      if (memcmp(p.bytes, erased, SamplePacket::PAIR_SIZE) != 0)
+      {
+        out.push_back(p);
+      }
+    }
+  }
+}
+
+static bool checkSummary(const SessionLog::Entry& e, const std::vector<SamplePacket>& rec)   // Against the records read back from the data pages
+{
+  if (e.summaryPage == SessionLog::NO_SUMMARY || e.summaryPages == 0xFFFF)
+  {
+    return false;
+  }
+  ChannelSet set = Sensors.plan(e.mode, e.freq);
+  std::vector<uint8_t> offsets, slots;
+  for (uint8_t k = 0; k < ChannelSet::SLOTS; k++)
+  {
+    for (uint8_t a = 0; a < 3; a++)
+    {
+      if (set.axes[k] & (1 << a))
+      {
+        offsets.push_back(SamplePacket::slotOffset(k) + 2 * a);
+        slots.push_back(k);
+      }
+    }
+  }
+  size_t ch = offsets.size();
+  size_t blockSize = SummaryLog::BLOCK_HEADER + ch * 8;
+  std::vector<uint8_t> blocks[SummaryLog::LEVELS];                                // Every block of each level, in order
+  for (uint16_t k = 0; k < e.summaryPages; k++)
+  {
+    uint8_t chip;
+    uint32_t phys;
+    Log.locateSummary(e.summaryPage + k, chip, phys);
+    const uint8_t* page = FLASHES[chip]->data() + phys * NorFlash::PAGE;
+    SummaryLog::PageHeader h;
+    memcpy(&h, page, sizeof(h));
+    if (h.level >= SummaryLog::LEVELS || h.channels != ch || h.firstBlock * blockSize != blocks[h.level].size())
+    {
+      return false;
+    }
+    blocks[h.level].insert(blocks[h.level].end(), page + sizeof(h), page + sizeof(h) + h.blocks * blockSize);
+  }
+  uint32_t span = SummaryLog::BLOCK;
+  for (uint8_t level = 0; level < SummaryLog::LEVELS; level++, span *= SummaryLog::FACTOR)
+  {
+    size_t expected = (rec.size() + span - 1) / span;
+    if (blocks[level].size() != expected * blockSize)
+    {
+      return false;
+    }
+    for (size_t b = 0; b < expected; b++)
+    {
+      const uint8_t* got = blocks[level].data() + b * blockSize;
+      uint16_t records = std::min<size_t>(span, rec.size() - b * span);
+      if (memcmp(got + 4, &records, 2) != 0)
+      {
+        return false;
+      }
+      for (size_t c = 0; c < ch; c++)
+      {
+        int16_t lo = INT16_MAX, hi = INT16_MIN;
+        int32_t sum = 0;
+        uint64_t squares = 0;
+        uint32_t count = 0;
+        bool sparse = set.axes[slots[c]] & ChannelSet::SPARSE;
+        for (size_t i = b * span; i < b * span + records; i++)
+        {
+          if (sparse && !(rec[i].present & (1 << slots[c])))
+          {
+            continue;
+          }
+          count++;
+          int16_t v;
+          memcpy(&v, rec[i].bytes + offsets[c], 2);
+          lo = std::min(lo, v);
+          hi = std::max(hi, v);
+          sum += v;
+          squares += (uint32_t)((int32_t)v * v);
+        }
+        count = count ? count : 1;
+        float rms = sqrtf((float)squares / count);
+        int16_t want[4] = {lo, hi, (int16_t)(sum / (int32_t)count), (int16_t)((rms < 32767.0f) ? rms + 0.5f : 32767.0f)};
+        if (memcmp(got + SummaryLog::BLOCK_HEADER + c * 8, want, 8) != 0)
+        {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+static void timing(const std::vector<SamplePacket>& rec, const std::vector<uint8_t>& rates, double nominalUs, Result& r)   // rates: ADP dividers, else empty
+{
+  double sum2 = 0;
+  uint32_t regular = 0;
+  uint64_t span = 0;
+  r.gaps = 0;
+  r.jitterMax = 0;
+  r.ratesOk = rates.empty() || (rates[0] != 0 && rates.size() == rec.size());
+  r.fullRate = 0;
+  r.rateChanges = 0;
+  for (size_t i = 0; i < rates.size(); i++)
+  {
+    r.fullRate += (rates[i] == 1);
+    r.rateChanges += (i > 0 && rates[i] != rates[i - 1]);
+  }
+  for (size_t i = 1; i < rec.size(); i++)
+  {
+    uint32_t a, b;
+    memcpy(&a, rec[i - 1].bytes + 12, 4);
+    memcpy(&b, rec[i].bytes + 12, 4);
+    uint32_t dt = b - a;
+    span += dt;
+    if (!rates.empty() && rates[i] != rates[i - 1])                               // First record at a new rate: anywhere up to the slower step
+    {
+      continue;
+    }
+    double step = rates.empty() ? nominalUs : nominalUs * rates[i];
+    uint32_t slots = (uint32_t)(dt / step + 0.5);
+    if (slots == 0 && !rates.empty() && rates[i] > 1)
+    {
+      r.ratesOk = false;                                                          // Full-rate spacing in a decimated stretch: a rate record in the wrong place
+    }
+    if (slots >= 2)
+    {
+      r.gaps += slots - 1;
+    }
+    else if (slots == 1)
+    {
+      double dev = dt - step;
+      sum2 += dev * dev;
+      regular++;
+      if (fabs(dev) > r.jitterMax)
+      {
+        r.jitterMax = fabs(dev);
+      }
+    }
+  }
+  r.jitterRms = regular ? sqrt(sum2 / regular) : 0;
+  r.rate = span ? (rec.size() - 1) * 1e6 / span : 0;
+}
+
+template <typename F>
+static void parseFrames(std::vector<uint8_t>& buf, F onFrame)                    // Calls onFrame(type, seq, payload, len) per valid frame, keeps the rest
+{
+  size_t i = 0;
+  while (i + 10 <= buf.size())
+  {
+    if (buf[i] != Transfer::SYNC)
+    {
+      i++;
+      continue;
+    }
+    uint16_t len = buf[i + 6] | (buf[i + 7] << 8);
+    if (i + 10 + len > buf.size())
+    {
+      break;
+    }
+    uint16_t crc = buf[i + 8 + len] | (buf[i + 9 + len] << 8);
+    if (Transfer::crc16(&buf[i + 1], 7 + len) != crc)
+    {
+      i++;
+      continue;
+    }
+    uint32_t seq;
+    memcpy(&seq, &buf[i + 2], 4);
+    onFrame(buf[i + 1], seq, &buf[i + 8], len);
+    i += 10 + len;
+  }
+  buf.erase(buf.begin(), buf.begin() + i);
+}
+
+static bool download(uint16_t index, uint32_t expectedPages, double& mbPerSecond, RunStats::Record& stats)   // Simulated PC: STAT, GET, collect, ACK
+{
+  std::atomic<bool> ok(false);
+  std::atomic<bool> haveStats(false);
+  double elapsed = 0;
+  uint64_t received = 0;
+  Sim::hostFlush();
+  std::thread host([&]()
+  {
+    std::vector<uint8_t> buf;
+    std::vector<bool> seen;
+    uint32_t total = 0, have = 0;
+    bool asked = false;
+    uint64_t t0 = 0;
+    uint8_t chunk[4096];
+    while (true)
+    {
+      size_t n = Sim::hostRead(chunk, sizeof(chunk), 3000);
+      if (n == 0)
+      {
+        break;                                                                    // Device went quiet
+      }
+      buf.insert(buf.end(), chunk, chunk + n);
+      parseFrames(buf, [&](uint8_t type, uint32_t seq, const uint8_t* p, uint16_t len)
+      {
+        if (type == Transfer::DIRECTORY && !asked)
+        {
+          uint8_t stat[3] = {Transfer::STAT, (uint8_t)(index & 0xFF), (uint8_t)(index >> 8)};
+          uint8_t get[3] = {Transfer::GET, (uint8_t)(index & 0xFF), (uint8_t)(index >> 8)};
+          Sim::hostWrite(stat, sizeof(stat));
+          Sim::hostWrite(get, sizeof(get));
+          asked = true;
+          t0 = Sim::nowUs();
+        }
+        else if (type == Transfer::HEADER && total == 0)
+        {
+          memcpy(&total, p + 6, 4);
+          seen.assign(total, false);
+        }
+        if (type == Transfer::STATS && len == 2 + sizeof(stats))
+        {
+          memcpy(&stats, p + 2, sizeof(stats));
+          haveStats = (stats.magic == RunStats::MAGIC);
+        }
+        else if (asked && type != Transfer::DIRECTORY)
+        {
+          received += 10 + len;
+          if (seq < seen.size() && !seen[seq])
+          {
+            seen[seq] = true;
+            have++;
+          }
+        }
+      });
+      if (total > 0 && have == total)
+      {
+        elapsed = (Sim::nowUs() - t0) * 1e-6;
+        uint8_t ack = Transfer::ACK;
+        Sim::hostWrite(&ack, 1);
+        ok = (total == expectedPages + 2);
+        break;
+      }
+    }
+  });
+
+  Downlink.begin();
+  currentState = DATA_TRANSFER;
+  while (currentState == DATA_TRANSFER)                                           // loop() ends the transfer on ACK, like on the device
+  {
+    loop();
+  }
+  host.join();
+  mbPerSecond = (elapsed > 0) ? received / elapsed / 1e6 : 0;
+  return ok && haveStats;
+}
+
+static bool requests(uint16_t index, const SessionLog::Entry& e)                 // Simulated PC: OVERVIEW, RESUME half way, READ every chip's pages, ACK
+{
+  struct Range
+  {
+    uint8_t chip;
+    uint32_t first;
+    uint16_t count;
+  };
+  static const uint16_t READ_PAGES = 64;
+  static const uint8_t OUTSTANDING = Transfer::REQUESTS - 2;                      // OVERVIEW and RESUME take a slot each
+  std::vector<Range> ranges;
+  for (uint8_t c = 0; c < Log.chips(); c++)                                       // The session's physical pages on chip c, in READ_PAGES pieces
+  {
+    uint8_t chip;
+    uint32_t first;
+    if (e.startPage + c >= e.endPage)
+    {
+      continue;
+    }
+    Log.locate(e.startPage + c, chip, first);
+    uint32_t end = Log.usedPages(c, e.endPage);
+    for (uint32_t p = first; p < end; p += READ_PAGES)
+    {
+      ranges.push_back({c, p, (uint16_t)std::min<uint32_t>(READ_PAGES, end - p)});
+    }
+  }
+  uint32_t total = e.endPage - e.startPage + 2;
+  uint32_t from = total / 2;
+  uint32_t overviewPages = 0;                                                     // Level 1 pages in the summary region
+  for (uint16_t k = 0; e.summaryPage != SessionLog::NO_SUMMARY && k < e.summaryPages; k++)
+  {
+    uint8_t chip;
+    uint32_t phys;
+    Log.locateSummary(e.summaryPage + k, chip, phys);
+    overviewPages += (FLASHES[chip]->data()[phys * NorFlash::PAGE] == 1);
+  }
+  std::atomic<bool> ok(false);
+  Sim::hostFlush();
+  std::thread host([&]()
+  {
+    std::vector<uint8_t> buf;
+    std::vector<bool> seen(total, false);
+    uint32_t have = 0, blocks = 0, expected = 0, badBlocks = 0, summaries = 0;
+    bool overviewDone = false;
+    size_t sent = 0, done = 0, left = 0;
+    bool asked = false, wrongFrame = false;
+    for (const Range& r : ranges)
+    {
+      expected += r.count;
+    }
+    auto issue = [&]()                                                            // Keeps OUTSTANDING READs queued on the device
+    {
+      while (sent < ranges.size() && sent - done < OUTSTANDING)
+      {
+        const Range& r = ranges[sent++];
+        uint8_t read[8] = {Transfer::READ, r.chip, (uint8_t)r.first, (uint8_t)(r.first >> 8), (uint8_t)(r.first >> 16), (uint8_t)(r.first >> 24),
+                           (uint8_t)(r.count & 0xFF), (uint8_t)(r.count >> 8)};
+        Sim::hostWrite(read, sizeof(read));
+      }
+    };
+    uint8_t chunk[4096];
+    while (true)
+    {
+      size_t n = Sim::hostRead(chunk, sizeof(chunk), 3000);
+      if (n == 0)
+      {
+        break;
+      }
+      buf.insert(buf.end(), chunk, chunk + n);
+      parseFrames(buf, [&](uint8_t type, uint32_t seq, const uint8_t* p, uint16_t len)
+      {
+        if (type == Transfer::DIRECTORY && !asked)
+        {
+          uint8_t resume[7] = {Transfer::RESUME, (uint8_t)(index & 0xFF), (uint8_t)(index >> 8), (uint8_t)from, (uint8_t)(from >> 8), (uint8_t)(from >> 16), (uint8_t)(from >> 24)};
+          uint8_t overview[4] = {Transfer::OVERVIEW, (uint8_t)(index & 0xFF), (uint8_t)(index >> 8), 1};
+          Sim::hostWrite(overview, sizeof(overview));
+          Sim::hostWrite(resume, sizeof(resume));
+          issue();
+          asked = true;
+        }
+        else if (type == Transfer::BLOCK && len == 4 + 256)
+        {
+          uint8_t chip = p[0];
+          badBlocks += (chip >= Log.chips() || (uint16_t)seq != (p[1] | (p[2] << 8))
+                        || memcmp(p + 4, FLASHES[chip]->data() + seq * NorFlash::PAGE, 256) != 0);
+          blocks++;
+          if (left == 0)
+          {
+            left = ranges[done].count;
+          }
+          if (--left == 0)
+          {
+            done++;
+            issue();
+          }
+        }
+        else if (type == Transfer::SUMMARY && len == 6)
+        {
+          uint32_t sent;
+          memcpy(&sent, p + 2, 4);
+          overviewDone = (sent == summaries && sent == overviewPages);
+        }
+        else if (type == Transfer::SUMMARY)
+        {
+          summaries += (p[2] == 1);
+        }
+        else if (type == Transfer::HEADER || type == Transfer::PAGE || type == Transfer::END)
+        {
+          wrongFrame = wrongFrame || (seq > 0 && seq < from) || seq >= total;       // Frames before from were not asked for
+          if (seq < total && !seen[seq])
+          {
+            seen[seq] = true;
+            have++;
+          }
+        }
+      });
+      if (have == total - from + 1 && blocks == expected && overviewDone)
+      {
+        uint8_t ack = Transfer::ACK;
+        Sim::hostWrite(&ack, 1);
+        ok = !wrongFrame && badBlocks == 0;
+        break;
+      }
+    }
+  });
+
+  Downlink.begin();
+  currentState = DATA_TRANSFER;
+  while (currentState == DATA_TRANSFER)
+  {
+    loop();
+  }
+  host.join();
+  return ok;
+}
+
+static void liveHost(Result& r)                                                  // Simulated PC in STREAM: live pages, then NAKs for the gaps, ACK
+{
+  std::vector<uint8_t> buf;
+  std::vector<bool> seen;
+  uint32_t total = 0, have = 0;
+  bool ended = false;
+  uint8_t rounds = 0;
+  uint8_t chunk[4096];
+  auto nakMissing = [&]()
+  {
+    for (uint32_t seq = 0; seq < total; seq++)
+    {
+      if (!seen[seq])
+      {
+        uint8_t nak[5] = {Transfer::NAK, (uint8_t)seq, (uint8_t)(seq >> 8), (uint8_t)(seq >> 16), (uint8_t)(seq >> 24)};
+        Sim::hostWrite(nak, sizeof(nak));
+      }
+    }
+  };
+  while (true)
+  {
+    size_t n = Sim::hostRead(chunk, sizeof(chunk), ended ? 500 : 3000);
+    if (n == 0)
+    {
+      if (!ended || ++rounds > 20)
+      {
+        break;                                                                    // Device went quiet
+      }
+      nakMissing();
+      continue;
+    }
+    buf.insert(buf.end(), chunk, chunk + n);
+    parseFrames(buf, [&](uint8_t type, uint32_t seq, const uint8_t* p, uint16_t len)
+    {
+      (void)p;
+      (void)len;
+      if (type == Transfer::DIRECTORY || type == Transfer::STATS)
+      {
+        return;
+      }
+      if (type == Transfer::PAGE && !ended)
+      {
+        r.livePages++;
+      }
+      if (seq >= seen.size())
+      {
+        seen.resize(seq + 1, false);
+      }
+      if (!seen[seq])
+      {
+        seen[seq] = true;
+        have++;
+      }
+      if (type == Transfer::END && !ended)
+      {
+        ended = true;
+        total = seq + 1;
+        seen.resize(total, false);
+        r.liveBehind = total - 2 - r.livePages;
+        nakMissing();
+      }
+    });
+    if (ended && have == total)
+    {
+      uint8_t ack = Transfer::ACK;
+      Sim::hostWrite(&ack, 1);
+      r.liveOk = true;
+      break;
+    }
+  }
+}
+
+static bool runCase(int mode, int freq, double seconds, bool live, bool adaptive, Result& r)
+{
+  memset(&r, 0, sizeof(r));
+  selectedMode = mode;
+  selectedFreq = freq;
+  Sim::resetStats();
+  Sim::hostFlush();
+  std::thread host;
+  if (live)
+  {
+    host = std::thread(liveHost, std::ref(r));
+  }
+  if (!startRecording(live, adaptive))
+  {
+    if (host.joinable())
+    {
+      host.join();
+    }
+    return false;
+  }
+  bool fifo = fifoMode;
+  double nominalUs = fifo ? 1e6 / IMUHandler::FIFO_ODR : (double)(1000000UL / recordingRate());
+  SystemState running = live ? STREAM : RECORDING;
+  currentState = running;
+  uint64_t end = Sim::nowUs() + (uint64_t)(seconds * 1e6);
+  while (Sim::nowUs() < end && currentState == running)                           // The UI loop runs alongside, as on the device
+  {
+    uint64_t bus = Sim::stats().oledBusUs;
+    loop();
+    bus = Sim::stats().oledBusUs - bus;
+    if (bus > r.oledMaxUs)
+    {
+      r.oledMaxUs = bus;
+    }
+  }
+  if (currentState == RECORDING)
+  {
+    stopRecording();
+  }
+  if (currentState == STREAM)
+  {
+    stopStream();
+  }
+  while (currentState == DATA_TRANSFER)                                           // STREAM: the host recovers its gaps from flash, then ACKs
+  {
+    loop();
+  }
+  if (host.joinable())
+  {
+    host.join();
+  }
+  r.ticks = Sim::stats().tickerFires;
+  r.queueDrops = droppedSamples;
+  r.pushed = samplesInSecond;
+
+  SessionLog::Entry e;
+  uint16_t index = Log.count() - 1;
+  if (!Log.read(index, e))
+  {
+    return false;
+  }
+  std::vector<SamplePacket> rec;
+  std::vector<uint8_t> rates;
+  sessionRecords(e, rec, rates, r.timeOk);
+  r.records = rec.size();
+  r.pages = e.endPage - e.startPage;
+  timing(rec, rates, nominalUs, r);
+  ChannelSet set = recordingSet();
+  for (uint8_t k = 0; k < ChannelSet::SLOTS; k++)
+  {
+    for (size_t i = 0; set.sensor[k] == ChannelSet::MAG && (set.axes[k] & ChannelSet::SPARSE) && i < rec.size(); i++)
+    {
+      r.magSamples += (rec[i].present >> k) & 1;
+    }
+    uint8_t at = SamplePacket::slotOffset(k);
+    for (size_t i = 1; set.sensor[k] == ChannelSet::COI && i < rec.size(); i++)
+    {
+      r.coilRepeats += memcmp(rec[i].bytes + at, rec[i - 1].bytes + at, 6) == 0;
+    }
+  }
+  uint8_t page[256];
+  r.statsOk = Log.readStats(index, page);
+  r.summaryOk = checkSummary(e, rec);
+  memcpy(&r.stats, page, sizeof(r.stats));
+  RunStats::Record sent;
+  r.downloadOk = download(index, r.pages, r.downloadMBs, sent) && memcmp(&sent, &r.stats, sizeof(sent)) == 0;
+  r.requestsOk = requests(index, e);
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  double seconds = 2;
+  double linkMBs = 1.0;
+  int onlyMode = -1;
+  bool live = false;
+  bool adaptive = false;
+  std::vector<int> freqs(DEFAULT_FREQS, DEFAULT_FREQS + sizeof(DEFAULT_FREQS) / sizeof(DEFAULT_FREQS[0]));
+  for (int i = 1; i < argc; i++)
+  {
+    std::string a = argv[i];
+    bool hasValue = (i + 1 < argc);
+    if (a == "--seconds" && hasValue) seconds = atof(argv[++i]);
+    else if (a == "--mode" && hasValue) onlyMode = atoi(argv[++i]);
+    else if (a == "--link" && hasValue) linkMBs = atof(argv[++i]);
+    else if (a == "--wrap") Sim::setMicrosStart(0u - 1000000u);
+    else if (a == "--stream") live = true;
+    else if (a == "--adaptive") adaptive = true;
+    else if (a == "--nack" && hasValue) Sim::setTwimNacks(atoi(argv[++i]));
+    else if (a == "--freq" && hasValue)
+    {
+      std::string f = argv[++i];
+      freqs.clear();
+      if (f == "menu")
+      {
+        freqs.assign(MENU_FREQS, MENU_FREQS + sizeof(MENU_FREQS) / sizeof(MENU_FREQS[0]));
+      }
+      else
+      {
+        freqs.push_back(atoi(f.c_str()));
+      }
+    }
+    else if (a == "--replay" && hasValue)
+    {
+      if (!Wave.load(argv[++i]))
+      {
+        fprintf(stderr, "Cannot replay %s.\n", argv[i]);
+        return 1;
+      }
+    }
+    else
+    {
+      fprintf(stderr, "Usage: %s [--seconds S] [--mode 0-11] [--freq HZ|menu] [--replay rec.csv] [--link MBPS] [--wrap] [--stream] [--adaptive] [--nack N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  Sim::attachFlash(MEM1_CS, &Flash1);
+  Sim::attachFlash(MEM2_CS, &Flash2);
+#ifdef MEM3_CS
+  Sim::attachFlash(MEM3_CS, &Flash3);
+#endif
+  Sim::attachImu(&Imu);
+  Sim::setLinkRate((uint32_t)(linkMBs * 1e6));
+  setup();
+
+  static const char* LAYOUTS[] = {"?", "raw", "packed", "time-base", "channel-set"};
+  printf("Host simulation, %.1f s per case, link %.2f MB/s, %u host CPUs, %s pages\n", seconds, linkMBs,
+         std::thread::hardware_concurrency(), LAYOUTS[PAGE_SCHEMA]);
+  printf("Mode  Target  Achieved  Records  Ticks   Lost  Gaps  QDrop  PeakQ  Jit.rms  Jit.max  Pages  Download  OLED.max\n");
+  printf("        [Hz]      [Hz]                                                [us]     [us]          [MB/s]      [us]\n");
+  for (int mode = 0; mode < ChannelSet::MODES; mode++)
+  {
+    if ((onlyMode >= 0 && mode != onlyMode) || (adaptive && !ChannelSet::forMode(mode).has(ChannelSet::ACC)))
+    {
+      continue;                                                                   // START refuses ADP without the accelerometer (initAllowed())
+    }
+    for (int freq : freqs)
+    {
+      Result r;
+      if (!runCase(mode, freq, seconds, live, adaptive, r))
+      {
+        printf("%-4s  %6d  recording failed (memory full?)\n", MODE_NAMES[mode], freq);
+        continue;
+      }
+      long lost = r.statsOk ? (long)r.stats.missedTicks : -1;                     // Counted by the firmware (RunStats)
+      printf("%-4s  %6d  %8.1f  %7u  %5llu  %5ld  %4u  %5u  %5u  %7.1f  %7.1f  %5u  %6.3f  %8llu%s%s%s%s%s%s\n", MODE_NAMES[mode], freq, r.rate,
+             r.records, (unsigned long long)r.ticks, lost, r.gaps, r.queueDrops, r.stats.peakQueue, r.jitterRms, r.jitterMax, r.pages, r.downloadMBs, (unsigned long long)r.oledMaxUs,
+             r.downloadOk ? "" : "  DOWNLOAD FAILED", r.statsOk ? "" : "  NO STATS", (r.records == r.pushed) ? "" : "  RECORDS LOST IN STORAGE",
+             r.timeOk ? "" : "  TIME NOT MONOTONIC", r.requestsOk ? "" : "  RESUME/READ/OVERVIEW FAILED", r.summaryOk ? "" : "  SUMMARY MISMATCH");
+      if (r.magSamples > 0)
+      {
+        printf("      MAG: %u of %u records, %.1f Hz (preset: up to %u Hz)\n", r.magSamples, r.records, r.rate * r.magSamples / r.records, Sensors.magRate());
+      }
+      if (r.stats.skippedReads > 0)
+      {
+        printf("      TWIM: %u failed reads skipped\n", r.stats.skippedReads);
+      }
+      if (r.stats.summaryDropped > 0)
+      {
+        printf("      SUMMARY: %u pages dropped\n", r.stats.summaryDropped);
+      }
+      if (ChannelSet::forMode(mode).has(ChannelSet::COI))
+      {
+        printf("      COIL: %u of %u records repeat the one before%s\n", r.coilRepeats, r.records,   // Catching up after a late tick can outrun the ADC
+               (r.coilRepeats > r.gaps + r.records / 100) ? "  COIL REPEATS" : "");
+      }
+      if (adaptive)
+      {
+        printf("      ADP: %u of %u records at the full rate, %u rate changes%s\n", r.fullRate, r.records, r.rateChanges,
+               r.ratesOk ? "" : "  RATE RECORDS MISPLACED");
+      }
+      if (live)
+      {
+        printf("      live: %u of %u pages while recording, %u behind and NAKed from flash%s\n", r.livePages, r.pages, r.liveBehind,
+               r.liveOk ? "" : "  STREAM INCOMPLETE");
+      }
+      fflush(stdout);
+    }
+  }
+
+  for (int c = 0; c < Log.chips(); c++)
+  {
+    const NorFlash::Stats& s = FLASHES[c]->stats;
+    printf("M%d: %llu programs, %llu sector / %llu block erases, %.1f MB read, %llu busy rejects, %llu without WREN, %llu overwrites\n",
+           c + 1, (unsigned long long)s.programs, (unsigned long long)s.sectorErases, (unsigned long long)s.blockErases,
+           s.bytesRead / 1e6, (unsigned long long)s.busyRejects, (unsigned long long)s.noWriteEnable, (unsigned long long)s.overwrites);
+  }
+  printf("IMU FIFO: %llu frames, %llu overwritten\n", (unsigned long long)Imu.stats.fifoFrames, (unsigned long long)Imu.stats.fifoDropped);
+  printf("BMM150: %llu forced-mode reads, %llu before the measurement was done\n", (unsigned long long)Imu.stats.magReads, (unsigned long long)Imu.stats.magEarly);
+  fflush(stdout);
+  _exit(0);                                                                       // Firmware threads never return
+}
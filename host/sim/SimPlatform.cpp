@@ -0,0 +1,641 @@
+#include "Arduino.h"
+#include "SPI.h"
+#include "Wire.h"
+#include "ACROBOTIC_SSD1306.h"
+#include "Arduino_BMI270_BMM150.h"
+#include "mbed.h"
+#include "Sim.h"
+#include "NorFlash.h"
+#include "ImuModel.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <deque>
+
+                                                                          // Implementation of the mocked Arduino core, buses and mbed kernel objects
+
+static const std::chrono::steady_clock::time_point START = std::chrono::steady_clock::now();
+static const uint32_t SPIN_US = 60;                                       // Host sleep overshoot, the rest of a wait is spun
+static const uint32_t USB_BUFFER = 2048;                                  // Bytes the device may queue ahead of the link
+
+static Sim::Stats simStats;
+static int pinLevel[64];
+static bool pinInit = false;
+static NorFlash* flashOnPin[64];
+static NorFlash* selected = nullptr;
+static uint32_t spiClock = 4000000;
+static uint64_t spiFreeUs = 0;
+static ImuModel* imu = nullptr;
+
+static std::mutex serialLock;
+static std::condition_variable serialData;
+static std::deque<std::pair<uint64_t, uint8_t>> toHost;                  // Byte and the time it reaches the PC
+static std::deque<uint8_t> toDevice;
+static uint32_t linkRate = 0;
+static uint64_t linkFreeUs = 0;
+static uint32_t microsStart = 0;
+
+HardwareSerial Serial;
+SPIClass SPI;
+static const uint8_t OLED_ADDR = 0x3C;
+TwoWire Wire(0);
+TwoWire Wire1(1);
+ACROBOTIC_SSD1306 oled;
+BoschSensorClass IMU;
+
+// --- Simulation control ---
+
+uint64_t Sim::nowUs()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - START).count();
+}
+
+void Sim::waitUntilUs(uint64_t deadline)
+{
+  uint64_t now = nowUs();
+  if (deadline > now + SPIN_US)
+  {
+    std::this_thread::sleep_for(std::chrono::microseconds(deadline - now - SPIN_US));
+  }
+  while (nowUs() < deadline)
+  {
+  }
+}
+
+void Sim::attachFlash(int csPin, NorFlash* chip)
+{
+  flashOnPin[csPin & 63] = chip;
+}
+
+void Sim::attachImu(ImuModel* model)
+{
+  imu = model;
+}
+
+int16_t Sim::coil(uint64_t us)
+{
+  return (imu != nullptr) ? imu->coil(us) : 512;
+}
+
+void Sim::setPin(int pin, int level)
+{
+  pinLevel[pin & 63] = level;
+}
+
+void Sim::setLinkRate(uint32_t bytesPerSecond)
+{
+  linkRate = bytesPerSecond;
+}
+
+void Sim::setMicrosStart(uint32_t us)
+{
+  microsStart = us;
+}
+
+size_t Sim::hostRead(uint8_t* buf, size_t max, uint32_t timeoutMs)
+{
+  std::unique_lock<std::mutex> guard(serialLock);
+  serialData.wait_for(guard, std::chrono::milliseconds(timeoutMs), [] { return !toHost.empty(); });
+  if (toHost.empty())
+  {
+    return 0;
+  }
+  uint64_t arrival = toHost.front().first;
+  if (arrival > nowUs())                                                          // Still on the wire
+  {
+    guard.unlock();
+    waitUntilUs(arrival);
+    guard.lock();
+  }
+  uint64_t now = nowUs();
+  size_t n = 0;
+  while (n < max && !toHost.empty() && toHost.front().first <= now)
+  {
+    buf[n++] = toHost.front().second;
+    toHost.pop_front();
+  }
+  return n;
+}
+
+void Sim::hostWrite(const uint8_t* data, size_t len)
+{
+  std::lock_guard<std::mutex> guard(serialLock);
+  toDevice.insert(toDevice.end(), data, data + len);
+}
+
+void Sim::hostFlush()
+{
+  std::lock_guard<std::mutex> guard(serialLock);
+  toHost.clear();
+}
+
+Sim::Stats& Sim::stats()
+{
+  return simStats;
+}
+
+void Sim::resetStats()
+{
+  memset(&simStats, 0, sizeof(simStats));
+}
+
+// --- Arduino core ---
+
+void pinMode(int pin, int mode)
+{
+  if (!pinInit)
+  {
+    for (int i = 0; i < 64; i++)
+    {
+      pinLevel[i] = HIGH;
+    }
+    pinInit = true;
+  }
+  if (mode == INPUT_PULLUP)
+  {
+    pinLevel[pin & 63] = HIGH;
+  }
+}
+
+void digitalWrite(int pin, int value)
+{
+  NorFlash* chip = flashOnPin[pin & 63];
+  pinLevel[pin & 63] = value;
+  if (chip == nullptr)
+  {
+    return;
+  }
+  if (value == LOW)
+  {
+    if (selected != nullptr && selected != chip)
+    {
+      simStats.busConflicts++;
+    }
+    selected = chip;
+    chip->select();
+  }
+  else if (selected == chip)
+  {
+    Sim::waitUntilUs(spiFreeUs);                                                  // CS rises after the last clock
+    chip->deselect();
+    selected = nullptr;
+  }
+}
+
+int digitalRead(int pin)
+{
+  return pinInit ? pinLevel[pin & 63] : HIGH;
+}
+
+int analogRead(int pin)
+{
+  (void)pin;                                                                      // Only the coil input is wired
+  return Sim::coil(Sim::nowUs());
+}
+
+unsigned long millis()
+{
+  return (unsigned long)(uint32_t)(Sim::nowUs() / 1000);
+}
+
+unsigned long micros()
+{
+  return (unsigned long)(uint32_t)(Sim::nowUs() + microsStart);                   // Wraps like the nRF52 RTC-based micros()
+}
+
+void delay(unsigned long ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  Sim::waitUntilUs(Sim::nowUs() + us);
+}
+
+void tone(int pin, unsigned int frequency, unsigned long duration)
+{
+  (void)pin;
+  (void)frequency;
+  (void)duration;
+}
+
+void noTone(int pin)
+{
+  (void)pin;
+}
+
+size_t Stream::write(const uint8_t* data, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    write(data[i]);
+  }
+  return len;
+}
+
+size_t Stream::print(const char* s)
+{
+  return write((const uint8_t*)s, strlen(s));
+}
+
+size_t Stream::print(long v)
+{
+  char buf[24];
+  return write((const uint8_t*)buf, snprintf(buf, sizeof(buf), "%ld", v));
+}
+
+size_t Stream::print(unsigned long v)
+{
+  char buf[24];
+  return write((const uint8_t*)buf, snprintf(buf, sizeof(buf), "%lu", v));
+}
+
+size_t Stream::print(double v, int digits)
+{
+  char buf[48];
+  return write((const uint8_t*)buf, snprintf(buf, sizeof(buf), "%.*f", digits, v));
+}
+
+size_t Stream::println()
+{
+  return print("\r\n");
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+  (void)baud;                                                                     // USB CDC: the baud rate doesn't limit anything, setLinkRate() does
+}
+
+int HardwareSerial::available()
+{
+  std::lock_guard<std::mutex> guard(serialLock);
+  return (int)toDevice.size();
+}
+
+int HardwareSerial::read()
+{
+  std::lock_guard<std::mutex> guard(serialLock);
+  if (toDevice.empty())
+  {
+    return -1;
+  }
+  uint8_t b = toDevice.front();
+  toDevice.pop_front();
+  return b;
+}
+
+int HardwareSerial::peek()
+{
+  std::lock_guard<std::mutex> guard(serialLock);
+  return toDevice.empty() ? -1 : toDevice.front();
+}
+
+size_t HardwareSerial::write(uint8_t b)
+{
+  return write(&b, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* data, size_t len)
+{
+  uint64_t now = Sim::nowUs();
+  uint64_t arrival = now;
+  if (linkRate > 0)                                                               // Blocks like a full USB endpoint once the buffer is ahead of the link
+  {
+    uint64_t start = (linkFreeUs > now) ? linkFreeUs : now;
+    linkFreeUs = start + (uint64_t)len * 1000000 / linkRate;
+    arrival = linkFreeUs;
+    uint64_t ahead = (uint64_t)USB_BUFFER * 1000000 / linkRate;
+    if (linkFreeUs > now + ahead)
+    {
+      Sim::waitUntilUs(linkFreeUs - ahead);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> guard(serialLock);
+    for (size_t i = 0; i < len; i++)
+    {
+      toHost.emplace_back(arrival, data[i]);
+    }
+    simStats.serialOut += len;
+  }
+  serialData.notify_one();
+  return len;
+}
+
+// --- SPI: routed to the selected NorFlash ---
+
+static void spiClocks(size_t bytes)
+{
+  uint64_t now = Sim::nowUs();
+  uint64_t start = (spiFreeUs > now) ? spiFreeUs : now;
+  spiFreeUs = start + (uint64_t)bytes * 8000000 / spiClock / 1000;
+  simStats.spiBytes += bytes;
+  if (bytes >= 16)                                                                // Single bytes are settled at CS high
+  {
+    Sim::waitUntilUs(spiFreeUs);
+  }
+}
+
+void SPIClass::beginTransaction(SPISettings settings)
+{
+  spiClock = settings.clock;
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+  spiClocks(1);
+  return (selected != nullptr) ? selected->transfer(data) : 0xFF;
+}
+
+void SPIClass::transfer(void* buf, size_t count)
+{
+  spiClocks(count);
+  if (selected != nullptr)
+  {
+    selected->transfer((uint8_t*)buf, count);
+  }
+  else
+  {
+    memset(buf, 0xFF, count);
+  }
+}
+
+// --- I2C: Wire1 is the IMU bus ---
+
+TwoWire::TwoWire(uint8_t bus) : _bus(bus), _addr(0), _clock(100000), _txLen(0), _rxLen(0), _rxPos(0)
+{
+}
+
+void TwoWire::setClock(uint32_t hz)
+{
+  _clock = hz;
+}
+
+void TwoWire::beginTransmission(uint8_t addr)
+{
+  _addr = addr;
+  _txLen = 0;
+}
+
+size_t TwoWire::write(uint8_t b)
+{
+  if (_txLen >= BUFFER)
+  {
+    return 0;
+  }
+  _tx[_txLen++] = b;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t len)
+{
+  size_t n = 0;
+  while (n < len && write(data[n]))
+  {
+    n++;
+  }
+  return n;
+}
+
+static uint64_t i2cClocks(size_t bytes, uint32_t clock)
+{
+  simStats.i2cTransactions++;
+  simStats.i2cBytes += bytes;
+  uint64_t bits = 9 * (bytes + 1) + 2;                                            // Address byte, 9 clocks per byte with ACK, start/stop
+  uint64_t us = bits * 1000000 / clock;
+  Sim::waitUntilUs(Sim::nowUs() + us);
+  return us;
+}
+
+uint8_t TwoWire::endTransmission(bool stopBit)
+{
+  (void)stopBit;
+  uint64_t us = i2cClocks(_txLen, _clock);
+  if (_bus == 0 && _addr == OLED_ADDR)
+  {
+    simStats.oledBusUs += us;
+  }
+  bool ack = (_bus == 0 && _addr == OLED_ADDR) || ((_bus == 1 && imu != nullptr) && imu->write(_addr, _tx, _txLen));
+  _txLen = 0;
+  if (!ack)
+  {
+    simStats.i2cNacks++;
+    return 2;
+  }
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t addr, size_t len, bool stopBit)
+{
+  (void)stopBit;
+  if (len > BUFFER)
+  {
+    len = BUFFER;
+  }
+  i2cClocks(len, _clock);
+  _rxPos = 0;
+  _rxLen = 0;
+  if (_bus == 1 && imu != nullptr && imu->read(addr, _rx, len))
+  {
+    _rxLen = len;
+  }
+  else
+  {
+    simStats.i2cNacks++;
+  }
+  return _rxLen;
+}
+
+int TwoWire::available()
+{
+  return (int)(_rxLen - _rxPos);
+}
+
+int TwoWire::read()
+{
+  return (_rxPos < _rxLen) ? _rx[_rxPos++] : -1;
+}
+
+int TwoWire::peek()
+{
+  return (_rxPos < _rxLen) ? _rx[_rxPos] : -1;
+}
+
+// --- OLED: text kept in RAM, bus time as the library spends it (one transaction per command or data byte) ---
+
+static void oledBytes(uint8_t control, uint16_t count)
+{
+  for (uint16_t i = 0; i < count; i++)
+  {
+    Wire.beginTransmission(OLED_ADDR);
+    Wire.write(control);
+    Wire.write(0);
+    Wire.endTransmission();
+  }
+}
+
+void ACROBOTIC_SSD1306::clearDisplay()
+{
+  oledBytes(0x00, 8 * 3);                                                         // Page and column address of each page
+  oledBytes(0x40, 8 * 128);
+  memset(text, ' ', sizeof(text));
+  for (int r = 0; r < 8; r++)
+  {
+    text[r][16] = 0;
+  }
+  _row = _col = 0;
+}
+
+void ACROBOTIC_SSD1306::setTextXY(unsigned char row, unsigned char col)
+{
+  oledBytes(0x00, 3);
+  _row = row & 7;
+  _col = col;
+}
+
+void ACROBOTIC_SSD1306::putChar(unsigned char c)
+{
+  oledBytes(0x40, 8);                                                             // 8 columns of the glyph
+  if (_col < 16)
+  {
+    text[_row][_col++] = c;
+  }
+}
+
+void ACROBOTIC_SSD1306::putString(const char* s)
+{
+  while (*s)
+  {
+    putChar(*s++);
+  }
+}
+
+// --- mbed / RTX ---
+
+void mbed::Ticker::attach_us(Callback fn, uint32_t us)
+{
+  detach();
+  _run = true;
+  _thread = std::thread([this, fn, us]()
+  {
+    uint64_t next = Sim::nowUs() + us;
+    std::unique_lock<std::mutex> guard(_lock);
+    while (_run)
+    {
+      uint64_t now = Sim::nowUs();
+      if (now + SPIN_US < next)
+      {
+        _wake.wait_for(guard, std::chrono::microseconds(next - now - SPIN_US));
+        continue;
+      }
+      guard.unlock();
+      Sim::waitUntilUs(next);
+      uint64_t late = Sim::nowUs() - next;
+      if (late > simStats.tickerMaxLateUs)
+      {
+        simStats.tickerMaxLateUs = late;
+      }
+      simStats.tickerFires++;
+      fn();
+      next += us;
+      guard.lock();
+    }
+  });
+}
+
+void mbed::Ticker::detach()
+{
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    _run = false;
+  }
+  _wake.notify_all();
+  if (_thread.joinable())
+  {
+    _thread.join();
+  }
+}
+
+rtos::Thread::Thread(osPriority_t priority, uint32_t stackSize, unsigned char* stackMem, const char* name) : _priority(priority)
+{
+  (void)stackSize;
+  (void)stackMem;
+  (void)name;
+}
+
+int rtos::Thread::start(mbed::Callback task)
+{
+  _thread = std::thread(task);
+  sched_param param;
+  param.sched_priority = sched_get_priority_min(SCHED_FIFO) + _priority / 8;
+  pthread_setschedparam(_thread.native_handle(), SCHED_FIFO, &param);            // Needs CAP_SYS_NICE, best effort
+  _thread.detach();                                                               // Firmware threads run until the process exits
+  return 0;
+}
+
+uint32_t rtos::EventFlags::set(uint32_t flags)
+{
+  uint32_t now;
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    _flags |= flags;
+    now = _flags;
+  }
+  _changed.notify_all();
+  return now;
+}
+
+uint32_t rtos::EventFlags::clear(uint32_t flags)
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  uint32_t before = _flags;
+  _flags &= ~flags;
+  return before;
+}
+
+uint32_t rtos::EventFlags::get() const
+{
+  std::lock_guard<std::mutex> guard(_lock);
+  return _flags;
+}
+
+uint32_t rtos::EventFlags::wait(uint32_t flags, uint32_t millisec, bool clear, bool all)
+{
+  std::unique_lock<std::mutex> guard(_lock);
+  auto ready = [&]() { return all ? (_flags & flags) == flags : (_flags & flags) != 0; };
+  if (millisec == osWaitForever)
+  {
+    _changed.wait(guard, ready);
+  }
+  else if (!_changed.wait_for(guard, std::chrono::milliseconds(millisec), ready))
+  {
+    return osFlagsErrorTimeout;
+  }
+  uint32_t result = _flags;                                                       // Flags before clearing, like RTX
+  if (clear)
+  {
+    _flags &= ~flags;
+  }
+  return result;
+}
+
+uint32_t rtos::EventFlags::wait_any(uint32_t flags, uint32_t millisec, bool clear)
+{
+  return wait(flags, millisec, clear, false);
+}
+
+uint32_t rtos::EventFlags::wait_all(uint32_t flags, uint32_t millisec, bool clear)
+{
+  return wait(flags, millisec, clear, true);
+}
+
+void rtos::ThisThread::sleep_for(uint32_t ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void rtos::ThisThread::yield()
+{
+  std::this_thread::yield();
+}
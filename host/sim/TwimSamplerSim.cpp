@@ -0,0 +1,93 @@
+#include "../../TwimSampler.h"
+#include "Wire.h"
+#include "mbed.h"
+#include "Sim.h"
+
+                                                                          // TIMER3 + PPI + TWIM stand-in: a ticker plays the timer and does each read
+                                                                          // through Wire1 (bus time and ImuModel as for any other read), into the ring
+                                                                          // slot the list-mode DMA would use: a failed read doesn't move it on
+
+static mbed::Ticker readTicker;
+static std::atomic<uint64_t> failures(0);                                 // TIMER2 count << 32 | TIMER4 CC[2], both set by the same ERROR
+static uint32_t dmaSlot;                                                  // RXD.PTR, in frames
+static uint32_t nackEvery;                                                // Sim::setTwimNacks()
+
+void Sim::setTwimNacks(uint32_t every)
+{
+  nackEvery = every;
+}
+
+void TwimSampler::irq()
+{
+  TwimSampler* self = _active;
+  if (self == nullptr)
+  {
+    return;
+  }
+  uint32_t n = self->_done.load(std::memory_order_relaxed);
+  uint8_t* dest = self->_ring + dmaSlot * self->_frameBytes;
+  Wire1.beginTransmission(self->_addr);
+  Wire1.write(self->_reg);
+  bool ok = (Wire1.endTransmission(false) == 0) && (Wire1.requestFrom(self->_addr, self->_frameBytes) == self->_frameBytes);
+  ok = ok && !(nackEvery > 0 && n % nackEvery == nackEvery - 1);                // --nack: NACKed after the bus time was spent
+  for (uint8_t i = 0; ok && i < self->_frameBytes; i++)
+  {
+    dest[i] = Wire1.read();
+  }
+  if (ok)
+  {
+    dmaSlot++;
+  }
+  else
+  {
+    failures.store(((failures.load() >> 32) + 1) << 32 | n);
+  }
+  if (((n + 1) & (RING - 1)) == 0)
+  {
+    dmaSlot = 0;                                                                  // TIMER4 interrupt at the end of the lap
+  }
+  self->_done.store(n + 1, std::memory_order_release);
+}
+
+bool TwimSampler::start(uint8_t addr, uint8_t reg, uint8_t frameBytes, uint32_t rate)
+{
+  if (frameBytes == 0 || frameBytes > MAX_FRAME || rate == 0)
+  {
+    return false;
+  }
+  uint32_t us = 1000000UL / rate;                                                 // The ticker runs in whole microseconds
+  _addr = addr;
+  _reg = reg;
+  _frameBytes = frameBytes;
+  _periodTicks = us * 16;
+  _errors = 0;
+  _logged = 0;
+  _lostFrom = 0;
+  _lostTo = 0;
+  _polled = 0;
+  failures.store(0);
+  dmaSlot = 0;
+  _done.store(0);
+  _active = this;
+  _startUs = micros();
+  readTicker.attach_us(&TwimSampler::irq, us);
+  return true;
+}
+
+void TwimSampler::stop()
+{
+  readTicker.detach();
+  _active = nullptr;
+}
+
+uint32_t TwimSampler::completed()
+{
+  uint32_t done = _done.load(std::memory_order_acquire);                          // First, as on the device
+  uint64_t failed = failures.load();
+  if ((uint32_t)(failed >> 32) != _errors)
+  {
+    logFailures((uint32_t)(failed >> 32) - _errors, (uint32_t)failed);
+  }
+  _polled = done;
+  return done;
+}
@@ -0,0 +1,37 @@
+#ifndef SIM_WIRE_H
+#define SIM_WIRE_H
+
+#include "Arduino.h"
+
+class TwoWire : public Stream                                             // Wire1 is routed to the ImuModel, timed at the bus clock
+{
+public:
+  static const uint16_t BUFFER = 256;
+
+  TwoWire(uint8_t bus);
+  void begin() {}
+  void setClock(uint32_t hz);
+  void beginTransmission(uint8_t addr);
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* data, size_t len) override;
+  uint8_t endTransmission(bool stopBit = true);
+  uint8_t requestFrom(uint8_t addr, size_t len, bool stopBit = true);
+  int available() override;
+  int read() override;
+  int peek() override;
+
+private:
+  uint8_t _bus;
+  uint8_t _addr;
+  uint32_t _clock;
+  uint8_t _tx[BUFFER];
+  size_t _txLen;
+  uint8_t _rx[BUFFER];
+  size_t _rxLen;
+  size_t _rxPos;
+};
+
+extern TwoWire Wire;
+extern TwoWire Wire1;
+
+#endif
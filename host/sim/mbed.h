@@ -0,0 +1,89 @@
+#ifndef SIM_MBED_H
+#define SIM_MBED_H
+
+                                                                          // Host simulation of the mbed/RTX pieces the firmware uses, on std::thread
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+typedef enum
+{
+  osPriorityLow = 8,
+  osPriorityBelowNormal = 16,
+  osPriorityNormal = 24,
+  osPriorityAboveNormal = 32,
+  osPriorityHigh = 40,
+  osPriorityRealtime = 48
+} osPriority_t;
+
+#define osWaitForever 0xFFFFFFFFU
+#define osFlagsWaitAny 0x00000000U
+#define osFlagsError 0x80000000U
+#define osFlagsErrorTimeout 0xFFFFFFFEU
+
+namespace mbed
+{
+  typedef std::function<void()> Callback;
+
+  template <class T, class M>
+  Callback callback(T* obj, M method)
+  {
+    return [obj, method]() { (obj->*method)(); };
+  }
+
+  class Ticker                                                            // Periodic callback on its own thread, absolute schedule like the RTC ticker
+  {
+  public:
+    ~Ticker() { detach(); }
+    void attach_us(Callback fn, uint32_t us);
+    void detach();
+
+  private:
+    std::thread _thread;
+    std::mutex _lock;
+    std::condition_variable _wake;
+    bool _run = false;
+  };
+}
+
+namespace rtos
+{
+  class Thread                                                            // Priority is applied when the host allows it (SCHED_FIFO), else ignored
+  {
+  public:
+    Thread(osPriority_t priority = osPriorityNormal, uint32_t stackSize = 4096, unsigned char* stackMem = nullptr, const char* name = nullptr);
+    int start(mbed::Callback task);
+
+  private:
+    osPriority_t _priority;
+    std::thread _thread;
+  };
+
+  class EventFlags
+  {
+  public:
+    uint32_t set(uint32_t flags);
+    uint32_t clear(uint32_t flags = 0x7FFFFFFF);
+    uint32_t get() const;
+    uint32_t wait_any(uint32_t flags, uint32_t millisec = osWaitForever, bool clear = true);
+    uint32_t wait_all(uint32_t flags, uint32_t millisec = osWaitForever, bool clear = true);
+
+  private:
+    mutable std::mutex _lock;
+    std::condition_variable _changed;
+    uint32_t _flags = 0;
+    uint32_t wait(uint32_t flags, uint32_t millisec, bool clear, bool all);
+  };
+
+  namespace ThisThread
+  {
+    void sleep_for(uint32_t ms);
+    void yield();
+  }
+}
+
+#endif
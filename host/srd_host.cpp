@@ -0,0 +1,1749 @@
+// Host receiver/decoder for the framed download (Transfer.h), replaces the polling loop of Recording_device_plotter.m
+// Build:  g++ -O3 -march=native -std=c++17 -o srd_host srd_host.cpp
+// Usage:  srd_host --port /dev/ttyACM0 [--session N] [--save stream.bin] [--csv out.csv] [--bin out.srdb]
+//         srd_host --port /dev/ttyACM0 --live [--save stream.bin] [--csv out.csv] [--bin out.srdb]
+//         srd_host --port /dev/ttyACM0 --resume stream.bin [--csv out.csv] [--bin out.srdb]
+//         srd_host --port /dev/ttyACM0 [--session N] --overview [LEVEL] [--csv envelope.csv]
+//         srd_host --port /dev/ttyACM0 [--session N] --pages FIRST:LAST [--csv out.csv] [--bin out.srdb]
+//         srd_host --port /dev/ttyACM0 --read CHIP:PAGE:COUNT --raw pages.bin
+//         srd_host --dump stream.bin [--csv out.csv] [--bin out.srdb]
+//         srd_host --bench
+// Kept out of the sketch folder root, so the Arduino build doesn't pick it up. POSIX only (termios, mmap).
+
+#include <cctype>
+#include <chrono>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static const uint8_t SYNC = 0xA5;
+static const uint32_t DIR_SEQ = 0xFFFFFFFF;
+static const uint16_t PAGE_SIZE = 256;
+static const uint8_t SCHEMA_PAIR16 = 1;
+static const uint8_t SCHEMA_PACKED16 = 2;
+static const uint8_t SCHEMA_TIMEBASE14 = 3;
+static const uint8_t SCHEMA_CHANNELS = 4;
+static const uint16_t MAX_PAYLOAD = 2 + 128 * 32;                                // DIRECTORY with SessionLog::MAX_SESSIONS entries
+static const uint8_t NAK_BATCH = 64;                                              // Same limits as the MATLAB script
+static const uint8_t NAK_ROUNDS = 20;
+static const uint16_t READ_PAGES = 64;                                            // Pages per READ request
+static const uint8_t READ_AHEAD = 4;                                              // READs kept queued on the device (Transfer::REQUESTS)
+static const uint16_t SUMMARY_BLOCK = 256;                                        // SummaryLog: records per level 0 block
+static const uint8_t SUMMARY_FACTOR = 16;                                         // Level n + 1 blocks hold 16 level n blocks
+static const uint8_t SUMMARY_BLOCK_HEADER = 6;                                    // Session page (u32), records (u16)
+static const uint16_t NO_SUMMARY = 0xFFFF;
+
+enum FrameType
+{
+  HEADER = 0x01, PAGE = 0x02, END = 0x03, DIRECTORY = 0x04, STATS = 0x05, BLOCK = 0x06, SUMMARY = 0x07
+};
+enum Encoding
+{
+  RAW = 0, DELTA_RLE = 1
+};
+
+static const char* SENSORS[4] = {"Accel", "Gyro", "Mag", "Coil"};                // IMUHandler::Sensor order
+static const uint8_t MODES = 12;
+static const uint8_t NONE = 0xFF;
+static const uint8_t MODE_SENSORS[MODES][4] =                                     // SENSORS menu, as ChannelSet::forMode()
+{
+  {0, 3, NONE, NONE}, {0, 1, NONE, NONE}, {0, 2, NONE, NONE}, {1, 2, NONE, NONE}, {1, 3, NONE, NONE}, {2, 3, NONE, NONE},
+  {0, 1, 2, NONE}, {0, 1, 2, 3}, {0, NONE, NONE, NONE}, {1, NONE, NONE, NONE}, {2, NONE, NONE, NONE}, {3, NONE, NONE, NONE}
+};
+
+struct Entry                                                                      // SessionLog::Entry, little-endian like the host
+{
+  uint16_t magic;
+  uint8_t schema;
+  uint8_t mode;
+  uint16_t freq;
+  uint16_t gain;
+  uint8_t init;
+  uint8_t packetSize;
+  uint16_t summaryPage;
+  uint32_t startPage;
+  uint32_t endPage;
+  uint32_t startMillis;
+  uint32_t statsPage;
+  uint16_t preTrigger;
+  uint16_t summaryPages;
+};
+static_assert(sizeof(Entry) == 32, "Entry must match SessionLog::ENTRY_SIZE");
+
+struct Timing                                                                     // RunStats::Timing
+{
+  uint32_t count;
+  uint16_t meanUs;
+  uint16_t maxUs;
+};
+
+struct RunStats                                                                   // RunStats::Record, see RunStats.h
+{
+  uint16_t magic;
+  uint8_t version;
+  uint8_t bins;
+  uint32_t nominalUs;
+  uint32_t binUs;
+  uint32_t samples;
+  uint32_t dropped;
+  uint32_t ticks;
+  uint32_t missedTicks;
+  uint32_t minIntervalUs;
+  uint32_t maxIntervalUs;
+  uint16_t peakQueue;
+  uint16_t peakPages;
+  uint32_t hist[32];
+  Timing read[6];
+  Timing program;
+  Timing busy;
+  uint32_t skippedReads;                                                          // version 2
+  uint32_t summaryDropped;                                                        // version 3
+  uint8_t spare[16];
+};
+static_assert(sizeof(RunStats) == 256, "RunStats must match RunStats::Record");
+static const uint16_t RUN_STATS_MAGIC = 0x5A75;
+
+struct ChannelSet                                                                 // ChannelSet.h, at the start of a SCHEMA_CHANNELS stream
+{
+  uint8_t sensor[4];
+  uint8_t axes[4];
+  uint8_t bits[4];
+  uint8_t timeBits;
+};
+static_assert(sizeof(ChannelSet) == 13, "ChannelSet must match the firmware");
+static const uint8_t CHANNEL_HEADER = 3 + sizeof(ChannelSet) + 8;                 // ['C' 'S'][version][ChannelSet][base time u64]
+static const uint8_t CHANNEL_VERSION = 3;                                         // 3: SPARSE slots, 2: rate records (time delta all ones but bit 0)
+static const uint8_t SPARSE = 0x08;                                               // ChannelSet::axes flag: presence bit ahead of the slot values
+static const uint8_t INIT_ADAPTIVE = 3;                                           // Entry::init of an ADP session
+
+struct Record                                                                     // SCHEMA_PAIR16 record as stored
+{
+  int16_t axis[6];
+  uint32_t micros;
+};
+static_assert(sizeof(Record) == 16, "Record must match SamplePacket");
+
+static uint16_t CRC_TABLE[256];
+
+static void initCrc()
+{
+  for (uint16_t i = 0; i < 256; i++)
+  {
+    uint16_t crc = i << 8;
+    for (uint8_t b = 0; b < 8; b++)
+    {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    CRC_TABLE[i] = crc;
+  }
+}
+
+static uint16_t crc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF)   // CRC-16/CCITT-FALSE, as Transfer::crc16
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    crc = (crc << 8) ^ CRC_TABLE[(crc >> 8) ^ data[i]];
+  }
+  return crc;
+}
+
+static uint16_t rd16(const uint8_t* p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t rd32(const uint8_t* p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int32_t unzigzag(uint32_t u)
+{
+  return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+static bool isErased(const uint8_t* page)                                         // Word-wise, a page is either written or all 0xFF
+{
+  uint64_t acc = ~0ULL;
+  for (uint16_t i = 0; i < PAGE_SIZE; i += 8)
+  {
+    uint64_t w;
+    memcpy(&w, page + i, 8);
+    acc &= w;
+  }
+  return acc == ~0ULL;
+}
+
+static bool decodeDeltaRle(const uint8_t* in, size_t len, uint8_t* page)        // Inverse of Transfer::encodePage
+{
+  uint32_t vals[7 * 16] = {0};
+  size_t j = 0;
+  uint16_t v = 0;
+  while (v < 7 * 16)
+  {
+    if (j >= len)
+    {
+      return false;
+    }
+    bool run = (in[j] == 0);
+    if (run)
+    {
+      j++;
+    }
+    uint32_t u = 0;
+    for (uint8_t sh = 0; ; sh += 7)
+    {
+      if (j >= len || sh > 28)
+      {
+        return false;
+      }
+      uint8_t c = in[j++];
+      u |= (uint32_t)(c & 0x7F) << sh;
+      if (c < 0x80)
+      {
+        break;
+      }
+    }
+    if (run)
+    {
+      v += u + 1;                                                                 // vals are already zero
+    }
+    else
+    {
+      vals[v++] = u;
+    }
+  }
+  for (uint8_t col = 0; col < 7; col++)
+  {
+    int16_t prev = 0;
+    uint32_t t = 0, delta = 0;
+    for (uint8_t p = 0; p < 16; p++)
+    {
+      uint8_t* rec = page + p * 16;
+      if (col < 6)
+      {
+        prev = (int16_t)(prev + unzigzag(vals[col * 16 + p]));
+        memcpy(rec + col * 2, &prev, 2);
+      }
+      else
+      {
+        delta += (uint32_t)unzigzag(vals[col * 16 + p]);
+        t += delta;
+        memcpy(rec + 12, &t, 4);
+      }
+    }
+  }
+  return true;
+}
+
+static uint32_t getBits(const uint8_t* data, uint32_t& pos, uint8_t width)
+{
+  uint32_t v = 0;
+  for (uint8_t i = 0; i < width; i++, pos++)
+  {
+    v |= (uint32_t)((data[pos >> 3] >> (pos & 7)) & 1) << i;
+  }
+  return v;
+}
+
+static void decodePacked(const uint8_t* page, std::vector<Record>& out)          // Inverse of PageCodec, see PageCodec.h
+{
+  uint16_t count = rd16(page);
+  if (count == 0 || count > 1 + (PAGE_SIZE - 2 - sizeof(Record)) * 8 / 42 * 8)   // Erased, or more than PageCodec::RECORDS
+  {
+    return;
+  }
+  Record rec;
+  memcpy(&rec, page + 2, sizeof(rec));
+  out.push_back(rec);
+  const uint8_t* data = page + 2 + sizeof(Record);
+  const uint32_t limit = (PAGE_SIZE - 2 - sizeof(Record)) * 8;
+  uint32_t pos = 0, delta = 0;
+  uint32_t block[8][7];
+  for (uint16_t done = 1; done < count; )
+  {
+    uint8_t n = (count - done < 8) ? count - done : 8;
+    for (uint8_t c = 0; c < 7; c++)
+    {
+      if (pos + 6 > limit)
+      {
+        return;
+      }
+      uint8_t w = getBits(data, pos, 6);
+      if (w > 32 || pos + (uint32_t)n * w > limit)                                // Corrupt page, keep what decoded
+      {
+        return;
+      }
+      for (uint8_t i = 0; i < n; i++)
+      {
+        block[i][c] = getBits(data, pos, w);
+      }
+    }
+    for (uint8_t i = 0; i < n; i++, done++)
+    {
+      for (uint8_t c = 0; c < 6; c++)
+      {
+        rec.axis[c] = (int16_t)(rec.axis[c] + unzigzag(block[i][c]));
+      }
+      delta += (uint32_t)unzigzag(block[i][6]);
+      rec.micros += delta;
+      out.push_back(rec);
+    }
+  }
+}
+
+static void decodeTimeBase(const uint8_t* page, std::vector<Record>& out, std::vector<uint64_t>& times)   // Inverse of TimeBaseCodec
+{
+  uint16_t count = rd16(page);
+  if (count == 0 || count > (PAGE_SIZE - 10) / 14)
+  {
+    return;
+  }
+  uint64_t t;
+  memcpy(&t, page + 2, 8);
+  for (uint16_t i = 0; i < count; i++)
+  {
+    const uint8_t* p = page + 10 + i * 14;
+    t += rd16(p + 12);
+    Record rec;
+    memcpy(rec.axis, p, 12);
+    rec.micros = (uint32_t)t;
+    out.push_back(rec);
+    times.push_back(t);
+  }
+}
+
+class Receiver                                                                    // Frame parser; pages stay where they arrived (zero-copy)
+{
+public:
+  std::vector<Entry> sessions;
+  bool haveDirectory = false;
+  bool haveHeader = false;
+  uint16_t session = 0;
+  uint32_t frames = 0;
+  bool live = false;                                                              // STREAM: HEADER without a frame count, END brings it
+  Entry entry = {};
+  bool haveEnd = false;
+  uint32_t stats[3] = {0, 0, 0};                                                  // Elapsed ms, bytes sent, bytes read from flash
+  uint32_t badFrames = 0;
+  bool haveRunStats = false;                                                      // STATS frame of the selected session, if it was saved
+  RunStats runStats = {};
+  uint8_t rawChip = 0;                                                            // READ: BLOCK frames of this range land in raw
+  uint32_t rawFirst = 0;
+  std::vector<uint8_t> raw;
+  std::vector<bool> rawHave;
+  uint32_t rawGot = 0;
+  uint32_t wantFirst = 0;                                                         // --pages: session pages asked for, the rest is not NAKed
+  uint32_t wantEnd = UINT32_MAX;
+  std::vector<uint8_t> summary;                                                   // OVERVIEW: blocks of the level asked for, by block index
+  std::vector<bool> summaryHave;
+  uint8_t summaryChannels = 0;
+  uint32_t summaryFrames = 0;
+  bool haveSummaryEnd = false;
+  uint32_t summarySent = 0;                                                       // Frames the device sent, from the last SUMMARY frame
+
+  size_t feed(const uint8_t* buf, size_t n, size_t base)                          // base - offset of buf in the stream, returns bytes consumed
+  {
+    size_t i = 0;
+    while (i + 10 <= n)
+    {
+      if (buf[i] != SYNC)
+      {
+        i++;
+        continue;
+      }
+      uint16_t len = rd16(buf + i + 6);
+      if (len > MAX_PAYLOAD)                                                      // Not a frame start, don't wait for a bogus length
+      {
+        i++;
+        continue;
+      }
+      if (i + 10 + len > n)
+      {
+        break;                                                                    // Incomplete, wait for more
+      }
+      const uint8_t* body = buf + i + 1;
+      if (crc16(body, 7 + len) != rd16(body + 7 + len))
+      {
+        badFrames++;
+        i++;
+        continue;
+      }
+      frame(body[0], rd32(body + 1), body + 7, len, base + i + 8);
+      i += 10 + len;
+    }
+    return i;
+  }
+
+  void select()                                                                   // Forget the previous session before a new GET
+  {
+    haveHeader = haveEnd = false;
+    _pages.clear();
+    _decoded.clear();
+  }
+
+  uint32_t pageCount() const                                                      // Live: pages seen so far until END
+  {
+    return !haveHeader ? 0 : (frames >= 2) ? frames - 2 : (uint32_t)_pages.size();
+  }
+
+  uint32_t nextSeq() const                                                        // After the newest page frame received, where RESUME continues
+  {
+    return haveEnd ? frames - 1 : (uint32_t)_pages.size() + 1;
+  }
+
+  void readRange(uint8_t chip, uint32_t first, uint32_t count)
+  {
+    rawChip = chip;
+    rawFirst = first;
+    raw.assign((size_t)count * PAGE_SIZE, 0xFF);
+    rawHave.assign(count, false);
+    rawGot = 0;
+  }
+
+  const uint8_t* page(uint32_t index, const uint8_t* stream) const                // nullptr - not received
+  {
+    if (index >= _pages.size() || _pages[index] == MISSING)
+    {
+      return nullptr;
+    }
+    int64_t ref = _pages[index];
+    return (ref >= 0) ? stream + ref : _decoded.data() + (size_t)(-ref - 1) * PAGE_SIZE;
+  }
+
+  void missing(std::vector<uint32_t>& out, size_t max) const
+  {
+    out.clear();
+    if (!haveHeader)
+    {
+      out.push_back(0);
+      return;
+    }
+    uint32_t end = std::min(pageCount(), wantEnd);
+    for (uint32_t i = wantFirst; i < end && out.size() < max; i++)
+    {
+      if (i >= _pages.size() || _pages[i] == MISSING)
+      {
+        out.push_back(i + 1);
+      }
+    }
+    if (!haveEnd && frames >= 2 && wantEnd >= pageCount() && out.size() < max)
+    {
+      out.push_back(frames - 1);
+    }
+  }
+
+private:
+  static constexpr int64_t MISSING = INT64_MIN;
+  std::vector<int64_t> _pages;                                                    // >= 0: offset of the data in the stream, < 0: -(slot + 1) in _decoded
+  std::vector<uint8_t> _decoded;
+
+  void frame(uint8_t type, uint32_t seq, const uint8_t* p, uint16_t len, size_t offset)
+  {
+    if (type == DIRECTORY && len >= 2)
+    {
+      uint16_t count = rd16(p);
+      sessions.resize(count);
+      for (uint16_t k = 0; k < count && 2 + (k + 1) * sizeof(Entry) <= len; k++)
+      {
+        memcpy(&sessions[k], p + 2 + k * sizeof(Entry), sizeof(Entry));
+      }
+      haveDirectory = true;
+    }
+    else if (type == STATS && len >= 2 + sizeof(RunStats) && rd16(p + 2) == RUN_STATS_MAGIC)
+    {
+      memcpy(&runStats, p + 2, sizeof(RunStats));
+      haveRunStats = true;
+    }
+    else if (type == HEADER && len >= 10 + sizeof(Entry) && memcmp(p, "SRD", 3) == 0)
+    {
+      session = rd16(p + 4);
+      frames = rd32(p + 6);
+      live = live || (frames == 0);
+      memcpy(&entry, p + 10, sizeof(Entry));
+      haveHeader = true;
+    }
+    else if (type == END && len >= 12)
+    {
+      if (frames < 2)
+      {
+        frames = seq + 1;                                                         // Live: the session is closed, its size is final
+      }
+      for (uint8_t k = 0; k < 3; k++)
+      {
+        stats[k] = rd32(p + 4 * k);
+      }
+      haveEnd = true;
+    }
+    else if (type == BLOCK && len == 4 + PAGE_SIZE && p[0] == rawChip && seq - rawFirst < rawHave.size())
+    {
+      uint32_t k = seq - rawFirst;
+      if (!rawHave[k])
+      {
+        memcpy(raw.data() + (size_t)k * PAGE_SIZE, p + 4, PAGE_SIZE);
+        rawHave[k] = true;
+        rawGot++;
+      }
+    }
+    else if (type == SUMMARY && len == 6)
+    {
+      summarySent = rd32(p + 2);
+      haveSummaryEnd = true;
+    }
+    else if (type == SUMMARY && len >= 2 + 8 && p[4] > 0)
+    {
+      uint8_t channels = p[3];
+      size_t size = SUMMARY_BLOCK_HEADER + channels * 8;
+      uint32_t first = rd32(p + 6);
+      size_t blocks = std::min<size_t>(p[4], (len - 10) / size);
+      summaryChannels = channels;
+      if (first + blocks > summaryHave.size())
+      {
+        summaryHave.resize(first + blocks, false);
+        summary.resize(summaryHave.size() * size);
+      }
+      memcpy(summary.data() + first * size, p + 10, blocks * size);
+      for (size_t k = 0; k < blocks; k++)
+      {
+        summaryHave[first + k] = true;
+      }
+      summaryFrames++;
+    }
+    else if (type == PAGE && seq > 0 && len > 4)
+    {
+      uint32_t index = seq - 1;
+      if (index >= _pages.size())
+      {
+        _pages.resize(index + 1, MISSING);
+      }
+      if (p[3] == RAW && len == 4 + PAGE_SIZE)
+      {
+        _pages[index] = offset + 4;
+      }
+      else if (p[3] == DELTA_RLE)
+      {
+        size_t slot = _decoded.size() / PAGE_SIZE;
+        _decoded.resize(_decoded.size() + PAGE_SIZE);
+        if (decodeDeltaRle(p + 4, len - 4, _decoded.data() + slot * PAGE_SIZE))
+        {
+          _pages[index] = -(int64_t)slot - 1;
+        }
+        else
+        {
+          _decoded.resize(slot * PAGE_SIZE);
+          badFrames++;
+        }
+      }
+    }
+  }
+};
+
+static size_t decodeRecords(const Receiver& rx, const uint8_t* stream, std::vector<Record>& out, std::vector<uint64_t>& times, uint32_t& lost,
+                            uint32_t& erased)                                     // times: 64-bit record times, SCHEMA_TIMEBASE14 only
+{
+  out.clear();
+  times.clear();
+  out.reserve((size_t)rx.pageCount() * (PAGE_SIZE / sizeof(Record)));
+  lost = erased = 0;
+  for (uint32_t i = rx.wantFirst; i < std::min(rx.pageCount(), rx.wantEnd); i++)
+  {
+    const uint8_t* page = rx.page(i, stream);
+    if (page == nullptr)
+    {
+      lost++;
+    }
+    else if (isErased(page))                                                      // Unwritten pages of a recovered session
+    {
+      erased++;
+    }
+    else if (rx.entry.schema == SCHEMA_PACKED16)
+    {
+      decodePacked(page, out);
+    }
+    else if (rx.entry.schema == SCHEMA_TIMEBASE14)
+    {
+      decodeTimeBase(page, out, times);
+    }
+    else
+    {
+      size_t at = out.size();
+      out.resize(at + PAGE_SIZE / sizeof(Record));
+      memcpy(&out[at], page, PAGE_SIZE);
+    }
+  }
+  return out.size();
+}
+
+static const uint8_t MAX_COLUMNS = 12;
+static const int16_t MISSING = INT16_MIN;                                         // Value of a sparse column in records without it
+
+struct Columns
+{
+  std::vector<uint64_t> micros;                                                   // Relative to the first record, uint32 wrap undone
+  uint8_t count = 0;
+  char names[MAX_COLUMNS][8];                                                     // "Accel_x"
+  std::vector<int16_t> axis[MAX_COLUMNS];                                         // Pair layouts: S1 x y z, S2 x y z
+  bool sparse[MAX_COLUMNS] = {};                                                  // MISSING where the slot was not read on a tick
+  std::vector<std::pair<size_t, uint8_t>> rates;                                  // ADP: first record and divider of every rate change
+};
+
+static void nameColumn(Columns& c, uint8_t sensor, uint8_t axis)
+{
+  char suffix = (sensor == 3) ? '1' + axis : 'x' + axis;                           // Coil: sub-samples within the record period, oldest first
+  snprintf(c.names[c.count++], sizeof(c.names[0]), "%s_%c", SENSORS[sensor & 3], suffix);
+}
+
+static std::string modeName(uint8_t mode)                                         // "Accel & Gyro"
+{
+  std::string s;
+  for (uint8_t k = 0; k < 4 && MODE_SENSORS[mode % MODES][k] != NONE; k++)
+  {
+    s += (k ? " & " : "");
+    s += SENSORS[MODE_SENSORS[mode % MODES][k]];
+  }
+  return s;
+}
+
+static void splitAxes(const Record* rec, size_t n, int16_t* const* cols)
+{
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 8 <= n; i += 8)                                                      // 8 records = 8 x 8 int16, transposed in registers
+  {
+    const __m128i* p = (const __m128i*)(rec + i);
+    __m128i r0 = _mm_loadu_si128(p + 0), r1 = _mm_loadu_si128(p + 1);
+    __m128i r2 = _mm_loadu_si128(p + 2), r3 = _mm_loadu_si128(p + 3);
+    __m128i r4 = _mm_loadu_si128(p + 4), r5 = _mm_loadu_si128(p + 5);
+    __m128i r6 = _mm_loadu_si128(p + 6), r7 = _mm_loadu_si128(p + 7);
+    __m128i a0 = _mm_unpacklo_epi16(r0, r1), a1 = _mm_unpackhi_epi16(r0, r1);
+    __m128i a2 = _mm_unpacklo_epi16(r2, r3), a3 = _mm_unpackhi_epi16(r2, r3);
+    __m128i a4 = _mm_unpacklo_epi16(r4, r5), a5 = _mm_unpackhi_epi16(r4, r5);
+    __m128i a6 = _mm_unpacklo_epi16(r6, r7), a7 = _mm_unpackhi_epi16(r6, r7);
+    __m128i b0 = _mm_unpacklo_epi32(a0, a2), b1 = _mm_unpackhi_epi32(a0, a2);    // Columns 0-1 and 2-3 of records 0-3
+    __m128i b2 = _mm_unpacklo_epi32(a4, a6), b3 = _mm_unpackhi_epi32(a4, a6);    // ... of records 4-7
+    __m128i b4 = _mm_unpacklo_epi32(a1, a3), b5 = _mm_unpacklo_epi32(a5, a7);    // Columns 4-5 (6-7 are the time, done separately)
+    _mm_storeu_si128((__m128i*)(cols[0] + i), _mm_unpacklo_epi64(b0, b2));
+    _mm_storeu_si128((__m128i*)(cols[1] + i), _mm_unpackhi_epi64(b0, b2));
+    _mm_storeu_si128((__m128i*)(cols[2] + i), _mm_unpacklo_epi64(b1, b3));
+    _mm_storeu_si128((__m128i*)(cols[3] + i), _mm_unpackhi_epi64(b1, b3));
+    _mm_storeu_si128((__m128i*)(cols[4] + i), _mm_unpacklo_epi64(b4, b5));
+    _mm_storeu_si128((__m128i*)(cols[5] + i), _mm_unpackhi_epi64(b4, b5));
+  }
+#endif
+  for (; i < n; i++)
+  {
+    for (uint8_t c = 0; c < 6; c++)
+    {
+      cols[c][i] = rec[i].axis[c];
+    }
+  }
+}
+
+static void toColumns(const std::vector<Record>& rec, const std::vector<uint64_t>& times, uint8_t mode, Columns& out)
+{
+  size_t n = rec.size();
+  out.micros.resize(n);
+  out.count = 0;
+  for (uint8_t k = 0; k < 2; k++)
+  {
+    for (uint8_t a = 0; a < 3; a++)
+    {
+      nameColumn(out, MODE_SENSORS[mode % MODES][k], a);
+    }
+  }
+  int16_t* cols[6];
+  for (uint8_t c = 0; c < 6; c++)
+  {
+    out.axis[c].resize(n);
+    cols[c] = out.axis[c].data();
+  }
+  splitAxes(rec.data(), n, cols);
+  if (times.size() == n && n > 0)                                                 // Page time base: exact even across lost pages
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      out.micros[i] = times[i] - times[0];
+    }
+    return;
+  }
+  uint64_t t = 0;
+  for (size_t i = 0; i < n; i++)
+  {
+    if (i > 0)
+    {
+      t += (uint32_t)(rec[i].micros - rec[i - 1].micros);                         // micros() wraps every 71 minutes
+    }
+    out.micros[i] = t;
+  }
+}
+
+static uint32_t streamBits(const std::vector<const uint8_t*>& pages, uint64_t& pos, uint8_t width)   // LSB first, across page ends
+{
+  uint32_t v = 0;
+  for (uint8_t i = 0; i < width; i++, pos++)
+  {
+    const uint8_t* page = pages[pos / (PAGE_SIZE * 8)];
+    v |= (uint32_t)((page[(pos >> 3) % PAGE_SIZE] >> (pos & 7)) & 1) << i;
+  }
+  return v;
+}
+
+static size_t decodeChannels(const Receiver& rx, const uint8_t* stream, Columns& out, uint32_t& lost, uint32_t& erased)   // Inverse of ChannelPacker
+{
+  out.micros.clear();
+  out.rates.clear();
+  out.count = 0;
+  lost = erased = 0;
+  std::vector<const uint8_t*> pages(rx.pageCount());
+  for (uint32_t i = 0; i < pages.size(); i++)
+  {
+    pages[i] = rx.page(i, stream);
+    lost += (pages[i] == nullptr);
+    erased += (pages[i] != nullptr && isErased(pages[i]));                        // Unwritten pages of a recovered session
+  }
+  const uint8_t* first = pages.empty() ? nullptr : pages[0];
+  if (first == nullptr || first[0] != 'C' || first[1] != 'S' || first[2] == 0 || first[2] > CHANNEL_VERSION)
+  {
+    return 0;                                                                     // The channel set is in the first page, nothing decodes without it
+  }
+  ChannelSet set;
+  uint64_t t, t0;
+  memcpy(&set, first + 3, sizeof(set));
+  memcpy(&t, first + 3 + sizeof(set), 8);
+  t0 = t;
+  uint8_t width[MAX_COLUMNS];
+  uint32_t recordBits = set.timeBits;                                             // Longest record: every sparse slot present
+  bool sparse = false;
+  for (uint8_t k = 0; k < 4 && set.sensor[k] != NONE; k++)
+  {
+    recordBits += (set.axes[k] & SPARSE) ? 1 : 0;
+    sparse |= (set.axes[k] & SPARSE) != 0;
+    for (uint8_t a = 0; a < 3; a++)
+    {
+      if ((set.axes[k] >> a) & 1 && out.count < MAX_COLUMNS)
+      {
+        width[out.count] = set.bits[k];
+        recordBits += set.bits[k];
+        out.sparse[out.count] = (set.axes[k] & SPARSE) != 0;
+        nameColumn(out, set.sensor[k], a);
+      }
+    }
+  }
+  if (out.count == 0 || set.timeBits == 0 || set.timeBits > 31)
+  {
+    return 0;
+  }
+  for (uint8_t c = 0; c < out.count; c++)
+  {
+    out.axis[c].clear();
+  }
+
+  const uint64_t end = (uint64_t)pages.size() * PAGE_SIZE * 8;
+  const uint32_t endMark = (1u << set.timeBits) - 1;
+  const uint32_t rateMark = (first[2] > 1) ? endMark - 1 : endMark;              // Version 1: no rate records
+  const double periodUs = rx.entry.freq ? 1e6 / rx.entry.freq : 0;
+  auto readable = [&](uint64_t p, uint32_t n)
+  {
+    return p + n <= end && pages[p / (PAGE_SIZE * 8)] != nullptr && pages[(p + n - 1) / (PAGE_SIZE * 8)] != nullptr;
+  };
+  uint32_t lastDelta = 0;
+  int16_t v[MAX_COLUMNS];
+  for (uint64_t pos = CHANNEL_HEADER * 8; pos < end; )
+  {
+    uint64_t p = pos;
+    bool cut = false;
+    uint8_t c = 0;
+    for (uint8_t k = 0; k < 4 && set.sensor[k] != NONE && !cut; k++)
+    {
+      bool present = true;
+      if (set.axes[k] & SPARSE)
+      {
+        cut = !readable(p, 1);
+        present = !cut && streamBits(pages, p, 1);
+      }
+      for (uint8_t a = 0; a < 3 && !cut && c < out.count; a++)
+      {
+        if (!((set.axes[k] >> a) & 1))
+        {
+          continue;
+        }
+        cut = present && !readable(p, width[c]);
+        if (!cut)
+        {
+          uint32_t x = present ? streamBits(pages, p, width[c]) : 0;
+          v[c] = present ? (int16_t)((int32_t)(x << (32 - width[c])) >> (32 - width[c])) : MISSING;
+          c++;
+        }
+      }
+    }
+    if (cut || !readable(p, set.timeBits))
+    {
+      if (sparse || pos + recordBits > end)                                       // Records of varying size: nothing after a lost page can be found
+      {
+        break;
+      }
+      t += lastDelta;                                                             // Fixed-size records: a lost page costs only its own, the time
+      pos += recordBits;                                                          // delta lost with the record is assumed to be the previous one
+      continue;
+    }
+    uint32_t delta = streamBits(pages, p, set.timeBits);
+    pos = p;
+    if (delta == endMark)                                                         // Erased rest of the last page
+    {
+      break;
+    }
+    if (delta == rateMark)                                                        // The records after it are 1 in divider of the full rate
+    {
+      uint8_t divider = (uint8_t)v[0];
+      out.rates.push_back({out.micros.size(), divider});
+      lastDelta = (uint32_t)(divider * periodUs + 0.5);                           // What a lost record of the new rate is assumed to take
+      continue;
+    }
+    t += delta;
+    lastDelta = delta;
+    out.micros.push_back(t - t0);
+    for (uint8_t c = 0; c < out.count; c++)
+    {
+      out.axis[c].push_back(v[c]);
+    }
+  }
+  return out.micros.size();
+}
+
+class OutBuffer                                                                   // Large fwrite()s instead of one per value
+{
+public:
+  OutBuffer(FILE* f) : _file(f), _buf(1 << 20), _n(0) {}
+  ~OutBuffer() { flush(); }
+
+  char* reserve(size_t len)
+  {
+    if (_n + len > _buf.size())
+    {
+      flush();
+    }
+    return _buf.data() + _n;
+  }
+  void commit(size_t len) { _n += len; }
+  void write(const void* data, size_t len)
+  {
+    flush();
+    fwrite(data, 1, len, _file);
+  }
+  void flush()
+  {
+    if (_n > 0)
+    {
+      fwrite(_buf.data(), 1, _n, _file);
+    }
+    _n = 0;
+  }
+
+private:
+  FILE* _file;
+  std::vector<char> _buf;
+  size_t _n;
+};
+
+static void writeCsv(const Columns& c, FILE* f)
+{
+  OutBuffer out(f);
+  char* p = out.reserve(160);
+  int len = snprintf(p, 160, "t_sec");
+  for (uint8_t k = 0; k < c.count; k++)
+  {
+    len += snprintf(p + len, 160 - len, ",%s", c.names[k]);
+  }
+  p[len++] = '\n';
+  out.commit(len);
+  for (size_t i = 0; i < c.micros.size(); i++)
+  {
+    char* start = out.reserve(160);
+    char* q = start;
+    uint64_t sec = c.micros[i] / 1000000, us = c.micros[i] % 1000000;          // Seconds with 6 exact decimals, no floating point
+    q = std::to_chars(q, start + 160, sec).ptr;
+    *q++ = '.';
+    for (int d = 5; d >= 0; d--, us /= 10)
+    {
+      q[d] = '0' + us % 10;
+    }
+    q += 6;
+    for (uint8_t k = 0; k < c.count; k++)
+    {
+      *q++ = ',';
+      if (!c.sparse[k] || c.axis[k][i] != MISSING)                               // Empty field: not read on this tick
+      {
+        q = std::to_chars(q, start + 160, c.axis[k][i]).ptr;
+      }
+    }
+    *q++ = '\n';
+    out.commit(q - start);
+  }
+}
+
+struct BinHeader                                                                  // .srdb: this header, 8-byte column names, micros (u64) column,
+{                                                                                 // then the int16 columns (-32768 where a sparse slot was not read)
+  char magic[4];
+  uint8_t version;
+  uint8_t mode;
+  uint16_t freq;
+  uint16_t gain;
+  uint8_t init;
+  uint8_t schema;
+  uint8_t columns;
+  uint8_t reserved[3];
+  uint64_t count;
+};
+static_assert(sizeof(BinHeader) == 24, "BinHeader layout");
+
+static void writeBin(const Columns& c, const Entry& e, FILE* f)
+{
+  OutBuffer out(f);
+  BinHeader h = {{'S', 'R', 'D', 'B'}, 2, e.mode, e.freq, e.gain, e.init, e.schema, c.count, {0, 0, 0}, c.micros.size()};
+  out.write(&h, sizeof(h));
+  out.write(c.names, c.count * sizeof(c.names[0]));
+  out.write(c.micros.data(), c.micros.size() * sizeof(uint64_t));
+  for (uint8_t k = 0; k < c.count; k++)
+  {
+    out.write(c.axis[k].data(), c.axis[k].size() * sizeof(int16_t));
+  }
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void printSessions(const std::vector<Entry>& sessions)
+{
+  static const char* INITS[3] = {"TIM", "HIT", "STR"};
+  printf(" #  Sensors                    Freq   Gain  Init    Pages  Schema\n");
+  for (size_t k = 0; k < sessions.size(); k++)
+  {
+    const Entry& e = sessions[k];
+    printf("%2zu  %-25s %5u  %5u  %-4s %8u  %u\n", k, modeName(e.mode).c_str(), e.freq, e.gain,
+           INITS[(e.init < 3) ? e.init : 0], e.endPage - e.startPage, e.schema);
+  }
+}
+
+static int openPort(const char* path)
+{
+  int fd = open(path, O_RDWR | O_NOCTTY);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  termios tio;
+  tcgetattr(fd, &tio);
+  cfmakeraw(&tio);
+  cfsetspeed(&tio, B921600);                                                      // USB CDC ignores it, kept for UART bridges
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 1;                                                            // read() blocks up to 100 ms
+  tcsetattr(fd, TCSANOW, &tio);
+  tcflush(fd, TCIOFLUSH);
+  return fd;
+}
+
+struct Link                                                                       // Open port and how far the saved stream is parsed
+{
+  int fd;
+  size_t parsed;
+
+  bool pump(std::vector<uint8_t>& stream, Receiver& rx)                           // One blocking read, false - nothing arrived
+  {
+    uint8_t chunk[1 << 16];
+    ssize_t got = read(fd, chunk, sizeof(chunk));
+    if (got <= 0)
+    {
+      return false;
+    }
+    stream.insert(stream.end(), chunk, chunk + got);
+    parsed += rx.feed(stream.data() + parsed, stream.size() - parsed, parsed);
+    return true;
+  }
+};
+
+static bool collect(Link& link, std::vector<uint8_t>& stream, Receiver& rx)       // Until every frame is in (NAK rounds), then ACK
+{
+  std::vector<uint32_t> missing;
+  uint8_t rounds = 0;
+  uint32_t lastReport = 0;
+  auto quiet = std::chrono::steady_clock::now();
+  while (true)
+  {
+    if (link.pump(stream, rx))
+    {
+      quiet = std::chrono::steady_clock::now();
+      uint32_t mb = stream.size() >> 20;
+      if (rx.haveHeader && mb != lastReport)
+      {
+        printf("\rProgress: %u MB", mb);
+        fflush(stdout);
+        lastReport = mb;
+      }
+      continue;
+    }
+    rx.missing(missing, NAK_BATCH);
+    if (rx.haveHeader && missing.empty())
+    {
+      uint8_t ack = 'A';                                                          // Everything received
+      write(link.fd, &ack, 1);
+      return true;
+    }
+    double idle = secondsSince(quiet);
+    if (idle > 0.5 && rx.haveHeader && rounds < NAK_ROUNDS)
+    {
+      for (uint32_t seq : missing)                                                // Ask for lost/corrupt frames again
+      {
+        uint8_t nak[5] = {'N', (uint8_t)seq, (uint8_t)(seq >> 8), (uint8_t)(seq >> 16), (uint8_t)(seq >> 24)};
+        write(link.fd, nak, sizeof(nak));
+      }
+      rounds++;
+      quiet = std::chrono::steady_clock::now();
+    }
+    else if (idle > 15)
+    {
+      printf("\n[!] Timeout. Processing received data.\n");
+      return false;
+    }
+  }
+}
+
+static void waitDirectory(Link& link, std::vector<uint8_t>& stream, Receiver& rx)
+{
+  printf("Waiting for session directory...\n");
+  rx.haveDirectory = false;
+  auto quiet = std::chrono::steady_clock::now();
+  while (!rx.haveDirectory)                                                       // Sent by the device on GETDATA
+  {
+    if (link.pump(stream, rx))
+    {
+      quiet = std::chrono::steady_clock::now();
+    }
+    else if (secondsSince(quiet) > 2)
+    {
+      uint8_t cmd = 'L';                                                          // Ask again (started late)
+      write(link.fd, &cmd, 1);
+      quiet = std::chrono::steady_clock::now();
+    }
+  }
+}
+
+static bool receive(const char* path, int index, std::vector<uint8_t>& stream, Receiver& rx)
+{
+  Link link = {openPort(path), 0};
+  if (link.fd < 0)
+  {
+    fprintf(stderr, "Port %s unavailable.\n", path);
+    return false;
+  }
+
+  waitDirectory(link, stream, rx);
+  printSessions(rx.sessions);
+  if (rx.sessions.empty())
+  {
+    fprintf(stderr, "No sessions on the device.\n");
+    close(link.fd);
+    return false;
+  }
+  uint16_t idx = (index < 0) ? rx.sessions.size() - 1 : index;
+  uint8_t stat[3] = {'S', (uint8_t)(idx & 0xFF), (uint8_t)(idx >> 8)};           // Answered before the GET below
+  uint8_t get[3] = {'G', (uint8_t)(idx & 0xFF), (uint8_t)(idx >> 8)};
+  uint32_t from = rx.wantFirst + 1;                                               // --pages: RESUME at the first page, ACK once the last one is in
+  uint8_t resume[7] = {'C', (uint8_t)(idx & 0xFF), (uint8_t)(idx >> 8), (uint8_t)from, (uint8_t)(from >> 8), (uint8_t)(from >> 16), (uint8_t)(from >> 24)};
+  rx.select();
+  write(link.fd, stat, sizeof(stat));
+  if (rx.wantFirst > 0 || rx.wantEnd != UINT32_MAX)
+  {
+    write(link.fd, resume, sizeof(resume));
+    printf(">>> Downloading pages %u-%u of session %u...\n", rx.wantFirst, std::min(rx.wantEnd, rx.sessions[idx].endPage - rx.sessions[idx].startPage) - 1, idx);
+  }
+  else
+  {
+    write(link.fd, get, sizeof(get));
+    printf(">>> Downloading session %u...\n", idx);
+  }
+
+  bool ok = collect(link, stream, rx);
+  printf("\n");
+  close(link.fd);
+  return ok || rx.haveHeader;
+}
+
+static bool resume(const char* path, std::vector<uint8_t>& stream, Receiver& rx)   // Continues the interrupted download saved in stream
+{
+  Link link = {openPort(path), stream.size()};
+  if (link.fd < 0)
+  {
+    fprintf(stderr, "Port %s unavailable.\n", path);
+    return false;
+  }
+  waitDirectory(link, stream, rx);
+  uint16_t idx = rx.session;
+  if (idx >= rx.sessions.size() || memcmp(&rx.sessions[idx], &rx.entry, sizeof(Entry)) != 0)
+  {
+    fprintf(stderr, "Session %u on the device is not the one in the saved stream.\n", idx);
+    close(link.fd);
+    return false;
+  }
+  uint32_t from = rx.nextSeq();                                                   // Holes below it are NAKed by collect()
+  uint8_t cmd[7] = {'C', (uint8_t)(idx & 0xFF), (uint8_t)(idx >> 8), (uint8_t)from, (uint8_t)(from >> 8), (uint8_t)(from >> 16), (uint8_t)(from >> 24)};
+  uint8_t stat[3] = {'S', (uint8_t)(idx & 0xFF), (uint8_t)(idx >> 8)};
+  write(link.fd, stat, sizeof(stat));
+  write(link.fd, cmd, sizeof(cmd));
+  printf(">>> Resuming session %u at frame %u of %u...\n", idx, from, rx.frames);
+
+  bool ok = collect(link, stream, rx);
+  printf("\n");
+  close(link.fd);
+  return ok;
+}
+
+static bool overview(const char* path, int index, uint8_t level, std::vector<uint8_t>& stream, Receiver& rx)
+{
+  Link link = {openPort(path), 0};
+  if (link.fd < 0)
+  {
+    fprintf(stderr, "Port %s unavailable.\n", path);
+    return false;
+  }
+  waitDirectory(link, stream, rx);
+  printSessions(rx.sessions);
+  if (rx.sessions.empty())
+  {
+    fprintf(stderr, "No sessions on the device.\n");
+    close(link.fd);
+    return false;
+  }
+  uint16_t idx = (index < 0) ? rx.sessions.size() - 1 : index;
+  rx.session = idx;
+  rx.entry = rx.sessions[idx];
+  if (rx.entry.summaryPage == NO_SUMMARY)
+  {
+    fprintf(stderr, "Session %u was recorded without summaries.\n", idx);
+    close(link.fd);
+    return false;
+  }
+  uint8_t cmd[4] = {'O', (uint8_t)(idx & 0xFF), (uint8_t)(idx >> 8), level};
+  bool ok = false;
+  for (uint8_t round = 0; round < NAK_ROUNDS && !ok; round++)                     // A few KB: asked again whole if a frame was lost
+  {
+    rx.summaryFrames = 0;
+    rx.haveSummaryEnd = false;
+    write(link.fd, cmd, sizeof(cmd));
+    auto quiet = std::chrono::steady_clock::now();
+    while (!rx.haveSummaryEnd && secondsSince(quiet) < 2)
+    {
+      if (link.pump(stream, rx))
+      {
+        quiet = std::chrono::steady_clock::now();
+      }
+    }
+    ok = rx.haveSummaryEnd && rx.summaryFrames == rx.summarySent;
+  }
+  uint8_t ack = 'A';
+  write(link.fd, &ack, 1);
+  close(link.fd);
+  return ok;
+}
+
+static bool writeOverview(const Receiver& rx, uint8_t level, const char* csvPath)   // Envelope table on stdout, CSV if asked for
+{
+  Columns names;
+  for (uint8_t k = 0; k < 4 && MODE_SENSORS[rx.entry.mode % MODES][k] != NONE && names.count < rx.summaryChannels; k++)
+  {
+    for (uint8_t a = 0; a < 3; a++)
+    {
+      nameColumn(names, MODE_SENSORS[rx.entry.mode % MODES][k], a);
+    }
+  }
+  uint32_t span = SUMMARY_BLOCK;
+  for (uint8_t l = 0; l < level; l++)
+  {
+    span *= SUMMARY_FACTOR;
+  }
+  size_t size = SUMMARY_BLOCK_HEADER + rx.summaryChannels * 8;
+  double freq = rx.entry.freq ? rx.entry.freq : 1;
+  printf(">>> Session %u overview, level %u: %zu blocks of %u records (%.2f s)\n", rx.session, level, rx.summaryHave.size(), span, span / freq);
+  FILE* f = (csvPath != nullptr) ? fopen(csvPath, "wb") : nullptr;
+  if (f != nullptr)
+  {
+    fprintf(f, "Block,Time_s,Page,Records");
+    for (uint8_t c = 0; c < names.count; c++)
+    {
+      fprintf(f, ",%s_min,%s_max,%s_mean,%s_rms", names.names[c], names.names[c], names.names[c], names.names[c]);
+    }
+    fprintf(f, "\n");
+  }
+  for (size_t b = 0; b < rx.summaryHave.size(); b++)
+  {
+    if (!rx.summaryHave[b])
+    {
+      printf("%5zu  (missing)\n", b);
+      continue;
+    }
+    const uint8_t* p = rx.summary.data() + b * size;
+    double t = b * span / freq;                                                   // Nominal: from the record count at the recorded rate
+    printf("%5zu  %8.2f s  page %6u ", b, t, rd32(p));
+    if (f != nullptr)
+    {
+      fprintf(f, "%zu,%.4f,%u,%u", b, t, rd32(p), rd16(p + 4));
+    }
+    for (uint8_t c = 0; c < rx.summaryChannels; c++)
+    {
+      const uint8_t* v = p + SUMMARY_BLOCK_HEADER + c * 8;
+      int16_t lo = (int16_t)rd16(v), hi = (int16_t)rd16(v + 2), mean = (int16_t)rd16(v + 4), rms = (int16_t)rd16(v + 6);
+      printf(" %6d..%-6d rms %-6d", lo, hi, rms);
+      if (f != nullptr)
+      {
+        fprintf(f, ",%d,%d,%d,%d", lo, hi, mean, rms);
+      }
+    }
+    printf("\n");
+    if (f != nullptr)
+    {
+      fprintf(f, "\n");
+    }
+  }
+  if (f != nullptr)
+  {
+    fclose(f);
+    printf(">>> Saved %s\n", csvPath);
+  }
+  printf(">>> Download a time range with --pages FIRST:LAST, taking the pages from the blocks around it\n");
+  return true;
+}
+
+static bool readPages(const char* path, uint8_t chip, uint32_t first, uint32_t count, std::vector<uint8_t>& stream, Receiver& rx)
+{
+  Link link = {openPort(path), 0};
+  if (link.fd < 0)
+  {
+    fprintf(stderr, "Port %s unavailable.\n", path);
+    return false;
+  }
+  waitDirectory(link, stream, rx);
+  rx.readRange(chip, first, count);
+  auto request = [&](uint32_t k, uint16_t n)                                      // Pages k.. of the range
+  {
+    uint32_t page = first + k;
+    uint8_t cmd[8] = {'R', chip, (uint8_t)page, (uint8_t)(page >> 8), (uint8_t)(page >> 16), (uint8_t)(page >> 24), (uint8_t)(n & 0xFF), (uint8_t)(n >> 8)};
+    write(link.fd, cmd, sizeof(cmd));
+  };
+  printf(">>> Reading chip %u pages %u-%u...\n", chip, first, first + count - 1);
+
+  uint32_t asked = 0;                                                             // Pages requested so far, in order
+  uint8_t rounds = 0;
+  auto start = std::chrono::steady_clock::now();
+  auto quiet = start;
+  while (rx.rawGot < count)
+  {
+    while (asked < count && asked - rx.rawGot < READ_AHEAD * READ_PAGES)          // Keep the device's queue full, a lost frame only costs its page
+    {
+      uint16_t n = (uint16_t)std::min<uint32_t>(READ_PAGES, count - asked);
+      request(asked, n);
+      asked += n;
+    }
+    if (link.pump(stream, rx))
+    {
+      quiet = std::chrono::steady_clock::now();
+      printf("\rRead: %u of %u pages", rx.rawGot, count);
+      fflush(stdout);
+      continue;
+    }
+    if (secondsSince(quiet) < 0.5)
+    {
+      continue;
+    }
+    if (asked < count || rounds++ >= NAK_ROUNDS)
+    {
+      break;                                                                      // Device went quiet
+    }
+    for (uint32_t k = 0, n = 0; k < count && n < NAK_BATCH; k++)                  // Ask for lost/corrupt pages again, one by one
+    {
+      if (!rx.rawHave[k])
+      {
+        request(k, 1);
+        n++;
+      }
+    }
+    quiet = std::chrono::steady_clock::now();
+  }
+  uint8_t ack = 'A';
+  write(link.fd, &ack, 1);
+  double sec = secondsSince(start);
+  printf("\n>>> %u of %u pages in %.2f s (%.2f MB/s)\n", rx.rawGot, count, sec, rx.rawGot * (double)PAGE_SIZE / 1e6 / (sec > 0 ? sec : 1));
+  close(link.fd);
+  return rx.rawGot == count;
+}
+
+static bool receiveLive(const char* path, std::vector<uint8_t>& stream, Receiver& rx)   // STREAM: pages as they are recorded
+{
+  Link link = {openPort(path), 0};
+  if (link.fd < 0)
+  {
+    fprintf(stderr, "Port %s unavailable.\n", path);
+    return false;
+  }
+  printf("Waiting for a STREAM recording (INIT: STR on the device)...\n");
+  while (!rx.haveHeader || !rx.live)
+  {
+    link.pump(stream, rx);
+  }
+  printf(">>> Live session %u: [%s], %u Hz\n", rx.session, modeName(rx.entry.mode).c_str(), rx.entry.freq);
+
+  uint32_t shown = 0;                                                             // Pages before this one are reported
+  uint32_t behind = 0;
+  auto start = std::chrono::steady_clock::now();
+  auto quiet = start;
+  while (!rx.haveEnd)
+  {
+    if (!link.pump(stream, rx))
+    {
+      if (secondsSince(quiet) > 15)
+      {
+        printf("\n[!] Stream stopped without END.\n");
+        close(link.fd);
+        return true;
+      }
+      continue;
+    }
+    quiet = std::chrono::steady_clock::now();
+    uint32_t n = rx.pageCount();                                                  // Live pages come in order: a hole below the newest is a gap
+    while (shown < n)
+    {
+      uint32_t first = shown;
+      while (shown < n && rx.page(shown, stream.data()) == nullptr)
+      {
+        shown++;
+      }
+      if (shown > first)
+      {
+        printf("\n[gap] pages %u-%u: link behind, kept in flash, fetched after END\n", first, shown - 1);
+        behind += shown - first;
+      }
+      while (shown < n && rx.page(shown, stream.data()) != nullptr)
+      {
+        shown++;
+      }
+    }
+    printf("\rLive: %u pages, %u behind, %.1f s", n, behind, secondsSince(start));
+    fflush(stdout);
+  }
+  printf("\n>>> Session closed: %u pages, %u to fetch from flash\n", rx.pageCount(), behind + (rx.pageCount() - shown));
+  bool ok = collect(link, stream, rx);
+  printf("\n");
+  close(link.fd);
+  return ok || rx.haveHeader;
+}
+
+static void printRunStats(const RunStats& s)
+{
+  static const char* CHANNELS[6] = {"Accel", "Gyro", "Mag", "Coil", "Accel+Gyro", "FIFO"};
+  double seconds = (double)s.samples * s.nominalUs * 1e-6;
+  printf(">>> Run statistics: %u samples, %u dropped, %u / %u ticks missed, peak queue %u, peak pages %u\n", s.samples, s.dropped,
+         s.missedTicks, s.ticks, s.peakQueue, s.peakPages);
+  if (s.version >= 2 && s.skippedReads > 0)
+  {
+    printf("Skipped: %u sensor reads failed on the bus, no record for their ticks\n", s.skippedReads);
+  }
+  if (s.version >= 3 && s.summaryDropped > 0)
+  {
+    printf("Summary: %u pages dropped, the overview has gaps (the data pages are complete)\n", s.summaryDropped);
+  }
+  if (s.samples > 1)
+  {
+    printf("Interval: nominal %u us, min %u us, max %u us, about %.1f s recorded\n", s.nominalUs, s.minIntervalUs, s.maxIntervalUs,
+           seconds);
+    for (uint8_t b = 0; b < 32; b++)
+    {
+      if (s.hist[b] > 0)
+      {
+        printf("  %6u..%-6s us  %10u\n", b * s.binUs, (b == 31) ? "" : std::to_string((b + 1) * s.binUs).c_str(), s.hist[b]);
+      }
+    }
+  }
+  for (uint8_t c = 0; c < 6; c++)
+  {
+    if (s.read[c].count > 0)
+    {
+      printf("Read %-10s  %10u x  mean %5u us  max %5u us\n", CHANNELS[c], s.read[c].count, s.read[c].meanUs, s.read[c].maxUs);
+    }
+  }
+  printf("Page program    %10u x  mean %5u us  max %5u us\n", s.program.count, s.program.meanUs, s.program.maxUs);
+  printf("Chip busy wait  %10u x  mean %5u us  max %5u us\n", s.busy.count, s.busy.meanUs, s.busy.maxUs);
+}
+
+static bool writeOutputs(const Receiver& rx, const uint8_t* stream, const char* csvPath, const char* binPath)
+{
+  uint32_t lost, erased;
+  Columns cols;
+  if (rx.entry.schema == SCHEMA_CHANNELS)
+  {
+    decodeChannels(rx, stream, cols, lost, erased);
+  }
+  else
+  {
+    std::vector<Record> records;
+    std::vector<uint64_t> times;
+    decodeRecords(rx, stream, records, times, lost, erased);
+    toColumns(records, times, rx.entry.mode, cols);
+  }
+  printf(">>> Session %u: [%s], %u Hz, gain %u. Pages: %u, records: %zu\n", rx.session, modeName(rx.entry.mode).c_str(), rx.entry.freq,
+         rx.entry.gain, rx.pageCount(), cols.micros.size());
+  if (rx.entry.init == 1 && rx.entry.preTrigger != 0xFFFF)
+  {
+    printf(">>> HIT trigger at record %u, the records before it are the pre-trigger window\n", rx.entry.preTrigger);
+  }
+  if (rx.entry.init == INIT_ADAPTIVE && !cols.rates.empty())
+  {
+    size_t full = 0;
+    uint8_t quiet = 1;
+    for (size_t i = 0; i < cols.rates.size(); i++)
+    {
+      size_t end = (i + 1 < cols.rates.size()) ? cols.rates[i + 1].first : cols.micros.size();
+      full += (cols.rates[i].second == 1) ? end - cols.rates[i].first : 0;
+      quiet = std::max(quiet, cols.rates[i].second);
+    }
+    printf(">>> Adaptive rate: %zu rate changes, %zu of %zu records at the full rate, the rest at 1/%u\n", cols.rates.size() - 1, full,
+           cols.micros.size(), quiet);
+  }
+  if (lost > 0 || erased > 0 || rx.badFrames > 0)
+  {
+    printf("[!] %u pages missing, %u erased pages trimmed, %u corrupt frames.\n", lost, erased, rx.badFrames);
+  }
+  if (rx.haveEnd)
+  {
+    double sec = (rx.stats[0] > 0 ? rx.stats[0] : 1) / 1000.0;
+    printf(">>> Transfer: %.2f s, link %.3f MB/s, flash data %.3f MB/s\n", sec, rx.stats[1] / sec / 1e6, rx.stats[2] / sec / 1e6);
+  }
+  if (rx.haveRunStats)
+  {
+    printRunStats(rx.runStats);
+  }
+  const char* paths[2] = {csvPath, binPath};
+  for (uint8_t k = 0; k < 2; k++)
+  {
+    if (paths[k] == nullptr)
+    {
+      continue;
+    }
+    FILE* f = fopen(paths[k], "wb");
+    if (f == nullptr)
+    {
+      fprintf(stderr, "Cannot write %s.\n", paths[k]);
+      return false;
+    }
+    if (k == 0)
+    {
+      writeCsv(cols, f);
+    }
+    else
+    {
+      writeBin(cols, rx.entry, f);
+    }
+    fclose(f);
+    printf(">>> Saved %s\n", paths[k]);
+  }
+  return true;
+}
+
+class Dump                                                                        // Saved stream, mapped read-only
+{
+public:
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+
+  bool open(const char* path)
+  {
+    _fd = ::open(path, O_RDONLY);
+    struct stat st;
+    if (_fd < 0 || fstat(_fd, &st) != 0 || st.st_size == 0)
+    {
+      return false;
+    }
+    size = st.st_size;
+    void* m = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (m == MAP_FAILED)
+    {
+      return false;
+    }
+    madvise(m, size, MADV_SEQUENTIAL);
+    data = (const uint8_t*)m;
+    return true;
+  }
+  ~Dump()
+  {
+    if (data != nullptr)
+    {
+      munmap((void*)data, size);
+    }
+    if (_fd >= 0)
+    {
+      ::close(_fd);
+    }
+  }
+
+private:
+  int _fd = -1;
+};
+
+static void appendFrame(std::vector<uint8_t>& s, uint8_t type, uint32_t seq, const uint8_t* payload, uint16_t len)
+{
+  size_t at = s.size();
+  s.resize(at + 10 + len);
+  uint8_t* f = s.data() + at;
+  f[0] = SYNC;
+  f[1] = type;
+  memcpy(f + 2, &seq, 4);
+  memcpy(f + 6, &len, 2);
+  memcpy(f + 8, payload, len);
+  uint16_t crc = crc16(f + 1, 7 + len);
+  memcpy(f + 8 + len, &crc, 2);
+}
+
+static int bench()
+{
+  const uint32_t PAGES = (32u << 20) / PAGE_SIZE;                                 // 32 MB of page data, RAW frames as from a flash dump
+  std::vector<uint8_t> s;
+  s.reserve((size_t)PAGES * (PAGE_SIZE + 14) + 256);
+  Entry e = {0x5E55, SCHEMA_PAIR16, 1, 1000, 1, 0, 16, 0, 0, PAGES, 0, 0xFFFFFFFF, 0, {0}};
+  uint8_t head[10 + sizeof(Entry)] = {'S', 'R', 'D', 2};
+  uint32_t frames = PAGES + 2;
+  memcpy(head + 6, &frames, 4);
+  memcpy(head + 10, &e, sizeof(e));
+  appendFrame(s, HEADER, 0, head, sizeof(head));
+  uint8_t payload[4 + PAGE_SIZE] = {0, 0, 0, RAW};
+  uint32_t t = 0xFFF00000;                                                        // Crosses the uint32 micros wrap
+  for (uint32_t i = 0; i < PAGES; i++)
+  {
+    Record* rec = (Record*)(payload + 4);
+    for (uint8_t k = 0; k < PAGE_SIZE / sizeof(Record); k++, t += 1000)
+    {
+      for (uint8_t c = 0; c < 6; c++)
+      {
+        rec[k].axis[c] = (int16_t)((i * 16 + k) * (c + 1));
+      }
+      rec[k].micros = t;
+    }
+    payload[0] = i & 1;
+    payload[1] = (i >> 1) & 0xFF;
+    payload[2] = (i >> 9) & 0xFF;
+    appendFrame(s, PAGE, i + 1, payload, sizeof(payload));
+  }
+  uint32_t stats[3] = {1, 0, 0};
+  appendFrame(s, END, frames - 1, (const uint8_t*)stats, sizeof(stats));
+
+  char path[] = "/tmp/srd_benchXXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0 || write(fd, s.data(), s.size()) != (ssize_t)s.size())
+  {
+    fprintf(stderr, "Cannot write the synthetic dump.\n");
+    return 1;
+  }
+  close(fd);
+  double mb = (double)PAGES * PAGE_SIZE / 1e6;
+  printf("Synthetic dump: %.1f MB page data, %zu bytes of frames\n", mb, s.size());
+  std::vector<uint8_t>().swap(s);
+
+  Dump dump;
+  if (!dump.open(path))
+  {
+    fprintf(stderr, "Cannot map %s.\n", path);
+    return 1;
+  }
+  auto t0 = std::chrono::steady_clock::now();
+  Receiver rx;
+  rx.feed(dump.data, dump.size, 0);
+  double tParse = secondsSince(t0);
+
+  t0 = std::chrono::steady_clock::now();
+  std::vector<Record> records;
+  std::vector<uint64_t> times;
+  uint32_t lost, erased;
+  decodeRecords(rx, dump.data, records, times, lost, erased);
+  double tRecords = secondsSince(t0);
+
+  t0 = std::chrono::steady_clock::now();
+  Columns cols;
+  toColumns(records, times, rx.entry.mode, cols);
+  double tColumns = secondsSince(t0);
+
+  for (size_t i = 0; i < records.size(); i++)                                     // Check the SIMD split against the records
+  {
+    for (uint8_t c = 0; c < 6; c++)
+    {
+      if (cols.axis[c][i] != records[i].axis[c] || cols.micros[i] != (uint64_t)i * 1000)
+      {
+        fprintf(stderr, "Column mismatch at record %zu.\n", i);
+        return 1;
+      }
+    }
+  }
+
+  FILE* sink = tmpfile();                                                         // A real file: /dev/null takes a large fwrite() for free
+  if (sink == nullptr)
+  {
+    fprintf(stderr, "Cannot create the output file.\n");
+    return 1;
+  }
+  t0 = std::chrono::steady_clock::now();
+  writeCsv(cols, sink);
+  double tCsv = secondsSince(t0);
+  t0 = std::chrono::steady_clock::now();
+  writeBin(cols, rx.entry, sink);
+  double tBin = secondsSince(t0);
+  fclose(sink);
+  unlink(path);
+
+  if (lost > 0 || records.size() != (size_t)PAGES * 16)
+  {
+    fprintf(stderr, "Decode failed: %u pages missing.\n", lost);
+    return 1;
+  }
+  printf("Frames (mmap + CRC):  %7.1f ms  %8.1f MB/s\n", tParse * 1e3, mb / tParse);
+  printf("Pages -> records:     %7.1f ms  %8.1f MB/s\n", tRecords * 1e3, mb / tRecords);
+  printf("Records -> columns:   %7.1f ms  %8.1f MB/s\n", tColumns * 1e3, mb / tColumns);
+  printf("CSV formatting:       %7.1f ms  %8.1f MB/s\n", tCsv * 1e3, mb / tCsv);
+  printf("Binary output:        %7.1f ms  %8.1f MB/s\n", tBin * 1e3, mb / tBin);
+  printf("Records: %zu\n", records.size());
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  initCrc();
+  const char* port = nullptr;
+  const char* dumpPath = nullptr;
+  const char* savePath = nullptr;
+  const char* csvPath = nullptr;
+  const char* binPath = nullptr;
+  const char* resumePath = nullptr;
+  const char* rawPath = nullptr;
+  int session = -1;
+  bool live = false;
+  unsigned readChip = 0, readFirst = 0, readCount = 0;
+  int overviewLevel = -1;
+  unsigned firstPage = 0, lastPage = UINT32_MAX;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string a = argv[i];
+    bool hasValue = (i + 1 < argc);
+    if (a == "--bench")
+    {
+      return bench();
+    }
+    else if (a == "--port" && hasValue) port = argv[++i];
+    else if (a == "--dump" && hasValue) dumpPath = argv[++i];
+    else if (a == "--save" && hasValue) savePath = argv[++i];
+    else if (a == "--csv" && hasValue) csvPath = argv[++i];
+    else if (a == "--bin" && hasValue) binPath = argv[++i];
+    else if (a == "--session" && hasValue) session = atoi(argv[++i]);
+    else if (a == "--live") live = true;
+    else if (a == "--resume" && hasValue) resumePath = argv[++i];
+    else if (a == "--raw" && hasValue) rawPath = argv[++i];
+    else if (a == "--read" && hasValue) sscanf(argv[++i], "%u:%u:%u", &readChip, &readFirst, &readCount);
+    else if (a == "--pages" && hasValue) sscanf(argv[++i], "%u:%u", &firstPage, &lastPage);
+    else if (a == "--overview") overviewLevel = (hasValue && isdigit((unsigned char)argv[i + 1][0])) ? atoi(argv[++i]) : 1;
+    else
+    {
+      fprintf(stderr, "Usage: %s --port DEV [--session N [--overview [LEVEL] | --pages FIRST:LAST] | --live | --resume FILE] [--save FILE]\n"
+                      "       %s --port DEV --read CHIP:PAGE:COUNT --raw FILE\n"
+                      "       %s --dump FILE | --bench  [--csv FILE] [--bin FILE]\n", argv[0], argv[0], argv[0]);
+      return 2;
+    }
+  }
+
+  Receiver rx;
+  if (dumpPath != nullptr)
+  {
+    Dump dump;
+    if (!dump.open(dumpPath))
+    {
+      fprintf(stderr, "Cannot map %s.\n", dumpPath);
+      return 1;
+    }
+    rx.feed(dump.data, dump.size, 0);
+    if (rx.haveDirectory)
+    {
+      printSessions(rx.sessions);
+    }
+    if (!rx.haveHeader)
+    {
+      fprintf(stderr, "No HEADER frame in %s.\n", dumpPath);
+      return 1;
+    }
+    return writeOutputs(rx, dump.data, csvPath, binPath) ? 0 : 1;
+  }
+  if (port == nullptr)
+  {
+    fprintf(stderr, "Give --port, --dump or --bench.\n");
+    return 2;
+  }
+
+  std::vector<uint8_t> stream;
+  stream.reserve(32u << 20);
+  if (readCount > 0)
+  {
+    bool ok = readPages(port, readChip, readFirst, readCount, stream, rx);
+    FILE* f = (rawPath != nullptr) ? fopen(rawPath, "wb") : nullptr;             // Missing pages stay 0xFF, as erased
+    if (f != nullptr)
+    {
+      fwrite(rx.raw.data(), 1, rx.raw.size(), f);
+      fclose(f);
+    }
+    return ok ? 0 : 1;
+  }
+  if (overviewLevel >= 0)
+  {
+    bool ok = overview(port, session, (uint8_t)overviewLevel, stream, rx);
+    return (ok && writeOverview(rx, (uint8_t)overviewLevel, csvPath)) ? 0 : 1;
+  }
+  if (lastPage != UINT32_MAX)
+  {
+    rx.wantFirst = firstPage;
+    rx.wantEnd = lastPage + 1;
+  }
+  if (resumePath != nullptr)
+  {
+    Dump dump;
+    if (dump.open(resumePath))
+    {
+      stream.assign(dump.data, dump.data + dump.size);
+    }
+    rx.feed(stream.data(), stream.size(), 0);
+    if (!rx.haveHeader)
+    {
+      fprintf(stderr, "No HEADER frame in %s, nothing to resume.\n", resumePath);
+      return 1;
+    }
+    savePath = (savePath != nullptr) ? savePath : resumePath;                     // The completed stream replaces the partial one
+  }
+  bool ok = (resumePath != nullptr) ? resume(port, stream, rx) : live ? receiveLive(port, stream, rx) : receive(port, session, stream, rx);
+  if (savePath != nullptr)
+  {
+    FILE* f = fopen(savePath, "wb");
+    if (f != nullptr)
+    {
+      fwrite(stream.data(), 1, stream.size(), f);
+      fclose(f);
+    }
+  }
+  if (!ok)
+  {
+    return 1;
+  }
+  return writeOutputs(rx, stream.data(), csvPath, binPath) ? 0 : 1;
+}
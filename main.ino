@@ -5,74 +5,603 @@
 #include "Button.h"
 #include "Leds.h"
 #include "Buzzer.h"
+#include "PatternPlayer.h"
 #include "Display.h"
 #include "Storage.h"
 #include "IMUHandler.h"
+#include "PageRing.h"
+#include "SampleQueue.h"
+#include "SessionLog.h"
+#include "Transfer.h"
+#include "EraseAhead.h"
+#include "PageCodec.h"
+#include "TimeBaseCodec.h"
+#include "ChannelPacker.h"
+#include "RunStats.h"
+#include "HitTrigger.h"
+#include "PreTriggerRing.h"
+#include "StorageArray.h"
+#include "CoilSampler.h"
+#include "TwimSampler.h"
+#include "SummaryLog.h"
+#include "ActivityGate.h"
 
 #define BUZZER_PIN  2
 #define BUTTON_PIN  5
 #define LED1_PIN    A0
 #define LED2_PIN    A1
+#define COIL_AIN    6               // Coil input on A2 = P0.30 = AIN6 (A0, where analogRead() sampled it, also drives LED1)
 #define MEM1_CS     9
 #define MEM2_CS     10
+// #define MEM3_CS  6               // A third chip on the SPI bus: more pages programmed at once
 
 #define WIRE_SPEED  1000000UL
 #define UART_SPEED  921600UL
 #define SPI_SPEED   8000000UL
 #define BUFF_SIZE   256
 #define BUZ_VALUE   3100
+#define QUEUE_SIZE  512             // Sample records between acquisition and storage (power of two)
+#define RAM_BUFFER_BUDGET (96 * 1024UL)   // Record buffers below, of the 256 KB: the rest is mbed OS, the core and the thread stacks
+#define FIFO_POLL_US 4000           // FIFO mode: drain the BMI270 every 4 ms (~6 frames at 1600 Hz)
+#ifndef TWIM_DMA
+#define TWIM_DMA    1               // A/G, A and G: TIMER3 starts the reads through PPI, EasyDMA fills a ring (TwimSampler), the ticks
+#endif                              // only repack it; 0 - read on the ticks, A/G at 1600 Hz through the FIFO
+#define DMA_POLL_US 4000            // TWIM DMA mode: repack the finished reads every 4 ms
+#define OLED_BUDGET_US 400          // Screen updates per loop() pass, about 2 characters at 1 MHz I2C
+#define PRETRIGGER_SIZE 1024        // HIT: records of history kept while waiting (power of two, 29 KB of 29-byte SamplePackets)
+#define PRETRIGGER_MS 100           // HIT: history stored ahead of the trigger record
+#define HIT_LEVEL_MG 3000           // HIT: |a| that fires the trigger (at rest |a| = 1 g)
+#define HIT_RELEASE_MG 1500         // HIT: |a| must be below this before the trigger arms
+#define ACC_LSB_PER_G 2048          // +/- 16 g range (set_AllMaxSpeed)
+#define MAG_PRESET IMUHandler::MAG_LOW_POWER    // BMM150 repetitions; their forced-mode measurement time sets the MAG rate (311 Hz)
+#define ADAPT_LEVEL_MG 250          // ADP: |a - baseline| summed over x, y, z that counts as activity (sensor 1 counts)
+#define ADAPT_DIVIDER 16            // ADP: 1 in 16 records kept while quiet
+#define ADAPT_LOOKBACK_MS 100       // ADP: full-rate history kept ahead of the first active record
+#define ADAPT_HOLD_MS 1000          // ADP: full rate kept this long after the last active record
+#define RATE_MARKS 64               // ADP: rate changes between acquisition and storage (power of two)
+#define PAGE_SCHEMA 2               // SessionLog::SCHEMA_* of the sensor pairs: 1 raw 16-byte records, 2 compressed per page
+                                    // (PageCodec), 3 64-bit time base per page + 16-bit deltas (TimeBaseCodec), 4 channel-set
+                                    // bitstream (ChannelPacker). The modes past the pairs, ADP recordings and MAG modes whose ticks
+                                    // outrun the magnetometer (SPARSE slots) are always recorded as 4.
+
+#define INIT_HIT 1                  // INIT menu: TIM, HIT, STR, ADP
+#define INIT_STREAM 2
+#define INIT_ADAPTIVE 3
+
+#define FLAG_TICK   0x01            // acqFlags: ticker fired, read the sensors
+#define FLAG_STOP   0x02            // acqFlags: recording stopped, no more ticks
+#define FLAG_DATA   0x01            // storageFlags: new records in the queue
+#define FLAG_FLUSH  0x02            // storageFlags: write out everything that is left
+#define FLAG_IDLE   0x04            // storageFlags: flush finished
+
+struct RateMark                 // ADP: records from `record` on are kept at 1 / divider of the rate
+{
+    uint32_t record;            // Index among the queued records of the session
+    uint8_t divider;
+};
 
 enum SystemState
 { 
-    MENU, COUNTDOWN, WAIT_HIT, RECORDING, DATA_TRANSFER
+    MENU, COUNTDOWN, WAIT_HIT, RECORDING, STREAM, DATA_TRANSFER
 };
 
 SystemState currentState = MENU;
 
 mbed::Ticker sampleTicker;      
+rtos::Thread acquisitionThread(osPriorityRealtime, 2048);       // Sensor reads, woken only by the ticker
+rtos::Thread storageThread(osPriorityAboveNormal, 2048);        // Queue -> pages -> flash, above loop() so the UI can't starve it
+rtos::EventFlags acqFlags;
+rtos::EventFlags storageFlags;
 Buzzer Buzzer(BUZZER_PIN);
 Leds Leds(LED1_PIN, LED2_PIN);
-ButtonHandler Button(BUTTON_PIN, &Buzzer);
+PatternPlayer Signals(&Buzzer, &Leds);      // Feedback without blocking the caller
+ButtonHandler Button(BUTTON_PIN, &Signals);
 Storage Memory1(MEM1_CS);
 Storage Memory2(MEM2_CS);
-Display Gui(&Buzzer, &Leds, &Memory1, &Memory2);
-IMUHandler Sensors;
-
-uint8_t pageBuffer1[BUFF_SIZE], pageBuffer2[BUFF_SIZE]; 
-uint16_t offset1 = 0, offset2 = 0;
-volatile bool readyM1 = false, readyM2 = false;
-volatile bool timeToReadSensors = false;
-uint32_t page1 = 0, page2 = 0;
+#ifdef MEM3_CS
+Storage Memory3(MEM3_CS);
+Storage* const Chips[] = {&Memory1, &Memory2, &Memory3};
+#else
+Storage* const Chips[] = {&Memory1, &Memory2};
+#endif
+StorageArray Memory(Chips);      // Logical page k -> chip k % N, at most StorageArray::MAX_CHIPS chips
+SessionLog Log(&Memory);
+Display Gui(&Signals, &Log);
+RunStats Stats;                 // Always on: intervals, missed ticks, read and flash timings, queue peaks
+CoilSampler Coil(COIL_AIN);     // SAADC + EasyDMA, runs only while the selected mode includes the coil
+TwimSampler Dma;                // TIMER3 + PPI + TWIM EasyDMA, runs only while a BMI270-only mode records
+IMUHandler Sensors(&Stats, &Coil, &Dma);
+EraseAhead Eraser(&Log);
+SummaryLog Summary(&Log, &Memory);  // Min/max/mean/RMS blocks of every channel, in the summary region beside the data
+Transfer Downlink(&Log, &Serial);
+
+SampleQueue<SamplePacket, QUEUE_SIZE> Samples;      // Producer: acquisition thread, consumer: storage thread
+PageRing Pages;                 // Producer: storage thread packs records, consumer: flash programs them
+#if PAGE_SCHEMA == 3
+TimeBaseCodec Codec;            // Encoder of the page being filled
+#else
+PageCodec Codec;                // Encoder of the page being filled (not used for raw records)
+#endif
+ChannelPacker Packer;           // SCHEMA_CHANNELS: records of the selected channel set, run on across pages
+PreTriggerRing<SamplePacket, PRETRIGGER_SIZE> History;   // HIT: producer acquisition thread until the trigger, then read by storage
+HitTrigger Trigger;             // Watches sensor 1 of every record: the accelerometer, HIT needs a mode with it
+ActivityGate Gate;              // ADP: look-back line and decimation of the quiet stretches, ahead of the queue (modes with ACC)
+SampleQueue<RateMark, RATE_MARKS> Marks;    // ADP: producer acquisition thread, consumer storage thread (rate records in Packer)
+
+uint16_t pageOffset = 0;
+bool channelPages = false;      // This recording goes through Packer instead of Codec
+uint32_t sessionStart = 0;      // First logical page of the open session
+uint32_t pagesWritten = 0;      // Logical pages: even go to M1, odd to M2
+volatile bool sessionOpen = false;  // Pages may go to flash only while a session is open
+volatile bool waitingHit = false;   // Records go to History and the trigger instead of the queue
+uint32_t preTriggerRecords = 0;
+volatile uint16_t triggerRecord = 0;    // HIT: index of the trigger record in the session
+volatile bool streaming = false;    // STREAM: pages written to flash are also offered to the USB link
+bool adaptiveRate = false;      // ADP: records go through Gate, rate changes through Marks
+uint32_t queuedRecords = 0;     // ADP: records queued so far (acquisition thread)
+uint8_t markedRate = 0;         // ADP: divider of the last RateMark queued (0 - none yet)
+uint32_t packedRecords = 0;     // ADP: records taken from the queue so far (storage thread)
+volatile bool eraseActive = false;   // Storage thread keeps erasing ahead of the write pointer
+volatile uint32_t page1 = 0, page2 = 0;
+volatile uint32_t droppedSamples = 0;
+volatile uint32_t readCostUs = 0;   // Duration of the last sensor read + pack
+uint32_t chipWaitSince = 0;     // A full page has been waiting for a busy chip since then (0 - not waiting)
 int selectedMode, selectedFreq;
-uint32_t samplesInSecond = 0;
+bool coilActive = false;        // Coil sampler converting for this recording
+bool fifoMode = false;          // A/G at the sensor's native ODR: ticks drain the hardware FIFO
+bool dmaMode = false;           // BMI270-only modes: the reads are timed by hardware, ticks repack the finished ones
+SamplePacket fifoPackets[IMUHandler::FIFO_MAX_FRAMES];     // Records of one FIFO or DMA drain
+static_assert(sizeof(Samples) + sizeof(Pages) + sizeof(History) + sizeof(Gate) + sizeof(Marks) + sizeof(fifoPackets) + sizeof(Downlink)
+              + sizeof(Summary) + sizeof(Dma) + sizeof(Coil) <= RAM_BUFFER_BUDGET, "Record buffers outgrow RAM_BUFFER_BUDGET");   // About 79 KB
+volatile uint32_t samplesInSecond = 0;
 uint32_t lastStatMillis = 0;
 
 void TimerHandler()
 {
-    timeToReadSensors = true;
+    Stats.tick();
+    acqFlags.set(FLAG_TICK);
+}
+
+bool writeNextPage()                            // Every waiting page whose chip is idle, so programs on different chips overlap
+{
+    if (Pages.count() == 0 || !sessionOpen) return false;              // HIT: pages wait in the ring until the session is opened
+
+    bool wrote = false, blocked = false;
+    Memory.beginPass();
+    for (uint8_t i = 0; i < Pages.count(); i++)
+    {
+        if (Pages.isWritten(i)) continue;
+        uint32_t logical = sessionStart + pagesWritten + i;
+        if (logical >= Log.capacity()) break;                           // Flash full, the UI stops the recording
+        if (!Eraser.canWrite(logical)) continue;                        // Sector not erased yet, the page stays in the ring
+
+        uint8_t chip;
+        uint32_t phys;
+        Log.locate(logical, chip, phys);
+        uint32_t t0 = micros();
+        if (!Memory.tryProgram(chip, phys, Pages.fullSlot(i)))          // Chip still programming, a later page may go to another one
+        {
+            blocked = true;
+            continue;
+        }
+        Stats.program(micros() - t0, chipWaitSince ? t0 - chipWaitSince : 0);
+        chipWaitSince = 0;
+        Pages.markWritten(i);
+        wrote = true;
+    }
+    if (blocked && chipWaitSince == 0) chipWaitSince = micros() | 1;
+
+    while (Pages.count() > 0 && Pages.isWritten(0))                    // Released in recording order
+    {
+        if (streaming) Downlink.offerLive(pagesWritten, Pages.readSlot());     // Link behind: the page is only in flash, the host asks for it after END
+        Pages.release();
+        pagesWritten++;
+        eraseActive = sessionOpen;
+    }
+    uint32_t end = sessionStart + pagesWritten;
+    page1 = Log.usedPages(0, end);                                      // First and last chip, for the progress bars
+    page2 = Log.usedPages(Log.chips() - 1, end);
+    return wrote;
+}
+
+uint32_t fullChipPages()                        // usedPages() of every chip once the data region is full: 100% on the progress bars
+{
+    return Log.usedPages(0, Log.capacity());
+}
+
+bool peekSample(SamplePacket& packet)           // Pre-trigger history first, then the live queue
+{
+    return History.peek(packet) || Samples.peek(packet);
+}
+
+void popSample()
+{
+    SamplePacket packet;
+    if (!History.pop(packet)) Samples.pop(packet);
+    packedRecords++;
+    Summary.add(packet, pagesWritten + Pages.count());                 // The page being filled: the record is in it now
+}
+
+uint32_t samplesLeft()
+{
+    return History.remaining() + Samples.size();
+}
+
+void packQueuedSamples()
+{
+    SamplePacket packet;
+    uint8_t* slot;
+    if (channelPages)
+    {
+        while ((slot = Pages.writeSlot()) != nullptr && (Packer.pending() || peekSample(packet)))
+        {
+            if (!Packer.isOpen())
+            {
+                Packer.begin(slot);                                           // Starts with the rest of a record cut at the end of the last page
+            }
+            if (!peekSample(packet))
+            {
+                break;
+            }
+            RateMark mark;
+            if (Marks.peek(mark) && mark.record <= packedRecords)          // ADP: the rate record goes in ahead of this record
+            {
+                Packer.mark(mark.divider);
+                Marks.pop(mark);
+            }
+            if (Packer.add(packet))
+            {
+                popSample();
+            }
+            else
+            {
+                Packer.finish();                                              // Page full to the last bit
+                Pages.commit();
+            }
+        }
+        return;
+    }
+#if PAGE_SCHEMA != 1
+    while ((slot = Pages.writeSlot()) != nullptr && peekSample(packet))    // Popped only once it is in a page
+    {
+        if (!Codec.isOpen())
+        {
+            Codec.begin(slot);
+        }
+        if (Codec.add(packet))
+        {
+            popSample();
+        }
+        else
+        {
+            Codec.finish();                                                   // Page full, the record starts the next one
+            Pages.commit();
+        }
+    }
+    return;
+#endif
+    while ((slot = Pages.writeSlot()) != nullptr && peekSample(packet))    // Records stay queued while the ring is full
+    {
+        popSample();
+        memcpy(slot + pageOffset, packet.bytes, SamplePacket::PAIR_SIZE);
+        pageOffset += SamplePacket::PAIR_SIZE;
+        if (pageOffset >= PageRing::PAGE_SIZE)
+        {
+            pageOffset = 0;
+            Pages.commit();
+        }
+    }
+}
+
+bool pageOpen()                 // A page is being filled, or part of a record waits for one
+{
+    return channelPages ? (Packer.isOpen() || Packer.pending()) : Codec.isOpen();
+}
+
+void closePage()                // Last page of the session goes out partly filled
+{
+    if (channelPages ? !Packer.isOpen() : !Codec.isOpen()) return;
+    if (channelPages) Packer.finish();
+    else Codec.finish();
+    Pages.commit();
+}
+
+void queueSample(const SamplePacket& packet)
+{
+    if (adaptiveRate && Gate.rate() != markedRate)                      // First record at a new rate
+    {
+        if (!Marks.push({queuedRecords, Gate.rate()}))
+        {
+            droppedSamples++;       // Storage is far behind, the mark is retried with the next record
+            return;
+        }
+        markedRate = Gate.rate();
+    }
+    if (Samples.push(packet))
+    {
+        samplesInSecond++;
+        queuedRecords++;
+    }
+    else
+    {
+        droppedSamples++;           // Storage is behind by QUEUE_SIZE records, the sample is lost
+    }
+}
+
+void pushSample(const SamplePacket& packet)
+{
+    Stats.sample(packet.bytes + 12);
+    if (waitingHit)
+    {
+        History.put(packet);
+        int16_t axis[3];
+        memcpy(axis, packet.bytes, sizeof(axis));
+        if (Trigger.update(axis))
+        {
+            triggerRecord = History.freeze(preTriggerRecords + 1) - 1;    // The window and the trigger record; later records go to the queue
+            waitingHit = false;                                         // Last: loop() opens the session once it sees this
+        }
+        return;
+    }
+    if (!adaptiveRate)
+    {
+        queueSample(packet);
+        return;
+    }
+    SamplePacket kept;
+    if (Gate.put(packet, kept)) queueSample(kept);                      // Else a quiet record dropped, or the line still filling
+}
+
+void acquisitionTask()
+{
+    SamplePacket packet;
+    while (true)
+    {
+        uint32_t flags = acqFlags.wait_any(FLAG_TICK | FLAG_STOP);
+        if (flags & FLAG_TICK)
+        {
+            Stats.tickServed();
+            if (fifoMode || dmaMode)
+            {
+                uint16_t n = fifoMode ? Sensors.drainFifo(fifoPackets, IMUHandler::FIFO_MAX_FRAMES)
+                                      : Sensors.drainDma(fifoPackets, IMUHandler::FIFO_MAX_FRAMES);     // The rest waits in the ring
+                for (uint16_t i = 0; i < n; i++)
+                {
+                    pushSample(fifoPackets[i]);
+                }
+            }
+            else
+            {
+                uint32_t t0 = micros();
+                Sensors.collectAndPack(packet);
+                readCostUs = micros() - t0;
+                pushSample(packet);
+            }
+            Stats.depth(Samples.size(), Pages.count());
+            storageFlags.set(FLAG_DATA);
+        }
+        if (flags & FLAG_STOP)      // Queued after any pending tick, so nothing is produced after the flush
+        {
+            while (adaptiveRate && Gate.drain(packet))
+            {
+                queueSample(packet);        // ADP: the look-back line goes out too
+            }
+            storageFlags.set(FLAG_FLUSH);
+        }
+    }
+}
+
+void storageTask()
+{
+    while (true)
+    {
+        uint32_t timeout = (Pages.count() > 0 || eraseActive) ? 1 : osWaitForever;   // Retry busy chips every 1 ms while there is work
+        uint32_t flags = storageFlags.wait_any(FLAG_DATA | FLAG_FLUSH, timeout);
+        if (flags & osFlagsError) flags = 0;                                  // Timeout
+
+        packQueuedSamples();
+        writeNextPage();
+        if (sessionOpen) Summary.step();                                 // After the data pages: only chips they left idle
+        if (eraseActive && !Eraser.step(sessionStart + pagesWritten))
+        {
+            eraseActive = false;                                              // Window ready, the next page written re-arms it
+        }
+
+        if ((flags & FLAG_FLUSH) && !sessionOpen)                            // HIT cancelled or no session: nothing to keep
+        {
+            storageFlags.set(FLAG_IDLE);
+        }
+        else if (flags & FLAG_FLUSH)
+        {
+            while (samplesLeft() > 0 || Pages.count() > 0 || pageOpen())
+            {
+                packQueuedSamples();
+                if (!writeNextPage() && sessionStart + pagesWritten >= Log.capacity()) break;   // Flash full: the rest is lost
+                Summary.step();
+                if (eraseActive) Eraser.step(sessionStart + pagesWritten);
+                if (samplesLeft() == 0)
+                {
+                    closePage();
+                }
+            }
+            Summary.finish();
+            storageFlags.set(FLAG_IDLE);
+        }
+    }
+}
+
+void showMemoryFull()
+{
+    Gui.showMessage(CURSOR_X_CENTER, 2, "MEMORY FULL");
+    Signals.play(PatternPlayer::FAILURE);
+    delay(1500);                            // Not recording: keeps the message up while the error tone plays
+}
+
+bool initAllowed(uint8_t mode)  // HIT and ADP watch slot 0 against milli-g levels: the accelerometer, in every mode that records it
+{
+    int init = Gui.getSelectedInit();
+    if ((init != INIT_HIT && init != INIT_ADAPTIVE) || ChannelSet::forMode(mode).has(ChannelSet::ACC)) return true;
+    Gui.showMessage(CURSOR_X_CENTER, 1, (init == INIT_HIT) ? "HIT NEEDS ACC" : "ADP NEEDS ACC");
+    Signals.play(PatternPlayer::FAILURE);
+    delay(1500);
+    Gui.clear();
+    Gui.render();                           // Back to the menu: pick a mode with A, or another INIT
+    return false;
 }
 
-void startRecording()
+uint16_t recordingRate()          // Ticks per second: the FREQ entry, unless no sensor of the mode keeps up with it
 {
-    page1 = 0; page2 = 0;
-    offset1 = 0;      
-    offset2 = 0xFFFF; 
-    readyM1 = false; readyM2 = false;
+    return Sensors.tickRate(selectedMode, selectedFreq);
+}
+
+ChannelSet recordingSet()        // Sensors of the mode, the slower ones SPARSE
+{
+    return Sensors.plan(selectedMode, selectedFreq);
+}
+
+bool channelSetMode()            // The selected sensors are recorded as SCHEMA_CHANNELS
+{
+    return (PAGE_SCHEMA == SessionLog::SCHEMA_CHANNELS) || (selectedMode >= ChannelSet::PAIR_MODES) || adaptiveRate   // ADP: rate records
+        || recordingSet().sparse();
+}
+
+bool openSession()
+{
+    SessionLog::Entry entry;
+    entry.schema = channelSetMode() ? SessionLog::SCHEMA_CHANNELS : PAGE_SCHEMA;
+    entry.mode = selectedMode;
+    entry.freq = recordingRate();
+    entry.gain = Gui.getSelectedGain();
+    entry.init = adaptiveRate ? INIT_ADAPTIVE : Gui.getSelectedInit();
+    entry.packetSize = channelSetMode() ? (recordingSet().recordBits() + 7) / 8 : SamplePacket::PAIR_SIZE;   // Longest record
+    entry.startMillis = millis();
+    entry.preTrigger = (entry.init == INIT_HIT) ? triggerRecord : 0;
+    if (!Log.open(entry))
+    {
+        return false;
+    }
+    sessionStart = entry.startPage;
+    Summary.open(entry.summaryPage);
+    page1 = Log.usedPages(0, sessionStart);
+    page2 = Log.usedPages(Log.chips() - 1, sessionStart);
+    pagesWritten = 0;
+    eraseActive = true;
+    sessionOpen = true;                     // Last: the storage thread starts writing pages here
+    return true;
+}
+
+void startAcquisition(bool preTrigger)
+{
+    pageOffset = 0;
+    Samples.reset();
+    Pages.reset();
+    Codec.reset();
+    channelPages = channelSetMode();
+    Packer.start(recordingSet());
+    Summary.start(recordingSet());
+    History.reset();
+    Marks.reset();
+    queuedRecords = 0;
+    markedRate = 0;
+    packedRecords = 0;
     samplesInSecond = 0;
+    droppedSamples = 0;
+    chipWaitSince = 0;
     
-    uint32_t intervalUs = 1000000UL / selectedFreq;
+    uint16_t freq = recordingRate();
+    Sensors.selectMode(selectedMode, selectedFreq);      // Slower sensors read every few ticks
+    coilActive = ChannelSet::forMode(selectedMode).has(ChannelSet::COI);
+    if (coilActive) Coil.start(freq, Gui.getSelectedGain());
+    dmaMode = TWIM_DMA && Sensors.startDma(selectedMode, freq);
+    fifoMode = !dmaMode && (freq > 1000) && Sensors.startFifo(selectedMode);
+    uint32_t intervalUs = fifoMode ? FIFO_POLL_US : dmaMode ? DMA_POLL_US : 1000000UL / freq;
+    uint32_t rate = fifoMode ? IMUHandler::FIFO_ODR : freq;
+    preTriggerRecords = min((uint32_t)PRETRIGGER_SIZE - 1, rate * PRETRIGGER_MS / 1000);
+    Trigger.configure((uint32_t)HIT_LEVEL_MG * ACC_LSB_PER_G / 1000, (uint32_t)HIT_RELEASE_MG * ACC_LSB_PER_G / 1000);
+    Trigger.arm();
+    Gate.configure((uint32_t)ADAPT_LEVEL_MG * ACC_LSB_PER_G / 1000, ADAPT_DIVIDER, rate * ADAPT_LOOKBACK_MS / 1000, rate * ADAPT_HOLD_MS / 1000);
+    Gate.reset();
+    waitingHit = preTrigger;
+    Stats.begin(fifoMode ? 1000000UL / IMUHandler::FIFO_ODR : dmaMode ? 1000000UL / freq : intervalUs);
     sampleTicker.attach_us(&TimerHandler, intervalUs); 
-    oled.clearDisplay();
+}
+
+bool startRecording(bool live, bool adaptive)   // live: STREAM, the session also goes out over USB as it is written; adaptive: ADP
+{
+    adaptiveRate = adaptive;                // Before the session opens: ADP sessions are channel-set recordings
+    Log.load();
+    if (!openSession())
+    {
+        showMemoryFull();
+        return false;
+    }
+    Eraser.prepareStart(sessionStart);      // No bulk erase needed, the rest is erased while recording
+    if (live) Downlink.beginLive(Log.count() - 1);
+    streaming = live;
+    startAcquisition(false);
+    Gui.clear();
+    return true;
+}
+
+bool armHit()                               // Samples into History from now on, the session opens at the trigger
+{
+    Log.load();
+    if (!Log.hasRoom())
+    {
+        showMemoryFull();
+        return false;
+    }
+    Eraser.prepareStart(Log.nextStart());   // Done now, so the trigger only has to write the directory entry
+    startAcquisition(true);
+    return true;
 }
 
 void stopRecording()
 {
     sampleTicker.detach(); 
+    waitingHit = false;
+    acqFlags.set(FLAG_STOP);                // Flush the records and full pages still waiting in RAM
+    storageFlags.wait_any(FLAG_IDLE);
+    eraseActive = false;
+    if (sessionOpen)                        // Record where the session ended, the next one appends after it
+    {
+        Log.close(sessionStart + pagesWritten);
+        Log.closeSummary(Summary.pagesWritten());
+        RunStats::Record record;
+        Stats.snapshot(record, droppedSamples, Summary.dropped());
+        Log.writeStats((const uint8_t*)&record);
+        sessionOpen = false;
+    }
+    if (coilActive)
+    {
+        Coil.stop();
+        coilActive = false;
+    }
+    if (fifoMode)
+    {
+        Sensors.stopFifo();
+        fifoMode = false;
+    }
+    if (dmaMode)
+    {
+        Sensors.stopDma();                  // Wire1 is free again
+        dmaMode = false;
+    }
+    adaptiveRate = false;
     currentState = MENU;
-    oled.clearDisplay();
+    Gui.clear();
     Gui.render(); 
 }
 
+void stopStream()
+{
+    stopRecording();                        // Every page is in flash and the session is closed
+    streaming = false;
+    Downlink.endLive();                     // The host NAKs its gaps, served from flash like a download
+    currentState = DATA_TRANSFER;
+    Gui.clear();
+}
+
 void setup()
 {
     Serial.begin(UART_SPEED); 
@@ -94,13 +623,15 @@ void setup()
     Buzzer.setVolume(BUZ_VALUE);
     oled.init();
     Gui.init();
-    Memory1.init();
-    Memory2.init();
+    Memory.init();
+    Sensors.setMagPreset(MAG_PRESET);
     Sensors.set_AllMaxSpeed(); 
-    oled.clearDisplay();
+    acquisitionThread.start(acquisitionTask);
+    storageThread.start(storageTask);
+    Gui.clear();
     Gui.render();
-    Buzzer.chirp();
-    Leds.blink(250);
+    Signals.begin();
+    Signals.play(PatternPlayer::READY);
 }
 
 void loop()
@@ -113,93 +644,87 @@ void loop()
             if (ev == ButtonHandler::LONG_PRESS)
             {
                 int line = Gui.getCurrentLine();
-                if (line == 6)  // START
+                if (line == 6 && initAllowed(Gui.getSelectedSensors()))  // START
                 {
                     selectedMode = Gui.getSelectedSensors();
                     selectedFreq = Gui.getSelectedFreq();
+                    Gui.startTimer(Gui.getSelectedTime());
                     currentState = COUNTDOWN;
                 }
                 else if (line == 5) // GETDATA
                 {
-                    page1 = 0; page2 = 0;
-                    selectedMode = Gui.getSelectedSensors();
+                    Downlink.begin();
                     currentState = DATA_TRANSFER;
-                    oled.clearDisplay();
+                    Gui.clear();
                 }
             }
             break;
 
         case COUNTDOWN:
-            if (Gui.runTimer(Gui.getSelectedTime(), &Button))
             {
-                if (Gui.getSelectedInit() == 0)
-                { 
-                    startRecording(); 
-                    currentState = RECORDING;
-                } else
-                { 
-                    oled.clearDisplay();
-                    oled.setTextXY(3, 1);
-                    oled.putString("READY! WAIT HIT");
-                    Buzzer.chirp();
-                    currentState = WAIT_HIT;
+                Display::TimerState timer = Gui.runTimer(ev);
+                if (timer == Display::TIMER_DONE)
+                {
+                    if (Gui.getSelectedInit() == 0 || Gui.getSelectedInit() == INIT_ADAPTIVE)
+                    { 
+                        if (startRecording(false, Gui.getSelectedInit() == INIT_ADAPTIVE)) currentState = RECORDING;
+                        else stopRecording();
+                    } else if (Gui.getSelectedInit() == INIT_STREAM)
+                    {
+                        if (startRecording(true, false)) currentState = STREAM;
+                        else stopRecording();
+                    } else if (armHit())
+                    { 
+                        Gui.showMessage(3, 1, "READY! WAIT HIT");
+                        Signals.play(PatternPlayer::CHIRP);
+                        currentState = WAIT_HIT;
+                    } else
+                    {
+                        stopRecording();
+                    }
+                } else if (timer == Display::TIMER_CANCELLED)
+                {
+                    stopRecording();
                 }
-            } else
-            {
-                stopRecording();
             }
             break;
 
         case WAIT_HIT:
-            if (Sensors.checkHit())
+            if (!waitingHit)                    // Triggered: the acquisition thread already queues the live records
             {
-                Buzzer.chirp();
-                startRecording();
-                currentState = RECORDING;
+                Signals.play(PatternPlayer::CHIRP);
+                if (openSession())
+                {
+                    Gui.clear();
+                    currentState = RECORDING;
+                }
+                else
+                {
+                    showMemoryFull();
+                    stopRecording();
+                }
             }
-            if (ev == ButtonHandler::LONG_PRESS) stopRecording();
+            else if (ev == ButtonHandler::LONG_PRESS) stopRecording();
             break;
 
         case RECORDING:
             if (ev == ButtonHandler::LONG_PRESS)
             {
                 stopRecording();
-                Buzzer.chirp();
+                Signals.play(PatternPlayer::CHIRP);
                 return;
             }
 
-            if (timeToReadSensors)
-            {
-                timeToReadSensors = false;
-                uint8_t status = Sensors.collectAndPack(selectedMode, pageBuffer1, offset1, pageBuffer2, offset2);
-                samplesInSecond++;
-                if (status & 1)
-                {
-                    readyM1 = true;
-                }
-                if (status & 2)
-                {
-                    readyM2 = true;
-                }
-            }
-
-            if (readyM1)
-            { 
-                Memory1.writePage(page1++, pageBuffer1); 
-                readyM1 = false; 
-            }
-            
-            if (readyM2)
-            { 
-                Memory2.writePage(page2++, pageBuffer2); 
-                readyM2 = false; 
-            }
             /* DEBUG: DATA WRITE SPEED
             if (millis() - lastStatMillis > 1000)
             {
                 Serial.print(F("Freq: ")); Serial.print(samplesInSecond); 
                 Serial.print(F(" Hz | M1 Pg: ")); Serial.print(page1);
-                Serial.print(F(" | M2 Pg: ")); Serial.println(page2);
+                Serial.print(F(" | M2 Pg: ")); Serial.print(page2);
+                Serial.print(F(" | Queue: ")); Serial.print(Samples.size());
+                Serial.print(F(" | Pages: ")); Serial.print(Pages.count());
+                Serial.print(F(" | Dropped: ")); Serial.print(droppedSamples);
+                Serial.print(F(" | Read: ")); Serial.print(readCostUs); Serial.println(F(" us"));
                 samplesInSecond = 0;
                 lastStatMillis = millis();
             }
@@ -208,43 +733,37 @@ void loop()
             if (millis() - guiT > 200)
             {
                 guiT = millis();
-                if (Gui.renderStorageProgress(page1, page2, 65536))
+                if (Gui.renderStorageProgress(page1, page2, fullChipPages()))
                 {
                     stopRecording();
                 }
             }
             break;
 
-        case DATA_TRANSFER:
+        case STREAM:
+            if (ev == ButtonHandler::LONG_PRESS)
             {
-                const uint32_t totalPages = 65536;
-                static uint8_t transferBuf[256];
-                static bool modeSent = false;
-
-                if (!modeSent) // Send once when transmitting data (sensors)
+                stopStream();
+                Signals.play(PatternPlayer::CHIRP);
+                return;
+            }
+            Downlink.step();                // One queued page per pass
+            static uint32_t streamGuiT = 0;
+            if (millis() - streamGuiT > 200)
+            {
+                streamGuiT = millis();
+                if (Gui.renderStorageProgress(page1, page2, fullChipPages()))
                 {
-                    uint8_t m = (uint8_t)selectedMode;
-                    Serial.write(m); 
-                    modeSent = true;
-                    return; 
+                    stopStream();
                 }
-                // Sequential unloading data
-                if (page1 < totalPages)
-                {
-                    Memory1.readPage(page1, transferBuf);
-                    Serial.write(transferBuf, 256);
-                    page1++;
-                } 
-                else if (page2 < totalPages)
-                {
-                    Memory2.readPage(page2, transferBuf);
-                    Serial.write(transferBuf, 256);
-                    page2++;
-                } 
-                else    // end of transmitting
+            }
+            break;
+
+        case DATA_TRANSFER:
+            {
+                if (!Downlink.step())   // end of transmitting (host ACK or NAK window closed)
                 {
-                    modeSent = false; // Сброс флага для следующего раза
-                    Buzzer.chirp();
+                    Signals.play(PatternPlayer::DOUBLE_BEEP);
                     stopRecording();
                     return;
                 }
@@ -253,17 +772,19 @@ void loop()
                 if (millis() - lastUpdate > 300)
                 {
                     lastUpdate = millis();
-                    Gui.renderStorageProgress(page1, page2, totalPages);
+                    uint32_t pages = Downlink.getPages();
+                    Gui.renderStorageProgress(Downlink.getSent(), Downlink.getSent(), pages > 0 ? pages : 1);
                 }
 
                 // Cancel job
                 if (ev == ButtonHandler::LONG_PRESS)
                 {
-                    modeSent = false;
-                    Buzzer.chirp();
+                    Downlink.cancel();
+                    Signals.play(PatternPlayer::CHIRP);
                     stopRecording();
                 }
             }
             break;
     }
+    Gui.refresh(OLED_BUDGET_US);     // A few changed characters per pass, the rest on the next ones
 }
\ No newline at end of file